@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+#include "thread_pool.h"
+
+// What the CPU-only benchmarks share: timing, and the command line they all take,
+//
+//   <name> [iterations] [threads]
+//
+// threads 0 or missing: one worker per hardware thread.
+namespace bench {
+
+inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// mean time of one call of fn over iterations calls
+template <typename Fn>
+double averageMs(int iterations, Fn&& fn) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    fn();
+  }
+  return elapsedMs(start) / (iterations > 0 ? iterations : 1);
+}
+
+// the parsed command line, the logger writing <name>.log and the ThreadPool
+struct Context {
+  Context(int argc, char** argv, const std::string& name, int defaultIterations = 20)
+      : iterations(argc > 1 ? std::atoi(argv[1]) : defaultIterations),
+        logger(initLogger(name + ".log", "bench")),
+        pool(workerCount(argc, argv)) {}
+
+  int iterations;
+  quill::Logger* logger;
+  ThreadPool pool;
+
+ private:
+  static std::size_t workerCount(int argc, char** argv) {
+    const std::size_t threads = argc > 2 ? static_cast<std::size_t>(std::atol(argv[2])) : 0;
+    return threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+  }
+};
+
+}  // namespace bench
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "bvh.h"
+#include "frustum_culling.h"
+#include "logger.h"
+#include "thread_pool.h"
+
+// Times Bvh::build() single threaded and on a ThreadPool, refit() after every object moved, and
+// frustum and box queries against the linear SoA culling kernels, at 100k and 1M objects.
+// Also logs the memory per node and per object. CPU only, no window.
+//
+//   bvh_benchmark [iterations] [threads]
+
+int main(int argc, char** argv) {
+  bench::Context context(argc, argv, "bvh_benchmark", 10);
+  const int iterations = context.iterations;
+  auto* logger = context.logger;
+  ThreadPool& pool = context.pool;
+
+  for (std::size_t objectCount : {std::size_t{100000}, std::size_t{1000000}}) {
+    // boxes of 1 to 8 units in a 1000 unit cube, the camera in the middle looking along +x
+    std::mt19937 random(13);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+    std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+    std::vector<Aabb> bounds(objectCount);
+    AabbSoA soa;
+    soa.resize(objectCount);
+    for (std::size_t i = 0; i < objectCount; ++i) {
+      const math::vec3 center{position(random), position(random), position(random)};
+      const math::vec3 extents{size(random), size(random), size(random)};
+      bounds[i] = {center - extents, center + extents};
+      soa.set(i, bounds[i].min, bounds[i].max);
+    }
+
+    Bvh bvh;
+    for (ThreadPool* buildPool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+      const double buildMs = bench::averageMs(iterations, [&] { bvh.build(bounds, buildPool); });
+      LOG_INFO(logger, "bvh benchmark: {} objects, {} threads: build {:.3f}ms, {} nodes, SAH cost {:.1f}",
+               objectCount, buildPool != nullptr ? pool.size() : 1, buildMs, bvh.nodes().size(), bvh.sahCost());
+    }
+    LOG_INFO(logger, "bvh benchmark: {} objects: {} bytes per node, {:.1f} bytes per object in total", objectCount,
+             sizeof(BvhNode), static_cast<double>(bvh.memoryBytes()) / static_cast<double>(objectCount));
+
+    // every object takes a small random step per frame
+    const float buildCost = bvh.sahCost();
+    double refitMs = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+      for (Aabb& box : bounds) {
+        const math::vec3 delta{step(random), step(random), step(random)};
+        box.min += delta;
+        box.max += delta;
+      }
+      const auto start = std::chrono::steady_clock::now();
+      bvh.refit(bounds);
+      refitMs += bench::elapsedMs(start) / iterations;
+    }
+    LOG_INFO(logger, "bvh benchmark: {} objects: refit {:.3f}ms, SAH cost {:.1f} -> {:.1f} after {} refits",
+             objectCount, refitMs, buildCost, bvh.sahCost(), bvh.refitsSinceBuild());
+    bvh.build(bounds, &pool);
+    for (std::size_t i = 0; i < objectCount; ++i) {
+      soa.set(i, bounds[i].min, bounds[i].max);
+    }
+
+    // a far plane of 500 units sees a few percent of the objects, one of 50 very few
+    FrustumCuller culler;
+    std::vector<std::uint32_t> visible;
+    visible.reserve(objectCount);
+    for (float farPlane : {500.0f, 50.0f}) {
+      const math::mat4 viewProjection = math::perspective(1.047f, 16.0f / 9.0f, 0.1f, farPlane) *
+                                        math::lookAt({0.0f, 0.0f, 0.0f}, {1.0f, 0.1f, 0.3f}, {0.0f, 1.0f, 0.0f});
+      const Frustum frustum = Frustum::fromMatrix(viewProjection);
+      const double bvhCullMs = bench::averageMs(iterations, [&] {
+        visible.clear();
+        bvh.cull(frustum, visible);
+      });
+      std::size_t linearVisible = 0;
+      const double linearCullMs =
+          bench::averageMs(iterations, [&] { linearVisible = culler.cull(frustum, soa).size(); });
+      LOG_INFO(logger, "bvh benchmark: {} objects, far plane {}: cull {:.3f}ms, linear SoA {:.3f}ms, {} visible",
+               objectCount, farPlane, bvhCullMs, linearCullMs, visible.size());
+      if (linearVisible != visible.size()) {
+        LOG_ERROR(logger, "bvh benchmark: the linear cull found {} visible objects", linearVisible);
+      }
+    }
+
+    // a 20 unit box, as e.g. for picking or neighbour queries
+    std::vector<std::uint32_t> hits;
+    const double overlapMs = bench::averageMs(iterations * 100, [&] {
+      const math::vec3 center{position(random), position(random), position(random)};
+      hits.clear();
+      bvh.overlap({center - math::vec3(10.0f), center + math::vec3(10.0f)}, hits);
+    });
+    LOG_INFO(logger, "bvh benchmark: {} objects: box query {:.4f}ms, {} hits", objectCount, overlapMs, hits.size());
+  }
+  return 0;
+}
@@ -0,0 +1,193 @@
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "command_list.h"
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "pipeline_state.h"
+#include "shader.h"
+#include "thread_pool.h"
+#include "uniform_buffer.h"
+#include "unit_quad.h"
+// clang-format on
+
+// Draws 20k textured quads per frame into a hidden window, each with its own Object block, and
+// reports the CPU time to record the frame's CommandLists on one thread and on the ThreadPool,
+// and to replay them on the GL thread. List i holds chunk i of the objects whatever worker
+// records it, so both recordings replay the same GL command stream.
+//
+//   command_list_benchmark [frames] [threads] [objects]
+
+namespace {
+
+// the blocks of 4.2.texture.vs (see shaders/frame.glsl)
+struct FrameBlock {
+  glsl::mat4 viewProjection;
+};
+struct ObjectBlock {
+  glsl::mat4 model;
+};
+static_assert(checkBlockLayout<FrameBlock>(BlockLayout::Std140, {BLOCK_MEMBER(FrameBlock, viewProjection)}));
+static_assert(checkBlockLayout<ObjectBlock>(BlockLayout::Std140, {BLOCK_MEMBER(ObjectBlock, model)}));
+
+constexpr GLuint kFrameBinding = 0;
+constexpr GLuint kObjectBinding = 1;
+constexpr std::size_t kChunkObjects = 256;
+
+// a procedural 16x16 checker, so no image files are needed
+GLuint makeTexture(GlStateCache& glState, std::uint32_t dark) {
+  constexpr int kTextureSize = 16;
+  std::vector<std::uint32_t> pixels(kTextureSize * kTextureSize);
+  for (int y = 0; y < kTextureSize; ++y) {
+    for (int x = 0; x < kTextureSize; ++x) {
+      pixels[y * kTextureSize + x] = ((x / 4) + (y / 4)) % 2 == 0 ? 0xFFFFFFFFu : dark;
+    }
+  }
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glState.bindTexture(0, GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kTextureSize, kTextureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  return texture;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Context context(argc, argv, "command_list_benchmark", 300);
+  const int frames = context.iterations;
+  const std::size_t objectCount = argc > 3 ? static_cast<std::size_t>(std::atol(argv[3])) : 20000;
+  auto* logger = context.logger;
+  ThreadPool& pool = context.pool;
+
+  glfwInit();
+  // runs last, after every GL object below has been deleted
+  struct GlfwTerminator {
+    ~GlfwTerminator() { glfwTerminate(); }
+  } glfwTerminator;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  GLFWwindow* window = glfwCreateWindow(1280, 720, "command_list_benchmark", nullptr, nullptr);
+  if (window == nullptr) {
+    LOG_ERROR(logger, "Failed to create GLFW window");
+    return -1;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSwapInterval(0);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    LOG_ERROR(logger, "Failed to initialize GLAD");
+    return -1;
+  }
+
+  Shader shader("shaders/4.2.texture.vs", "shaders/4.2.texture.fs", logger);
+  if (shader.shaderProgram == 0) {
+    return -1;
+  }
+  shader.bindUniformBlock("Frame", kFrameBinding);
+  shader.bindUniformBlock("Object", kObjectBinding);
+
+  GlStateCache glState;
+  GlResourceRegistry resources(glState, logger);
+  glState.useProgram(shader.shaderProgram);
+  shader.setInt(UniformName("texture1"), 0);
+  shader.setInt(UniformName("texture2"), 1);
+  const GLuint texture1 = makeTexture(glState, 0xFF2060A0u);
+  const GLuint texture2 = makeTexture(glState, 0x00000000u);
+
+  MeshPool quadPool = makeQuadPool(resources, glState, 4, 6, logger);
+  const MeshRange quad = quadPool.range(addUnitQuad(quadPool));
+  PipelineCache pipelines;
+  PipelineContext pipelineContext(glState);
+  PipelineDesc desc;
+  desc.shader = &shader;
+  desc.vertexArray = quadPool.vertexArray();
+  const PipelineState* pipeline = pipelines.create(desc);
+
+  // small quads scattered over clip space; the identity viewProjection keeps the setup simple
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<math::mat4> models(objectCount);
+  for (auto& model : models) {
+    model = math::translate({unit(random), unit(random), 0.0f}) * math::scale({0.02f, 0.02f, 1.0f});
+  }
+  const FrameBlock frameBlock{glsl::toMat4(math::mat4())};
+
+  const std::size_t chunks = (objectCount + kChunkObjects - 1) / kChunkObjects;
+  std::vector<CommandList> lists(chunks);
+  auto recordChunk = [&](std::size_t index, std::size_t) {
+    CommandList& list = lists[index];
+    list.reset();
+    list.setPipeline(*pipeline);
+    list.bindTexture(0, GL_TEXTURE_2D, texture1);
+    list.bindTexture(1, GL_TEXTURE_2D, texture2);
+    DrawCommand draw;
+    draw.count = static_cast<GLsizei>(quad.indexCount);
+    draw.offset = quad.firstIndex * sizeof(GLuint);
+    draw.baseVertex = quad.baseVertex;
+    const std::size_t end = std::min(objectCount, (index + 1) * kChunkObjects);
+    for (std::size_t i = index * kChunkObjects; i < end; ++i) {
+      list.uniformBlock(kObjectBinding, ObjectBlock{glsl::toMat4(models[i])});
+      list.draw(draw);
+    }
+  };
+
+  // every Object block takes a whole uniform offset alignment
+  UniformRing uniforms(static_cast<GLsizeiptr>((objectCount + 1) * 256), logger);
+  double serialMs = 0.0;
+  double parallelMs = 0.0;
+  double replayMs = 0.0;
+  bool overflowed = false;
+  for (int frame = 0; frame < frames; ++frame) {
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t index = 0; index < chunks; ++index) {
+      recordChunk(index, 0);
+    }
+    serialMs += bench::elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    pool.parallelFor(chunks, recordChunk);
+    parallelMs += bench::elapsedMs(start);
+    for (const CommandList& list : lists) {
+      overflowed |= list.overflowed();
+    }
+
+    start = std::chrono::steady_clock::now();
+    uniforms.beginFrame();
+    uniforms.bind(glState, kFrameBinding, uniforms.push(frameBlock));
+    replayCommandLists(lists, pipelineContext, glState, uniforms);
+    uniforms.endFrame();
+    replayMs += bench::elapsedMs(start);
+    glfwSwapBuffers(window);
+  }
+  if (overflowed) {
+    LOG_ERROR(logger, "command list benchmark: a list overflowed, the results are incomplete");
+  }
+
+  const double n = frames > 0 ? frames : 1;
+  LOG_INFO(logger, "command list benchmark: objects={} lists={} threads={} frames={}", objectCount, chunks,
+           pool.size(), frames);
+  LOG_INFO(logger, "command list benchmark: record serial={:.3f}ms parallel={:.3f}ms ({:.2f}x), replay={:.3f}ms",
+           serialMs / n, parallelMs / n, parallelMs > 0.0 ? serialMs / parallelMs : 0.0, replayMs / n);
+
+  glState.deleteTexture(texture1);
+  glState.deleteTexture(texture2);
+  glState.deleteProgram(shader.shaderProgram);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "frustum_culling.h"
+#include "logger.h"
+#include "thread_pool.h"
+
+// Times frustum culling of 1M bounding spheres and 1M boxes scattered around a camera: a
+// per-object loop over an array of structs as the baseline, then the SoA kernels single
+// threaded and on a ThreadPool. CPU only, no window.
+//
+//   culling_benchmark [iterations] [threads]
+
+namespace {
+
+constexpr std::size_t kObjects = 1000000;
+
+struct Sphere {
+  math::vec3 center;
+  float radius;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Context context(argc, argv, "culling_benchmark");
+  const int iterations = context.iterations;
+  auto* logger = context.logger;
+  ThreadPool& pool = context.pool;
+
+  // objects in a 1000 unit cube around a camera with a 60 degree field of view and a 500 unit
+  // far plane, so a few percent of them survive
+  std::mt19937 random(11);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> size(0.5f, 4.0f);
+  std::vector<Sphere> sphereArray(kObjects);
+  SphereSoA spheres;
+  AabbSoA boxes;
+  spheres.resize(kObjects);
+  boxes.resize(kObjects);
+  for (std::size_t i = 0; i < kObjects; ++i) {
+    const math::vec3 center{position(random), position(random), position(random)};
+    const math::vec3 extents{size(random), size(random), size(random)};
+    sphereArray[i] = {center, math::length(extents)};
+    spheres.set(i, center, sphereArray[i].radius);
+    boxes.set(i, center - extents, center + extents);
+  }
+  const math::mat4 viewProjection = math::perspective(1.047f, 16.0f / 9.0f, 0.1f, 500.0f) *
+                                    math::lookAt({0.0f, 0.0f, 0.0f}, {1.0f, 0.1f, 0.3f}, {0.0f, 1.0f, 0.0f});
+  const Frustum frustum = Frustum::fromMatrix(viewProjection);
+
+  std::vector<std::uint32_t> scalarVisible;
+  scalarVisible.reserve(kObjects);
+  const double scalarMs = bench::averageMs(iterations, [&] {
+    scalarVisible.clear();
+    for (std::size_t i = 0; i < kObjects; ++i) {
+      if (frustum.intersectsSphere(sphereArray[i].center, sphereArray[i].radius)) {
+        scalarVisible.push_back(static_cast<std::uint32_t>(i));
+      }
+    }
+  });
+  LOG_INFO(logger, "culling benchmark: {} spheres, per object (array of structs): {:.3f}ms, {} visible", kObjects,
+           scalarMs, scalarVisible.size());
+
+  FrustumCuller culler;
+  for (ThreadPool* cullPool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+    const std::size_t threadCount = cullPool != nullptr ? pool.size() : 1;
+    std::size_t visible = 0;
+    const double sphereMs =
+        bench::averageMs(iterations, [&] { visible = culler.cull(frustum, spheres, cullPool).size(); });
+    LOG_INFO(logger, "culling benchmark: {} spheres, SoA, {} threads: {:.3f}ms, {} visible", kObjects, threadCount,
+             sphereMs, visible);
+    const double boxMs = bench::averageMs(iterations, [&] { visible = culler.cull(frustum, boxes, cullPool).size(); });
+    LOG_INFO(logger, "culling benchmark: {} boxes, SoA, {} threads: {:.3f}ms, {} visible", kObjects, threadCount,
+             boxMs, visible);
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "frustum_culling.h"
+#include "logger.h"
+#include "occlusion_culling.h"
+#include "thread_pool.h"
+
+// Times OcclusionBuffer on a city block scene: a grid of buildings (12-triangle boxes) as
+// occluders and 200k small boxes scattered between and behind them as occludees, seen from
+// street level. Logs the rasterization time single threaded and on a ThreadPool, the time to
+// test the frustum-culled occludees, and how many of those are hidden. CPU only, no window.
+//
+//   occlusion_benchmark [iterations] [threads]
+
+namespace {
+
+constexpr int kBufferWidth = 320;
+constexpr int kBufferHeight = 192;
+constexpr int kGrid = 40;  // buildings per side
+constexpr std::size_t kOccludees = 200000;
+
+// counter-clockwise seen from outside, corners indexed by (x, y, z) bits
+constexpr std::uint32_t kBoxIndices[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                           2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+
+void appendCorners(const Aabb& box, std::vector<math::vec3>& vertices) {
+  for (int corner = 0; corner < 8; ++corner) {
+    vertices.push_back({(corner & 1) != 0 ? box.max.x : box.min.x, (corner & 2) != 0 ? box.max.y : box.min.y,
+                        (corner & 4) != 0 ? box.max.z : box.min.z});
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Context context(argc, argv, "occlusion_benchmark");
+  const int iterations = context.iterations;
+  auto* logger = context.logger;
+  ThreadPool& pool = context.pool;
+
+  // buildings of 12 to 20 units on a 30 unit grid, 10 to 60 units tall
+  std::mt19937 random(17);
+  std::uniform_real_distribution<float> footprint(6.0f, 10.0f);
+  std::uniform_real_distribution<float> tall(10.0f, 60.0f);
+  std::vector<std::vector<math::vec3>> buildings;
+  for (int gx = 0; gx < kGrid; ++gx) {
+    for (int gz = 0; gz < kGrid; ++gz) {
+      const math::vec3 center{(static_cast<float>(gx) - kGrid / 2) * 30.0f, 0.0f,
+                              (static_cast<float>(gz) - kGrid / 2) * 30.0f};
+      const math::vec3 half{footprint(random), 0.0f, footprint(random)};
+      buildings.emplace_back();
+      appendCorners({center - half, center + half + math::vec3{0.0f, tall(random), 0.0f}}, buildings.back());
+    }
+  }
+
+  std::uniform_real_distribution<float> spread(-kGrid * 15.0f, kGrid * 15.0f);
+  std::uniform_real_distribution<float> height(0.0f, 20.0f);
+  std::uniform_real_distribution<float> size(0.3f, 2.0f);
+  std::vector<Aabb> boxes(kOccludees);
+  AabbSoA soa;
+  soa.resize(kOccludees);
+  for (std::size_t i = 0; i < kOccludees; ++i) {
+    const math::vec3 center{spread(random), height(random), spread(random)};
+    const math::vec3 half{size(random), size(random), size(random)};
+    boxes[i] = {center - half, center + half};
+    soa.set(i, boxes[i].min, boxes[i].max);
+  }
+
+  // at street level between two rows of buildings, looking down the street
+  const math::mat4 viewProjection =
+      math::perspective(1.047f, static_cast<float>(kBufferWidth) / kBufferHeight, 0.5f, 1000.0f) *
+      math::lookAt({15.0f, 2.0f, 15.0f}, {15.3f, 2.0f, -100.0f}, {0.0f, 1.0f, 0.0f});
+  FrustumCuller culler;
+  const std::span<const std::uint32_t> candidates = culler.cull(Frustum::fromMatrix(viewProjection), soa);
+
+  OcclusionBuffer occlusion(kBufferWidth, kBufferHeight);
+  for (ThreadPool* rasterPool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+    const double rasterMs = bench::averageMs(iterations, [&] {
+      occlusion.clear();
+      for (const auto& building : buildings) {
+        occlusion.addOccluder(building, kBoxIndices, viewProjection);
+      }
+      occlusion.rasterize(rasterPool);
+    });
+    LOG_INFO(logger, "occlusion benchmark: {} occluder triangles ({} front facing on screen), {} threads: {:.3f}ms",
+             buildings.size() * 12, occlusion.rasterizedTriangles(), rasterPool != nullptr ? pool.size() : 1,
+             rasterMs);
+  }
+
+  std::vector<std::uint32_t> visible;
+  visible.reserve(candidates.size());
+  const double testMs = bench::averageMs(iterations, [&] {
+    visible.clear();
+    occlusion.filterVisible(candidates, boxes, viewProjection, visible);
+  });
+  LOG_INFO(logger, "occlusion benchmark: {} occludees, {} in the frustum, {} not hidden, test {:.3f}ms", kOccludees,
+           candidates.size(), visible.size(), testMs);
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "logger.h"
+#include "scene_graph.h"
+#include "thread_pool.h"
+
+// Times SceneGraph::update() on random hierarchies of 10k, 100k and 1M nodes, single threaded
+// and on a ThreadPool: a full update (every root moved, so every node is recomputed), a
+// partial one (1% of the nodes moved) and a clean one (nothing moved). CPU only, no window.
+//
+//   scene_benchmark [iterations] [threads]
+
+namespace {
+
+struct Timings {
+  double fullMs = 0.0;
+  double partialMs = 0.0;
+  double cleanMs = 0.0;
+  std::size_t partialNodes = 0;
+};
+
+Timings run(SceneGraph& graph, const std::vector<SceneNode>& nodes, const std::vector<SceneNode>& roots,
+            ThreadPool* pool, int iterations, std::mt19937& random) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_int_distribution<std::size_t> pick(0, nodes.size() - 1);
+  Timings timings;
+  for (int i = 0; i < iterations; ++i) {
+    for (SceneNode root : roots) {
+      graph.setTranslation(root, {unit(random), unit(random), unit(random)});
+    }
+    auto start = std::chrono::steady_clock::now();
+    graph.update(pool);
+    timings.fullMs += bench::elapsedMs(start);
+
+    for (std::size_t k = 0; k < nodes.size() / 100; ++k) {
+      graph.setRotation(nodes[pick(random)], math::quat::fromAxisAngle({0.0f, 0.0f, 1.0f}, unit(random)));
+    }
+    start = std::chrono::steady_clock::now();
+    timings.partialNodes = graph.update(pool);
+    timings.partialMs += bench::elapsedMs(start);
+
+    graph.update(pool);  // clears the changed flags of the partial update
+    start = std::chrono::steady_clock::now();
+    graph.update(pool);
+    timings.cleanMs += bench::elapsedMs(start);
+  }
+  const double n = iterations > 0 ? iterations : 1;
+  timings.fullMs /= n;
+  timings.partialMs /= n;
+  timings.cleanMs /= n;
+  return timings;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Context context(argc, argv, "scene_benchmark");
+  const int iterations = context.iterations;
+  auto* logger = context.logger;
+  ThreadPool& pool = context.pool;
+
+  for (std::size_t nodeCount : {std::size_t{10000}, std::size_t{100000}, std::size_t{1000000}}) {
+    // a random recursive tree: every node hangs below a random earlier one, with a root every
+    // ~1000 nodes; depths grow logarithmically (about 30 levels at 1M nodes)
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    SceneGraph graph(nodeCount);
+    std::vector<SceneNode> nodes;
+    std::vector<SceneNode> roots;
+    nodes.reserve(nodeCount);
+    for (std::size_t i = 0; i < nodeCount; ++i) {
+      SceneNode parent;
+      if (i % 1000 != 0) {
+        parent = nodes[std::uniform_int_distribution<std::size_t>(0, i - 1)(random)];
+      }
+      nodes.push_back(graph.add(parent, {unit(random), unit(random), unit(random)},
+                                math::quat::fromAxisAngle({unit(random), unit(random), 1.0f}, unit(random))));
+      if (!parent.valid()) {
+        roots.push_back(nodes.back());
+      }
+    }
+    auto start = std::chrono::steady_clock::now();
+    graph.update(&pool);
+    const double buildMs = bench::elapsedMs(start);
+
+    LOG_INFO(logger, "scene benchmark: {} nodes, {} depths, first update (sort + all nodes) {:.3f}ms", nodeCount,
+             graph.depthCount(), buildMs);
+    for (ThreadPool* updatePool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+      const Timings t = run(graph, nodes, roots, updatePool, iterations, random);
+      LOG_INFO(logger, "scene benchmark: {} nodes, {} threads: full {:.3f}ms, partial ({} nodes) {:.3f}ms",
+               nodeCount, updatePool != nullptr ? pool.size() : 1, t.fullMs, t.partialNodes, t.partialMs);
+      LOG_INFO(logger, "scene benchmark: {} nodes, {} threads: clean {:.3f}ms", nodeCount,
+               updatePool != nullptr ? pool.size() : 1, t.cleanMs);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,180 @@
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "logger.h"
+#include "shader.h"
+#include "sprite_batch.h"
+#include "stream_buffer.h"
+#include "unit_quad.h"
+// clang-format on
+
+// Draws 100k sprites per frame through SpriteBatch into a hidden window and reports the CPU
+// time to fill and submit the batch and the GPU time of the draws, once with an orphaned
+// instance buffer and once streaming through a persistently mapped StreamBuffer.
+//
+//   sprite_benchmark [frames] [sprites]
+
+int main(int argc, char** argv) {
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 300;
+  const std::size_t spriteCount = argc > 2 ? static_cast<std::size_t>(std::atol(argv[2])) : 100000;
+  auto logger = initLogger("sprite_benchmark.log", "bench");
+
+  glfwInit();
+  // runs last, after every GL object below has been deleted
+  struct GlfwTerminator {
+    ~GlfwTerminator() { glfwTerminate(); }
+  } glfwTerminator;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  GLFWwindow* window = glfwCreateWindow(1280, 720, "sprite_benchmark", nullptr, nullptr);
+  if (window == nullptr) {
+    LOG_ERROR(logger, "Failed to create GLFW window");
+    return -1;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSwapInterval(0);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    LOG_ERROR(logger, "Failed to initialize GLAD");
+    return -1;
+  }
+
+  Shader shader("shaders/sprite.vs", "shaders/sprite.fs", logger);
+  if (shader.shaderProgram == 0) {
+    return -1;
+  }
+
+  GlStateCache glState;
+  GlResourceRegistry resources(glState, logger);
+
+  // the unit quad main.cpp draws, in a mesh pool of its vertex format
+  MeshPool quadPool = makeQuadPool(resources, glState, 4, 6, logger);
+  const MeshHandle quad = addUnitQuad(quadPool);
+  SpriteBatch orphaningBatch(resources, glState, quadPool, quad, spriteCount, logger);
+  StreamBuffer stream(static_cast<GLsizeiptr>(spriteCount * sizeof(SpriteInstance)), logger);
+  SpriteBatch streamingBatch(resources, glState, quadPool, quad, spriteCount, logger, &stream);
+
+  // two procedural 16x16 layers, so no image files are needed
+  constexpr int kTextureSize = 16;
+  std::vector<std::uint32_t> pixels(kTextureSize * kTextureSize * 2);
+  for (int layer = 0; layer < 2; ++layer) {
+    for (int y = 0; y < kTextureSize; ++y) {
+      for (int x = 0; x < kTextureSize; ++x) {
+        bool checker = ((x / 4) + (y / 4) + layer) % 2 == 0;
+        pixels[(layer * kTextureSize + y) * kTextureSize + x] = checker ? 0xFFFFFFFFu : 0xFF808080u;
+      }
+    }
+  }
+  GLuint textureArray;
+  glGenTextures(1, &textureArray);
+  glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, kTextureSize, kTextureSize, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels.data());
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // sprites scattered over clip space; the identity viewProjection keeps the shader simple
+  struct Sprite {
+    float x, y, spin, layer;
+  };
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<Sprite> sprites(spriteCount);
+  for (auto& sprite : sprites) {
+    sprite = {unit(random), unit(random), unit(random) * 3.0f, unit(random) < 0.0f ? 0.0f : 1.0f};
+  }
+  // identity viewProjection, untinted
+  const SpriteFrameBlock frameBlock = {{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}}, {1, 1, 1, 1}};
+  constexpr GLuint kFrameBinding = 0;
+  GLuint frameBuffer;
+  glGenBuffers(1, &frameBuffer);
+  glState.bindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frameBlock), &frameBlock, GL_STATIC_DRAW);
+  glState.bindBufferRange(GL_UNIFORM_BUFFER, kFrameBinding, frameBuffer, 0, sizeof(frameBlock));
+  shader.bindUniformBlock("SpriteFrame", kFrameBinding);
+
+  glState.useProgram(shader.shaderProgram);
+  shader.setInt("sprites", 0);
+  glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+  glState.setEnabled(GL_BLEND, true);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // GPU times are read kTimerLatency frames late, more than the StreamBuffer's frames in flight,
+  // so reading them does not wait for the GPU and keeps the CPU / GPU overlap being measured
+  constexpr int kTimerLatency = 4;
+  GLuint timers[kTimerLatency];
+  glGenQueries(kTimerLatency, timers);
+  auto run = [&](const char* label, SpriteBatch& batch, StreamBuffer* frameStream) {
+    double fillMs = 0.0;
+    double submitMs = 0.0;
+    double gpuMs = 0.0;
+    int gpuFrames = 0;
+    std::size_t drawCalls = 0;
+    auto readTimer = [&](int frame) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(timers[frame % kTimerLatency], GL_QUERY_RESULT, &nanoseconds);
+      gpuMs += static_cast<double>(nanoseconds) / 1e6;
+      ++gpuFrames;
+    };
+    for (int frame = 0; frame < frames; ++frame) {
+      glClear(GL_COLOR_BUFFER_BIT);
+      if (frameStream != nullptr) {
+        frameStream->beginFrame();
+      }
+
+      auto fillStart = std::chrono::steady_clock::now();
+      const float time = static_cast<float>(frame) / 60.0f;
+      batch.clear();
+      for (const auto& sprite : sprites) {
+        batch.add(SpriteInstance::make(sprite.x, sprite.y, 0.01f, 0.01f, sprite.spin * time, sprite.layer));
+      }
+      fillMs += elapsedMs(fillStart);
+
+      if (frame >= kTimerLatency) {
+        readTimer(frame - kTimerLatency);  // its query is reused below
+      }
+      glBeginQuery(GL_TIME_ELAPSED, timers[frame % kTimerLatency]);
+      auto submitStart = std::chrono::steady_clock::now();
+      drawCalls = batch.draw(glState);
+      submitMs += elapsedMs(submitStart);
+      glEndQuery(GL_TIME_ELAPSED);
+      if (frameStream != nullptr) {
+        frameStream->endFrame();
+      }
+      glfwSwapBuffers(window);
+    }
+    // the last frames' timers, so the next run starts with unused queries
+    for (int frame = std::max(frames - kTimerLatency, 0); frame < frames; ++frame) {
+      readTimer(frame);
+    }
+
+    const double n = frames > 0 ? frames : 1;
+    LOG_INFO(logger, "sprite benchmark [{}]: sprites={} frames={} drawCalls/frame={}", label, spriteCount, frames,
+             drawCalls);
+    LOG_INFO(logger, "sprite benchmark [{}]: fill={:.3f}ms submit={:.3f}ms gpu={:.3f}ms per frame", label, fillMs / n,
+             submitMs / n, gpuMs / std::max(gpuFrames, 1));
+  };
+  run("orphaning", orphaningBatch, nullptr);
+  run(stream.persistent() ? "persistent stream" : "stream (glBufferSubData fallback)", streamingBatch, &stream);
+  LOG_INFO(logger, "sprite benchmark: stream stalls={} ({:.3f}ms)", stream.stalls(), stream.stallMs());
+
+  glDeleteQueries(kTimerLatency, timers);
+  glState.deleteTexture(textureArray);
+  glState.deleteBuffer(frameBuffer);
+  glState.deleteProgram(shader.shaderProgram);
+  return 0;
+}
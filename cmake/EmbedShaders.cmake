@@ -0,0 +1,83 @@
+# --------------------------------------------------------------------------------
+#                  Embed shader sources into the executable.
+# --------------------------------------------------------------------------------
+# Usage :
+#
+#       target_embed_shaders(mytarget ${PROJECT_SOURCE_DIR}/resources shaders)
+#
+# Every file under <root>/<subdirectory> is compiled into a generated translation unit as a
+# constexpr table keyed by its path relative to <root> (e.g. "shaders/4.2.texture.vs") with
+# an FNV-1a content hash, see include/shader_bundle.h. The table is regenerated whenever a
+# shader changes, so startup never has to read shader files from disk.
+#
+# This file is also the generator itself when run in script mode (cmake -P).
+
+if(CMAKE_SCRIPT_MODE_FILE)
+    # script mode: SHADER_ROOT, SHADER_SUBDIR and OUTPUT are passed with -D
+    file(GLOB_RECURSE shaders RELATIVE "${SHADER_ROOT}" "${SHADER_ROOT}/${SHADER_SUBDIR}/*")
+    list(SORT shaders) # the table is binary searched by path
+
+    set(sources "")
+    set(entries "")
+    set(index 0)
+    foreach(shader IN LISTS shaders)
+        file(READ "${SHADER_ROOT}/${shader}" bytes HEX)
+        # \xNN escapes, split into adjacent literals of 64 bytes to stay within compiler literal limits
+        string(LENGTH "${bytes}" length)
+        set(literal "")
+        set(offset 0)
+        while(offset LESS length)
+            string(SUBSTRING "${bytes}" ${offset} 128 chunk)
+            string(REGEX REPLACE "([0-9a-f][0-9a-f])" "\\\\x\\1" chunk "${chunk}")
+            string(APPEND literal "\n    \"${chunk}\"")
+            math(EXPR offset "${offset} + 128")
+        endwhile()
+        if(literal STREQUAL "")
+            set(literal " \"\"")
+        endif()
+        string(APPEND sources "constexpr char kShader${index}[] =${literal};\n")
+        string(APPEND entries "    {\"${shader}\", source(kShader${index}), fnv1a64(source(kShader${index}))},\n")
+        math(EXPR index "${index} + 1")
+    endforeach()
+
+    set(content "// Generated by cmake/EmbedShaders.cmake from ${SHADER_SUBDIR}/, do not edit.
+#include \"shader_bundle.h\"
+
+namespace {
+
+template <std::size_t N>
+constexpr std::string_view source(const char (&text)[N]) {
+  return {text, N - 1};
+}
+
+${sources}
+constexpr EmbeddedShader kShaders[] = {
+${entries}};
+
+}  // namespace
+
+std::span<const EmbeddedShader> embeddedShaders() { return kShaders; }
+")
+    # only touch the output when it changed, so unrelated edits do not trigger a relink
+    if(EXISTS "${OUTPUT}")
+        file(READ "${OUTPUT}" previous)
+    endif()
+    if(NOT "${previous}" STREQUAL "${content}")
+        file(WRITE "${OUTPUT}" "${content}")
+    endif()
+    return()
+endif()
+
+function(target_embed_shaders TARGET ROOT SUBDIRECTORY)
+    file(GLOB_RECURSE shaders CONFIGURE_DEPENDS "${ROOT}/${SUBDIRECTORY}/*")
+    set(output "${PROJECT_BINARY_DIR}/generated/${TARGET}_shader_bundle.cpp")
+    add_custom_command(
+        OUTPUT "${output}"
+        COMMAND ${CMAKE_COMMAND} -DSHADER_ROOT=${ROOT} -DSHADER_SUBDIR=${SUBDIRECTORY} -DOUTPUT=${output}
+                -P "${CMAKE_CURRENT_FUNCTION_LIST_FILE}"
+        DEPENDS ${shaders} "${CMAKE_CURRENT_FUNCTION_LIST_FILE}"
+        COMMENT "Embedding ${SUBDIRECTORY}/ into ${TARGET}"
+        VERBATIM
+    )
+    target_sources(${TARGET} PRIVATE "${output}")
+endfunction()
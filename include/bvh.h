@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "frustum_culling.h"
+#include "simd_math.h"
+#include "thread_pool.h"
+
+struct Aabb {
+  math::vec3 min{std::numeric_limits<float>::max()};
+  math::vec3 max{-std::numeric_limits<float>::max()};
+
+  void grow(const math::vec3& p) {
+    min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+    max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+  }
+  void grow(const Aabb& other) {
+    min = {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)};
+    max = {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)};
+  }
+  bool empty() const { return min.x > max.x; }
+  math::vec3 center() const { return (min + max) * 0.5f; }
+  math::vec3 extents() const { return (max - min) * 0.5f; }
+  bool overlaps(const Aabb& other) const {
+    return min.x <= other.max.x && max.x >= other.min.x && min.y <= other.max.y && max.y >= other.min.y &&
+           min.z <= other.max.z && max.z >= other.min.z;
+  }
+  // half the surface area, which is all SAH comparisons need
+  float halfArea() const {
+    if (empty()) {
+      return 0.0f;
+    }
+    const math::vec3 d = max - min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+};
+
+// 32 bytes, two per cache line: the bounds and either a leaf's primitive range or, for count 0,
+// the index of the left child; the right child always follows it
+struct alignas(32) BvhNode {
+  math::vec3 min;
+  std::uint32_t first = 0;
+  math::vec3 max;
+  std::uint32_t count = 0;
+
+  bool leaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32);
+
+// Bounding volume hierarchy over the boxes of scene objects.
+//
+// build() splits with the surface area heuristic, evaluated over 16 centroid bins per axis. The
+// upper levels are built by the calling thread; every subtree below a size threshold becomes a
+// task, the tasks are built on a ThreadPool into their own node arrays and then spliced into
+// the flat array, depth first with siblings adjacent, so children always come after their
+// parent. That makes refit() one reverse pass over the nodes: moving objects keep the tree
+// and only grow or shrink its boxes. The tree degrades as objects move apart, so update()
+// rebuilds when the SAH cost has grown by kRebuildRatio or after rebuildInterval refits.
+//
+// Queries walk the tree with a small stack: cull() keeps a mask of the frustum planes a node
+// straddles, so subtrees fully inside are emitted without further plane tests.
+class Bvh {
+ public:
+  static constexpr std::size_t kBins = 16;
+  static constexpr std::uint32_t kMaxLeafSize = 4;
+  static constexpr std::size_t kMaxDepth = 60;  // deeper nodes become leaves; bounds the query stack
+  static constexpr std::size_t kMinTaskSize = 4096;
+  static constexpr float kRebuildRatio = 1.5f;
+
+  // ------------------------------------------------------------------------
+  void build(std::span<const Aabb> bounds, ThreadPool* pool = nullptr) {
+    const auto count = static_cast<std::uint32_t>(bounds.size());
+    refs_.resize(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      refs_[i] = {bounds[i], bounds[i].center(), i};
+    }
+    nodes_.clear();
+    nodes_.reserve(count > 0 ? 2 * count - 1 : 0);
+    refitsSinceBuild_ = 0;
+    if (count == 0) {
+      finishBuild();
+      return;
+    }
+    nodes_.emplace_back();
+
+    // everything below taskSize is left to the pool
+    std::vector<Task> tasks;
+    const std::size_t workers = pool != nullptr ? pool->size() : 1;
+    const std::size_t taskSize = workers > 1 ? std::max(kMinTaskSize, count / (workers * 4)) : 0;
+    split(nodes_, 0, 0, count, 0, taskSize, &tasks);
+
+    std::vector<std::vector<BvhNode>> subtrees(tasks.size());
+    if (tasks.empty()) {
+      finishBuild();
+      return;
+    }
+    pool->parallelFor(tasks.size(), [&](std::size_t index, std::size_t) {
+      const Task& task = tasks[index];
+      std::vector<BvhNode>& local = subtrees[index];
+      local.reserve(2 * task.count - 1);
+      local.emplace_back();
+      split(local, 0, task.first, task.count, task.depth, 0, nullptr);
+    });
+    for (std::size_t index = 0; index < tasks.size(); ++index) {
+      splice(tasks[index].node, subtrees[index]);
+    }
+    finishBuild();
+  }
+
+  // recompute the boxes for new bounds of the same objects, keeping the tree
+  // ------------------------------------------------------------------------
+  void refit(std::span<const Aabb> bounds) {
+    for (std::size_t i = 0; i < indices_.size(); ++i) {
+      bounds_[i] = bounds[indices_[i]];
+    }
+    for (std::size_t n = nodes_.size(); n-- > 0;) {
+      BvhNode& node = nodes_[n];
+      Aabb box;
+      if (node.leaf()) {
+        for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+          box.grow(bounds_[i]);
+        }
+      } else {
+        box = nodeBounds(nodes_[node.first]);
+        box.grow(nodeBounds(nodes_[node.first + 1]));
+      }
+      node.min = box.min;
+      node.max = box.max;
+    }
+    ++refitsSinceBuild_;
+  }
+
+  // refit, or rebuild when the tree has degraded or the object count changed; true on a rebuild
+  // ------------------------------------------------------------------------
+  bool update(std::span<const Aabb> bounds, ThreadPool* pool = nullptr) {
+    if (bounds.size() != bounds_.size() || refitsSinceBuild_ + 1 >= rebuildInterval_) {
+      build(bounds, pool);
+      return true;
+    }
+    refit(bounds);
+    if (sahCost() > buildCost_ * kRebuildRatio) {
+      build(bounds, pool);
+      return true;
+    }
+    return false;
+  }
+
+  // 0 disables the periodic rebuild
+  void setRebuildInterval(std::size_t refits) {
+    rebuildInterval_ = refits > 0 ? refits : std::numeric_limits<std::size_t>::max();
+  }
+
+  // appends the objects whose box intersects the frustum
+  // ------------------------------------------------------------------------
+  void cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    std::array<math::vec3, 6> absNormals;
+    for (std::size_t p = 0; p < 6; ++p) {
+      const math::vec4& plane = frustum.planes[p];
+      absNormals[p] = {std::abs(plane.x), std::abs(plane.y), std::abs(plane.z)};
+    }
+    // 0 outside, otherwise kVisible plus the planes the box still straddles
+    const auto classify = [&](const math::vec3& center, const math::vec3& extents, unsigned planes) -> unsigned {
+      for (unsigned p = 0; p < 6; ++p) {
+        if ((planes & (1u << p)) == 0) {
+          continue;
+        }
+        const math::vec4& plane = frustum.planes[p];
+        const float distance = math::dot(plane.xyz(), center) + plane.w;
+        const float reach = math::dot(absNormals[p], extents);
+        if (distance < -reach) {
+          return 0;
+        }
+        if (distance >= reach) {
+          planes &= ~(1u << p);
+        }
+      }
+      return planes | kVisible;
+    };
+
+    std::array<std::pair<std::uint32_t, unsigned>, kMaxDepth + 2> stack;
+    std::size_t top = 0;
+    stack[top++] = {0, 0x3Fu};
+    while (top > 0) {
+      const auto [index, parentPlanes] = stack[--top];
+      const BvhNode& node = nodes_[index];
+      const unsigned planes =
+          parentPlanes == 0 ? kVisible
+                            : classify((node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f, parentPlanes);
+      if (planes == 0) {
+        continue;
+      }
+      const unsigned remaining = planes & ~kVisible;
+      if (!node.leaf()) {
+        stack[top++] = {node.first + 1, remaining};
+        stack[top++] = {node.first, remaining};
+        continue;
+      }
+      for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+        const Aabb& box = bounds_[i];
+        if (remaining == 0 || classify(box.center(), box.extents(), remaining) != 0) {
+          visible.push_back(indices_[i]);
+        }
+      }
+    }
+  }
+
+  // appends the objects whose box overlaps box
+  // ------------------------------------------------------------------------
+  void overlap(const Aabb& box, std::vector<std::uint32_t>& result) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    std::array<std::uint32_t, kMaxDepth + 2> stack;
+    std::size_t top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const BvhNode& node = nodes_[stack[--top]];
+      if (!box.overlaps(nodeBounds(node))) {
+        continue;
+      }
+      if (!node.leaf()) {
+        stack[top++] = node.first + 1;
+        stack[top++] = node.first;
+        continue;
+      }
+      for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (box.overlaps(bounds_[i])) {
+          result.push_back(indices_[i]);
+        }
+      }
+    }
+  }
+
+  // expected cost of a query relative to testing the root box, in node visits plus object
+  // tests; grows as refits loosen the tree
+  // ------------------------------------------------------------------------
+  float sahCost() const {
+    if (nodes_.empty()) {
+      return 0.0f;
+    }
+    float cost = 0.0f;
+    for (const BvhNode& node : nodes_) {
+      cost += nodeBounds(node).halfArea() * (node.leaf() ? static_cast<float>(node.count) : 1.0f);
+    }
+    const float rootArea = nodeBounds(nodes_[0]).halfArea();
+    return rootArea > 0.0f ? cost / rootArea : cost;
+  }
+
+  std::span<const BvhNode> nodes() const { return nodes_; }
+  std::size_t size() const { return bounds_.size(); }
+  // nodes, object bounds and the leaf index table (not the scratch memory of build())
+  std::size_t memoryBytes() const {
+    return nodes_.capacity() * sizeof(BvhNode) + bounds_.capacity() * sizeof(Aabb) +
+           indices_.capacity() * sizeof(std::uint32_t);
+  }
+  std::size_t refitsSinceBuild() const { return refitsSinceBuild_; }
+
+ private:
+  static constexpr unsigned kVisible = 0x40u;
+
+  struct Task {
+    std::uint32_t node;
+    std::uint32_t first;
+    std::uint32_t count;
+    std::uint32_t depth;
+  };
+
+  // an object while building; ranges of these are partitioned in place
+  struct BuildRef {
+    Aabb bounds;
+    math::vec3 centroid;
+    std::uint32_t index;
+  };
+
+  struct Bin {
+    Aabb bounds;
+    std::uint32_t count = 0;
+  };
+
+  std::vector<BvhNode> nodes_;
+  std::vector<Aabb> bounds_;             // in leaf order, so leaves read them sequentially
+  std::vector<std::uint32_t> indices_;  // object index of each entry of bounds_
+  std::vector<BuildRef> refs_;
+  float buildCost_ = 0.0f;
+  std::size_t refitsSinceBuild_ = 0;
+  std::size_t rebuildInterval_ = 240;
+
+  static Aabb nodeBounds(const BvhNode& node) { return {node.min, node.max}; }
+
+  static float component(const math::vec3& v, int axis) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); }
+
+  // make nodes[index] cover refs_[first, first + count) and split it further; ranges of at most
+  // taskSize objects are handed to tasks instead (taskSize 0: never)
+  // ------------------------------------------------------------------------
+  void split(std::vector<BvhNode>& nodes, std::uint32_t index, std::uint32_t first, std::uint32_t count,
+             std::uint32_t depth, std::size_t taskSize, std::vector<Task>* tasks) {
+    BuildRef* const refs = refs_.data() + first;
+    Aabb box;
+    Aabb centroidBox;
+    for (std::uint32_t i = 0; i < count; ++i) {
+      box.grow(refs[i].bounds);
+      centroidBox.grow(refs[i].centroid);
+    }
+    nodes[index].min = box.min;
+    nodes[index].max = box.max;
+    if (tasks != nullptr && count <= taskSize) {
+      tasks->push_back({index, first, count, depth});
+      return;
+    }
+
+    const auto makeLeaf = [&] {
+      nodes[index].first = first;
+      nodes[index].count = count;
+    };
+    if (count <= 1 || depth >= kMaxDepth) {
+      makeLeaf();
+      return;
+    }
+
+    // bin the centroids along all three axes in one pass; small ranges use fewer bins, which
+    // keeps the fixed cost per node down near the leaves
+    const std::size_t binCount = std::min<std::size_t>(kBins, count);
+    const math::vec3 extent = centroidBox.max - centroidBox.min;
+    const auto binScale = [binCount](float axisExtent) {
+      return axisExtent > 0.0f ? static_cast<float>(binCount) / axisExtent : 0.0f;
+    };
+    const math::vec3 scale{binScale(extent.x), binScale(extent.y), binScale(extent.z)};
+    const auto binOf = [&](const math::vec3& centroid, int axis) {
+      const float offset = component(centroid, axis) - component(centroidBox.min, axis);
+      return std::min(binCount - 1, static_cast<std::size_t>(offset * component(scale, axis)));
+    };
+    std::array<std::array<Bin, kBins>, 3> bins;
+    for (std::uint32_t i = 0; i < count; ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        Bin& bin = bins[static_cast<std::size_t>(axis)][binOf(refs[i].centroid, axis)];
+        bin.bounds.grow(refs[i].bounds);
+        ++bin.count;
+      }
+    }
+
+    // best split plane over all axes: objects whose centroid bin is below it go left
+    int bestAxis = -1;
+    std::size_t bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+      if (component(extent, axis) <= 0.0f) {
+        continue;
+      }
+      const auto& axisBins = bins[static_cast<std::size_t>(axis)];
+      // sweep from the right to get the cost of everything above each plane
+      std::array<float, kBins> rightCost{};
+      Aabb right;
+      std::uint32_t rightCount = 0;
+      for (std::size_t plane = binCount - 1; plane > 0; --plane) {
+        right.grow(axisBins[plane].bounds);
+        rightCount += axisBins[plane].count;
+        rightCost[plane] = right.halfArea() * static_cast<float>(rightCount);
+      }
+      Aabb left;
+      std::uint32_t leftCount = 0;
+      for (std::size_t plane = 1; plane < binCount; ++plane) {
+        left.grow(axisBins[plane - 1].bounds);
+        leftCount += axisBins[plane - 1].count;
+        const float cost = left.halfArea() * static_cast<float>(leftCount) + rightCost[plane];
+        if (leftCount > 0 && leftCount < count && cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = plane;
+        }
+      }
+    }
+
+    std::uint32_t middle;
+    if (bestAxis < 0) {
+      // all centroids coincide: SAH cannot separate them, halve the range
+      if (count <= kMaxLeafSize) {
+        makeLeaf();
+        return;
+      }
+      middle = first + count / 2;
+    } else {
+      // a split pays for one more node visit (the cost of visiting this one, in the same units)
+      const float leafCost = box.halfArea() * static_cast<float>(count);
+      if (count <= kMaxLeafSize && bestCost + box.halfArea() >= leafCost) {
+        makeLeaf();
+        return;
+      }
+      const BuildRef* pivot = std::partition(refs, refs + count, [&](const BuildRef& ref) {
+        return binOf(ref.centroid, bestAxis) < bestSplit;
+      });
+      middle = first + static_cast<std::uint32_t>(pivot - refs);
+    }
+
+    const auto left = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[index].first = left;
+    nodes[index].count = 0;
+    split(nodes, left, first, middle - first, depth + 1, taskSize, tasks);
+    split(nodes, left + 1, middle, first + count - middle, depth + 1, taskSize, tasks);
+  }
+
+  // keep the objects in leaf order, drop the build scratch and remember the initial SAH cost
+  void finishBuild() {
+    indices_.resize(refs_.size());
+    bounds_.resize(refs_.size());
+    for (std::size_t i = 0; i < refs_.size(); ++i) {
+      indices_[i] = refs_[i].index;
+      bounds_[i] = refs_[i].bounds;
+    }
+    refs_.clear();
+    buildCost_ = sahCost();
+  }
+
+  // replace nodes_[node] with the root of a subtree built by a task, append the rest
+  // ------------------------------------------------------------------------
+  void splice(std::uint32_t node, const std::vector<BvhNode>& subtree) {
+    // subtree node k > 0 lands at base + k - 1
+    const auto base = static_cast<std::uint32_t>(nodes_.size());
+    const auto relocate = [base](const BvhNode& source) {
+      BvhNode copy = source;
+      if (!copy.leaf()) {
+        copy.first = base + copy.first - 1;
+      }
+      return copy;
+    };
+    nodes_[node] = relocate(subtree[0]);
+    for (std::size_t k = 1; k < subtree.size(); ++k) {
+      nodes_.push_back(relocate(subtree[k]));
+    }
+  }
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "gl_state.h"
+#include "pipeline_state.h"
+#include "uniform_buffer.h"
+
+// one draw call as recorded into a CommandList; indexType 0 means glDrawArrays from first
+struct DrawCommand {
+  GLenum mode = GL_TRIANGLES;
+  GLsizei count = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  std::size_t offset = 0;  // byte offset into the element buffer
+  GLint first = 0;
+  GLsizei instances = 1;
+  GLint baseVertex = 0;  // added to every index, e.g. MeshRange::baseVertex of a pooled mesh
+};
+
+// the other recorded commands, as CommandList::visit() hands them out
+struct TextureCommand {
+  GLuint unit;
+  GLenum target;
+  GLuint texture;
+};
+struct UniformBlockCommand {
+  GLuint binding;
+  std::span<const std::byte> data;  // points into the list
+};
+
+// GL-free recording of the commands a worker thread prepares for a frame.
+//
+// Commands are packed into a byte buffer that is allocated once at construction, so recording
+// never allocates and touches no GL state; a list records from exactly one thread at a time.
+// Uniform block contents are copied into the list and only reach the UniformRing when the GL
+// thread replays it. A list that runs out of space drops the rest of its commands and reports
+// overflowed() so the capacity can be raised. visit() walks the recorded commands without GL,
+// replay() is the visitor that issues them.
+class CommandList {
+ public:
+  explicit CommandList(std::size_t capacityBytes = 64 * 1024) : buffer_(capacityBytes) {}
+
+  // start recording a new frame; keeps the buffer
+  void reset() {
+    size_ = 0;
+    commands_ = 0;
+    overflowed_ = false;
+  }
+
+  // ------------------------------------------------------------------------
+  bool setPipeline(const PipelineState& pipeline) { return write(Type::Pipeline, PipelinePayload{&pipeline}); }
+
+  bool bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    return write(Type::Texture, TextureCommand{unit, target, texture});
+  }
+
+  template <typename Block>
+  bool uniformBlock(GLuint binding, const Block& block) {
+    static_assert(std::is_trivially_copyable_v<Block>, "uniform blocks are copied byte for byte");
+    return write(Type::UniformBlock, UniformPayload{binding, static_cast<std::uint32_t>(sizeof(Block))}, &block,
+                 sizeof(Block));
+  }
+
+  bool draw(const DrawCommand& command) { return write(Type::Draw, command); }
+
+  // calls visitor(const PipelineState&), visitor(const TextureCommand&),
+  // visitor(const UniformBlockCommand&) or visitor(const DrawCommand&) for each command in order
+  // ------------------------------------------------------------------------
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const {
+    for (std::size_t at = 0; at < size_;) {
+      Header header;
+      std::memcpy(&header, buffer_.data() + at, sizeof(Header));
+      const std::byte* payload = buffer_.data() + at + sizeof(Header);
+      switch (header.type) {
+        case Type::Pipeline:
+          visitor(*read<PipelinePayload>(payload).pipeline);
+          break;
+        case Type::Texture:
+          visitor(read<TextureCommand>(payload));
+          break;
+        case Type::UniformBlock: {
+          auto block = read<UniformPayload>(payload);
+          visitor(UniformBlockCommand{block.binding, {payload + sizeof(UniformPayload), block.size}});
+          break;
+        }
+        case Type::Draw:
+          visitor(read<DrawCommand>(payload));
+          break;
+      }
+      at += header.size;
+    }
+  }
+
+  // issue the recorded commands; GL thread only
+  // ------------------------------------------------------------------------
+  void replay(PipelineContext& context, GlStateCache& glState, UniformRing& uniforms) const {
+    struct Replay {
+      PipelineContext& context;
+      GlStateCache& glState;
+      UniformRing& uniforms;
+
+      void operator()(const PipelineState& pipeline) { context.apply(pipeline); }
+      void operator()(const TextureCommand& texture) {
+        glState.bindTexture(texture.unit, texture.target, texture.texture);
+      }
+      void operator()(const UniformBlockCommand& block) {
+        UniformSlice slice = uniforms.pushBytes(block.data.data(), block.data.size());
+        if (slice.size > 0) {
+          uniforms.bind(glState, block.binding, slice);
+        }
+      }
+      void operator()(const DrawCommand& draw) {
+        if (draw.indexType == 0) {
+          glDrawArraysInstanced(draw.mode, draw.first, draw.count, draw.instances);
+        } else {
+          glDrawElementsInstancedBaseVertex(draw.mode, draw.count, draw.indexType,
+                                            reinterpret_cast<const void*>(draw.offset), draw.instances,
+                                            draw.baseVertex);
+        }
+      }
+    };
+    visit(Replay{context, glState, uniforms});
+  }
+
+  std::size_t commands() const { return commands_; }
+  std::size_t bytes() const { return size_; }
+  bool overflowed() const { return overflowed_; }
+
+ private:
+  enum class Type : std::uint16_t { Pipeline, Texture, UniformBlock, Draw };
+
+  struct Header {
+    Type type;
+    std::uint16_t size;  // header, payload and padding
+  };
+  struct PipelinePayload {
+    const PipelineState* pipeline;
+  };
+  struct UniformPayload {
+    GLuint binding;
+    std::uint32_t size;  // followed by the block's bytes
+  };
+
+  std::vector<std::byte> buffer_;
+  std::size_t size_ = 0;
+  std::size_t commands_ = 0;
+  bool overflowed_ = false;
+
+  // ------------------------------------------------------------------------
+  template <typename Payload>
+  bool write(Type type, const Payload& payload, const void* extra = nullptr, std::size_t extraSize = 0) {
+    const std::size_t size = alignUp(sizeof(Header) + sizeof(Payload) + extraSize, alignof(std::max_align_t));
+    if (overflowed_ || size_ + size > buffer_.size() || size > 0xFFFF) {
+      overflowed_ = true;
+      return false;
+    }
+    std::byte* out = buffer_.data() + size_;
+    Header header{type, static_cast<std::uint16_t>(size)};
+    std::memcpy(out, &header, sizeof(Header));
+    std::memcpy(out + sizeof(Header), &payload, sizeof(Payload));
+    if (extraSize > 0) {
+      std::memcpy(out + sizeof(Header) + sizeof(Payload), extra, extraSize);
+    }
+    size_ += size;
+    ++commands_;
+    return true;
+  }
+
+  template <typename Payload>
+  static Payload read(const std::byte* payload) {
+    Payload value;
+    std::memcpy(&value, payload, sizeof(Payload));
+    return value;
+  }
+};
+
+// Replays lists in index order. Record list i from parallelFor index i (not from the worker
+// that happens to run it) and the GL command stream is the same on every run.
+// ------------------------------------------------------------------------
+inline void replayCommandLists(std::span<const CommandList> lists, PipelineContext& context, GlStateCache& glState,
+                               UniformRing& uniforms) {
+  for (const CommandList& list : lists) {
+    list.replay(context, glState, uniforms);
+  }
+}
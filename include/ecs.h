@@ -0,0 +1,470 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Archetype-based entity component storage.
+//
+// Entities with the same set of component types share an archetype. An archetype stores its
+// entities in 16 KB chunks; a chunk holds one array per component (structure of arrays), each
+// starting on a cache line, plus the array of entity ids. Queries visit whole chunks and hand
+// out spans, so systems scan contiguous memory instead of chasing pointers. Removing an entity
+// moves the archetype's last entity into the hole, so all chunks but the last stay full.
+//
+// Components must be trivially copyable (they are moved between archetypes with memcpy); at
+// most 64 component types exist per program. Adding, removing, creating or destroying changes
+// the layout and invalidates spans and pointers: inside a query record such changes in an
+// EcsCommandBuffer (one per worker in parallel queries) and apply it afterwards.
+
+struct Entity {
+  static constexpr std::uint32_t kInvalid = 0xFFFFFFFFu;
+  std::uint32_t index = kInvalid;
+  std::uint32_t generation = 0;
+
+  bool valid() const { return index != kInvalid; }
+  bool operator==(const Entity&) const = default;
+};
+
+using ComponentMask = std::uint64_t;
+
+namespace ecs_detail {
+
+constexpr std::size_t kMaxComponents = 64;
+constexpr std::size_t kChunkBytes = 16 * 1024;
+constexpr std::size_t kCacheLine = 64;
+
+struct ComponentInfo {
+  std::size_t size;
+};
+
+// fixed size, so registering a type never moves the entries other threads read
+inline std::array<ComponentInfo, kMaxComponents>& componentInfos() {
+  static std::array<ComponentInfo, kMaxComponents> infos{};
+  return infos;
+}
+
+inline std::uint32_t registerComponent(std::size_t size) {
+  static std::mutex mutex;
+  static std::uint32_t count = 0;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (count == kMaxComponents) {
+    std::abort();  // raise kMaxComponents together with ComponentMask
+  }
+  componentInfos()[count] = {size};
+  return count++;
+}
+
+}  // namespace ecs_detail
+
+// a small id per component type, assigned on first use; const T shares the id of T
+template <typename T>
+std::uint32_t componentId() {
+  if constexpr (!std::is_same_v<T, std::remove_cv_t<T>>) {
+    return componentId<std::remove_cv_t<T>>();
+  } else {
+    static_assert(std::is_trivially_copyable_v<T>, "components are moved with memcpy");
+    static_assert(alignof(T) <= ecs_detail::kCacheLine, "component columns are only cache line aligned");
+    static const std::uint32_t id = ecs_detail::registerComponent(sizeof(T));
+    return id;
+  }
+}
+
+template <typename... Ts>
+ComponentMask componentMask() {
+  return (ComponentMask{0} | ... | (ComponentMask{1} << componentId<Ts>()));
+}
+
+class EcsWorld {
+ public:
+  EcsWorld() = default;
+  EcsWorld(const EcsWorld&) = delete;
+  EcsWorld& operator=(const EcsWorld&) = delete;
+
+  // ------------------------------------------------------------------------
+  template <typename... Ts>
+  Entity create(const Ts&... components) {
+    const std::uint32_t ids[] = {componentId<Ts>()..., 0};
+    const void* values[] = {static_cast<const void*>(&components)..., nullptr};
+    return createRaw(componentMask<Ts...>(), ids, values, sizeof...(Ts));
+  }
+
+  // ------------------------------------------------------------------------
+  void destroy(Entity entity) {
+    if (!alive(entity)) {
+      return;
+    }
+    Record& record = records_[entity.index];
+    removeRow(*record.archetype, record.chunk, record.row);
+    record.archetype = nullptr;
+    ++record.generation;
+    freeIndices_.push_back(entity.index);
+    --size_;
+  }
+
+  bool alive(Entity entity) const {
+    return entity.index < records_.size() && records_[entity.index].archetype != nullptr &&
+           records_[entity.index].generation == entity.generation;
+  }
+
+  std::size_t size() const { return size_; }
+
+  // add or overwrite a component
+  template <typename T>
+  void add(Entity entity, const T& component) {
+    addRaw(entity, componentId<T>(), &component);
+  }
+
+  template <typename T>
+  void remove(Entity entity) {
+    removeRaw(entity, componentId<T>());
+  }
+
+  template <typename T>
+  bool has(Entity entity) const {
+    return alive(entity) && (records_[entity.index].archetype->mask & componentMask<T>()) != 0;
+  }
+
+  // nullptr when the entity is gone or lacks the component
+  // ------------------------------------------------------------------------
+  template <typename T>
+  T* get(Entity entity) {
+    if (!has<T>(entity)) {
+      return nullptr;
+    }
+    const Record& record = records_[entity.index];
+    return reinterpret_cast<T*>(record.archetype->column(record.chunk, componentId<T>()) + record.row * sizeof(T));
+  }
+
+  // fn(std::span<const Entity>, std::span<Ts>...) once per chunk of every archetype that has
+  // all of Ts (and maybe more); const Ts give read-only spans
+  // ------------------------------------------------------------------------
+  template <typename... Ts, typename Fn>
+  void forEachChunk(Fn&& fn) {
+    const ComponentMask mask = componentMask<Ts...>();
+    for (const auto& archetype : archetypes_) {
+      if ((archetype->mask & mask) != mask) {
+        continue;
+      }
+      for (std::uint32_t chunk = 0; chunk < archetype->chunks.size(); ++chunk) {
+        visitChunk<Ts...>(*archetype, chunk, fn);
+      }
+    }
+  }
+
+  // fn(Entity, Ts&...) for every matching entity
+  template <typename... Ts, typename Fn>
+  void forEach(Fn&& fn) {
+    forEachChunk<Ts...>([&fn](std::span<const Entity> entities, std::span<Ts>... components) {
+      for (std::size_t i = 0; i < entities.size(); ++i) {
+        fn(entities[i], components[i]...);
+      }
+    });
+  }
+
+  // forEachChunk spread over a ThreadPool: fn(worker, std::span<const Entity>, std::span<Ts>...)
+  // ------------------------------------------------------------------------
+  template <typename... Ts, typename Fn>
+  void parallelForChunks(ThreadPool& pool, Fn&& fn) {
+    const ComponentMask mask = componentMask<Ts...>();
+    chunkList_.clear();
+    for (const auto& archetype : archetypes_) {
+      if ((archetype->mask & mask) == mask) {
+        for (std::uint32_t chunk = 0; chunk < archetype->chunks.size(); ++chunk) {
+          chunkList_.push_back({archetype.get(), chunk});
+        }
+      }
+    }
+    pool.parallelFor(chunkList_.size(), [this, &fn](std::size_t index, std::size_t worker) {
+      const ChunkRef& ref = chunkList_[index];
+      visitChunk<Ts...>(*ref.archetype, ref.chunk, [&fn, worker](std::span<const Entity> entities, auto... spans) {
+        fn(worker, entities, spans...);
+      });
+    });
+  }
+
+  // type-erased structural changes, used by EcsCommandBuffer
+  // ------------------------------------------------------------------------
+  Entity createRaw(ComponentMask mask, const std::uint32_t* ids, const void* const* values, std::size_t count) {
+    Entity entity;
+    if (!freeIndices_.empty()) {
+      entity.index = freeIndices_.back();
+      freeIndices_.pop_back();
+    } else {
+      entity.index = static_cast<std::uint32_t>(records_.size());
+      records_.emplace_back();
+    }
+    Record& record = records_[entity.index];
+    entity.generation = record.generation;
+    record.archetype = &archetype(mask);
+    appendRow(record, entity);
+    for (std::size_t i = 0; i < count; ++i) {
+      writeComponent(record, ids[i], values[i]);
+    }
+    ++size_;
+    return entity;
+  }
+
+  void addRaw(Entity entity, std::uint32_t id, const void* value) {
+    if (!alive(entity)) {
+      return;
+    }
+    Record& record = records_[entity.index];
+    const ComponentMask bit = ComponentMask{1} << id;
+    if ((record.archetype->mask & bit) == 0) {
+      move(entity, archetype(record.archetype->mask | bit));
+    }
+    writeComponent(record, id, value);
+  }
+
+  void removeRaw(Entity entity, std::uint32_t id) {
+    if (!alive(entity)) {
+      return;
+    }
+    const ComponentMask bit = ComponentMask{1} << id;
+    if ((records_[entity.index].archetype->mask & bit) != 0) {
+      move(entity, archetype(records_[entity.index].archetype->mask & ~bit));
+    }
+  }
+
+  std::size_t archetypeCount() const { return archetypes_.size(); }
+
+ private:
+  static constexpr std::uint32_t kNoColumn = 0xFFFFFFFFu;
+
+  struct alignas(ecs_detail::kCacheLine) Chunk {
+    std::byte data[ecs_detail::kChunkBytes];
+  };
+
+  struct Archetype {
+    ComponentMask mask = 0;
+    std::vector<std::uint32_t> components;
+    std::array<std::uint32_t, ecs_detail::kMaxComponents> offsets;  // column start per component id
+    std::size_t capacity = 0;                                         // entities per chunk
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<std::uint32_t> counts;  // entities per chunk
+
+    std::byte* column(std::uint32_t chunk, std::uint32_t id) { return chunks[chunk]->data + offsets[id]; }
+    Entity* entities(std::uint32_t chunk) { return reinterpret_cast<Entity*>(chunks[chunk]->data); }
+  };
+
+  struct Record {
+    Archetype* archetype = nullptr;
+    std::uint32_t chunk = 0;
+    std::uint32_t row = 0;
+    std::uint32_t generation = 1;  // never 0, so a default Entity is never alive
+  };
+
+  struct ChunkRef {
+    Archetype* archetype;
+    std::uint32_t chunk;
+  };
+
+  std::vector<std::unique_ptr<Archetype>> archetypes_;  // in creation order, for queries
+  std::unordered_map<ComponentMask, Archetype*> byMask_;
+  std::vector<Record> records_;
+  std::vector<std::uint32_t> freeIndices_;
+  std::vector<ChunkRef> chunkList_;
+  std::size_t size_ = 0;
+
+  template <typename... Ts, typename Fn>
+  static void visitChunk(Archetype& archetype, std::uint32_t chunk, Fn&& fn) {
+    const std::size_t count = archetype.counts[chunk];
+    fn(std::span<const Entity>(archetype.entities(chunk), count),
+       std::span<Ts>(reinterpret_cast<Ts*>(archetype.column(chunk, componentId<Ts>())), count)...);
+  }
+
+  // ------------------------------------------------------------------------
+  Archetype& archetype(ComponentMask mask) {
+    if (auto found = byMask_.find(mask); found != byMask_.end()) {
+      return *found->second;
+    }
+    auto created = std::make_unique<Archetype>();
+    created->mask = mask;
+    created->offsets.fill(kNoColumn);
+    for (ComponentMask bits = mask; bits != 0; bits &= bits - 1) {
+      created->components.push_back(static_cast<std::uint32_t>(std::countr_zero(bits)));
+    }
+    layout(*created);
+    byMask_.emplace(mask, created.get());
+    archetypes_.push_back(std::move(created));
+    return *archetypes_.back();
+  }
+
+  // the largest capacity whose cache-line aligned columns still fit into a chunk
+  static void layout(Archetype& archetype) {
+    const auto& infos = ecs_detail::componentInfos();
+    std::size_t perEntity = sizeof(Entity);
+    for (std::uint32_t id : archetype.components) {
+      perEntity += infos[id].size;
+    }
+    for (std::size_t capacity = ecs_detail::kChunkBytes / perEntity; capacity > 0; --capacity) {
+      std::size_t offset = capacity * sizeof(Entity);
+      bool fits = true;
+      for (std::uint32_t id : archetype.components) {
+        offset = (offset + ecs_detail::kCacheLine - 1) / ecs_detail::kCacheLine * ecs_detail::kCacheLine;
+        archetype.offsets[id] = static_cast<std::uint32_t>(offset);
+        offset += capacity * infos[id].size;
+        fits = offset <= ecs_detail::kChunkBytes;
+      }
+      if (fits) {
+        archetype.capacity = capacity;
+        return;
+      }
+    }
+    std::abort();  // a single entity of this archetype is larger than a chunk
+  }
+
+  void appendRow(Record& record, Entity entity) {
+    Archetype& archetype = *record.archetype;
+    if (archetype.chunks.empty() || archetype.counts.back() == archetype.capacity) {
+      archetype.chunks.emplace_back(new Chunk);
+      archetype.counts.push_back(0);
+    }
+    record.chunk = static_cast<std::uint32_t>(archetype.chunks.size() - 1);
+    record.row = archetype.counts.back()++;
+    archetype.entities(record.chunk)[record.row] = entity;
+  }
+
+  void writeComponent(const Record& record, std::uint32_t id, const void* value) {
+    const std::size_t size = ecs_detail::componentInfos()[id].size;
+    std::memcpy(record.archetype->column(record.chunk, id) + record.row * size, value, size);
+  }
+
+  // fill the hole with the archetype's last entity
+  // ------------------------------------------------------------------------
+  void removeRow(Archetype& archetype, std::uint32_t chunk, std::uint32_t row) {
+    const auto lastChunk = static_cast<std::uint32_t>(archetype.chunks.size() - 1);
+    const std::uint32_t lastRow = archetype.counts.back() - 1;
+    if (chunk != lastChunk || row != lastRow) {
+      const auto& infos = ecs_detail::componentInfos();
+      for (std::uint32_t id : archetype.components) {
+        const std::size_t size = infos[id].size;
+        std::memcpy(archetype.column(chunk, id) + row * size, archetype.column(lastChunk, id) + lastRow * size, size);
+      }
+      const Entity moved = archetype.entities(lastChunk)[lastRow];
+      archetype.entities(chunk)[row] = moved;
+      records_[moved.index].chunk = chunk;
+      records_[moved.index].row = row;
+    }
+    if (--archetype.counts.back() == 0) {
+      archetype.chunks.pop_back();
+      archetype.counts.pop_back();
+    }
+  }
+
+  // carry the components both archetypes have over to the new one
+  void move(Entity entity, Archetype& target) {
+    Record& record = records_[entity.index];
+    Archetype& source = *record.archetype;
+    const std::uint32_t chunk = record.chunk;
+    const std::uint32_t row = record.row;
+
+    record.archetype = &target;
+    appendRow(record, entity);
+    const auto& infos = ecs_detail::componentInfos();
+    for (std::uint32_t id : target.components) {
+      if ((source.mask & (ComponentMask{1} << id)) != 0) {
+        const std::size_t size = infos[id].size;
+        std::memcpy(target.column(record.chunk, id) + record.row * size, source.column(chunk, id) + row * size,
+                    size);
+      }
+    }
+    removeRow(source, chunk, row);
+  }
+};
+
+// Structural changes recorded while a query runs and applied afterwards, in order. Component
+// values are copied into the buffer. Not thread-safe: use one buffer per worker.
+class EcsCommandBuffer {
+ public:
+  // ------------------------------------------------------------------------
+  template <typename... Ts>
+  void create(const Ts&... components) {
+    commands_.push_back({Type::Create, {}, static_cast<std::uint32_t>(sizeof...(Ts)), 0});
+    (pushValue(Type::Value, {}, componentId<Ts>(), &components, sizeof(Ts)), ...);
+  }
+
+  void destroy(Entity entity) { commands_.push_back({Type::Destroy, entity, 0, 0}); }
+
+  template <typename T>
+  void add(Entity entity, const T& component) {
+    pushValue(Type::Add, entity, componentId<T>(), &component, sizeof(T));
+  }
+
+  template <typename T>
+  void remove(Entity entity) {
+    commands_.push_back({Type::Remove, entity, componentId<T>(), 0});
+  }
+
+  bool empty() const { return commands_.empty(); }
+
+  // ------------------------------------------------------------------------
+  void apply(EcsWorld& world) {
+    for (std::size_t i = 0; i < commands_.size(); ++i) {
+      const Command& command = commands_[i];
+      switch (command.type) {
+        case Type::Create: {
+          std::uint32_t ids[ecs_detail::kMaxComponents];
+          const void* values[ecs_detail::kMaxComponents];
+          ComponentMask mask = 0;
+          for (std::uint32_t c = 0; c < command.id; ++c) {
+            const Command& value = commands_[++i];
+            ids[c] = value.id;
+            values[c] = payload_.data() + value.offset;
+            mask |= ComponentMask{1} << value.id;
+          }
+          world.createRaw(mask, ids, values, command.id);
+          break;
+        }
+        case Type::Destroy:
+          world.destroy(command.entity);
+          break;
+        case Type::Add:
+          world.addRaw(command.entity, command.id, payload_.data() + command.offset);
+          break;
+        case Type::Remove:
+          world.removeRaw(command.entity, command.id);
+          break;
+        case Type::Value:
+          break;  // consumed by its Create
+      }
+    }
+    commands_.clear();
+    payload_.clear();
+  }
+
+ private:
+  enum class Type : std::uint8_t { Create, Value, Destroy, Add, Remove };
+
+  struct Command {
+    Type type;
+    Entity entity;
+    std::uint32_t id;      // component id; the component count for Create
+    std::uint32_t offset;  // of the value in payload_
+  };
+
+  std::vector<Command> commands_;
+  std::vector<std::byte> payload_;
+
+  void pushValue(Type type, Entity entity, std::uint32_t id, const void* value, std::size_t size) {
+    // keep every value aligned for any component type
+    const std::size_t offset = (payload_.size() + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) *
+                               alignof(std::max_align_t);
+    payload_.resize(offset + size);
+    std::memcpy(payload_.data() + offset, value, size);
+    commands_.push_back({type, entity, id, static_cast<std::uint32_t>(offset)});
+  }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+// Bounds how many frames the CPU may queue ahead of the GPU.
+//
+// endFrame() (right after glfwSwapBuffers) fences the frame. beginFrame() retires the frames
+// whose fence has signalled and, while maxFramesInFlight are still queued, blocks on the
+// oldest one, so input sampled after beginFrame() reaches the screen at most that many frames
+// later. The time blocked is reported as CPU wait; frame latency is measured from the latch
+// point (the end of beginFrame(), where input should be sampled) until the frame's fence is
+// seen signalled, so it is an upper bound at the resolution of one frame.
+//
+// With a late latch (frameIntervalMs > 0, e.g. the display's refresh period) beginFrame() also
+// sleeps until marginMs plus the average CPU time of a frame before the next expected swap,
+// so input is sampled as late as the frame can still make it. The CPU time runs from the latch
+// to markSubmitted(), called right before glfwSwapBuffers: with vsync the swap blocks until the
+// next refresh, and counting that wait as work would shrink the sleep to nothing.
+class FramePacer {
+ public:
+  // ------------------------------------------------------------------------
+  explicit FramePacer(std::size_t maxFramesInFlight, quill::Logger* logger)
+      : logger_(logger), maxFramesInFlight_(std::max<std::size_t>(maxFramesInFlight, 1)) {
+    frames_.reserve(maxFramesInFlight_ + 1);
+  }
+
+  FramePacer(const FramePacer&) = delete;
+  FramePacer& operator=(const FramePacer&) = delete;
+
+  ~FramePacer() {
+    for (Frame& frame : frames_) {
+      glDeleteSync(frame.fence);
+    }
+  }
+
+  // 0 turns the late latch off
+  void setLateLatch(double frameIntervalMs, double marginMs = 1.0) {
+    frameIntervalMs_ = frameIntervalMs;
+    marginMs_ = marginMs;
+  }
+
+  std::size_t maxFramesInFlight() const { return maxFramesInFlight_; }
+  void setMaxFramesInFlight(std::size_t frames) { maxFramesInFlight_ = std::max<std::size_t>(frames, 1); }
+
+  // before sampling input; returns the milliseconds spent waiting for the GPU
+  // ------------------------------------------------------------------------
+  double beginFrame() {
+    retire(false);
+    double waitMs = 0.0;
+    if (frames_.size() >= maxFramesInFlight_) {
+      auto start = std::chrono::steady_clock::now();
+      while (frames_.size() >= maxFramesInFlight_) {
+        retire(true);
+      }
+      waitMs = elapsedMs(start);
+      ++waits_;
+      waitMs_ += waitMs;
+    }
+
+    if (frameIntervalMs_ > 0.0 && lastSwap_ != Clock::time_point{}) {
+      const auto latch = lastSwap_ + toDuration(frameIntervalMs_ - averageWorkMs_ - marginMs_);
+      if (latch > Clock::now()) {
+        std::this_thread::sleep_until(latch);
+      }
+    }
+    latched_ = Clock::now();
+    return waitMs;
+  }
+
+  // right before the swap, once the frame's commands are issued
+  void markSubmitted() { submitted_ = Clock::now(); }
+
+  // right after the swap; without a markSubmitted() this frame the work ends at the swap
+  // ------------------------------------------------------------------------
+  void endFrame() {
+    Frame frame;
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.latched = latched_;
+    frames_.push_back(frame);
+
+    lastSwap_ = Clock::now();
+    const Clock::time_point workEnd = submitted_ > latched_ ? submitted_ : lastSwap_;
+    const double workMs = std::chrono::duration<double, std::milli>(workEnd - latched_).count();
+    averageWorkMs_ = frameCount_ == 0 ? workMs : averageWorkMs_ + (workMs - averageWorkMs_) * 0.1;
+    ++frameCount_;
+  }
+
+  std::uint64_t frames() const { return frameCount_; }
+  std::uint64_t waits() const { return waits_; }  // frames in which beginFrame() blocked
+  double cpuWaitMs() const { return waitMs_; }
+  double averageLatencyMs() const { return retired_ == 0 ? 0.0 : latencyMs_ / static_cast<double>(retired_); }
+  double maxLatencyMs() const { return maxLatencyMs_; }
+  double averageWorkMs() const { return averageWorkMs_; }
+
+  // ------------------------------------------------------------------------
+  void logStats() const {
+    LOG_INFO(logger_, "frame pacer: {} frames, max {} in flight, waited {} times ({:.3f}ms)", frameCount_,
+             maxFramesInFlight_, waits_, waitMs_);
+    LOG_INFO(logger_, "frame pacer: latency avg {:.3f}ms max {:.3f}ms, cpu work avg {:.3f}ms", averageLatencyMs(),
+             maxLatencyMs_, averageWorkMs_);
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    GLsync fence = nullptr;
+    Clock::time_point latched;
+  };
+
+  quill::Logger* logger_;
+  std::size_t maxFramesInFlight_;
+  std::vector<Frame> frames_;  // oldest first
+  double frameIntervalMs_ = 0.0;
+  double marginMs_ = 1.0;
+  Clock::time_point latched_;
+  Clock::time_point submitted_;
+  Clock::time_point lastSwap_;
+  double averageWorkMs_ = 0.0;
+  std::uint64_t frameCount_ = 0;
+  std::uint64_t waits_ = 0;
+  double waitMs_ = 0.0;
+  std::uint64_t retired_ = 0;
+  double latencyMs_ = 0.0;
+  double maxLatencyMs_ = 0.0;
+
+  static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  static Clock::duration toDuration(double ms) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+  }
+
+  // drop the finished frames from the front; with block, wait up to 1ms for the oldest
+  void retire(bool block) {
+    std::size_t done = 0;
+    for (; done < frames_.size(); ++done) {
+      const GLuint64 timeout = block && done == 0 ? 1000000 : 0;
+      const GLenum status = glClientWaitSync(frames_[done].fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+      if (status == GL_TIMEOUT_EXPIRED) {
+        break;
+      }
+      if (status == GL_WAIT_FAILED) {
+        LOG_ERROR(logger_, "frame pacer: glClientWaitSync failed");
+      } else {
+        const double latencyMs = elapsedMs(frames_[done].latched);
+        latencyMs_ += latencyMs;
+        maxLatencyMs_ = std::max(maxLatencyMs_, latencyMs);
+        ++retired_;
+      }
+      glDeleteSync(frames_[done].fence);
+    }
+    frames_.erase(frames_.begin(), frames_.begin() + static_cast<std::ptrdiff_t>(done));
+  }
+};
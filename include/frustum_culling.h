@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "simd_math.h"
+#include "thread_pool.h"
+
+// View frustum culling of bounding spheres and axis-aligned boxes.
+//
+// Bounds are kept as structure of arrays (SphereSoA, AabbSoA) so the kernels test 8 objects per
+// iteration against all 6 planes with AVX, 4 with SSE or NEON: one broadcast plane, one load
+// per stream, a running lane mask. Surviving indices are written out compactly; with AVX2 a
+// lookup table turns the 8-bit lane mask into a permutation, so compaction needs no branches.
+// FrustumCuller splits large sets into blocks for a ThreadPool and stitches the blocks'
+// index lists together in order.
+//
+// The tests are conservative: objects near a frustum corner may be reported visible although
+// they are outside, never the other way around.
+
+// planes point inwards: a point p is inside plane (n, d) when dot(n, p) + d >= 0
+struct Frustum {
+  std::array<math::vec4, 6> planes;  // left, right, bottom, top, near, far
+
+  // Gribb / Hartmann extraction from a projection or view projection matrix; planes are
+  // normalized so that plane distances are in world units
+  // ------------------------------------------------------------------------
+  static Frustum fromMatrix(const math::mat4& m) {
+    const math::vec4 r0(m[0].x, m[1].x, m[2].x, m[3].x);
+    const math::vec4 r1(m[0].y, m[1].y, m[2].y, m[3].y);
+    const math::vec4 r2(m[0].z, m[1].z, m[2].z, m[3].z);
+    const math::vec4 r3(m[0].w, m[1].w, m[2].w, m[3].w);
+    Frustum frustum{{r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2}};
+    for (math::vec4& plane : frustum.planes) {
+      plane = plane / math::length(plane.xyz());
+    }
+    return frustum;
+  }
+
+  bool intersectsSphere(const math::vec3& center, float radius) const {
+    for (const math::vec4& plane : planes) {
+      if (math::dot(plane.xyz(), center) + plane.w < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool intersectsAabb(const math::vec3& center, const math::vec3& extents) const {
+    for (const math::vec4& plane : planes) {
+      const float reach =
+          std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+      if (math::dot(plane.xyz(), center) + plane.w < -reach) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+struct SphereSoA {
+  std::vector<float> x, y, z, radius;
+
+  std::size_t size() const { return x.size(); }
+  void resize(std::size_t count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    radius.resize(count);
+  }
+  void set(std::size_t i, const math::vec3& center, float r) {
+    x[i] = center.x;
+    y[i] = center.y;
+    z[i] = center.z;
+    radius[i] = r;
+  }
+};
+
+// stored as center and half extents, which is what the plane test needs
+struct AabbSoA {
+  std::vector<float> x, y, z, extentX, extentY, extentZ;
+
+  std::size_t size() const { return x.size(); }
+  void resize(std::size_t count) {
+    for (auto* stream : {&x, &y, &z, &extentX, &extentY, &extentZ}) {
+      stream->resize(count);
+    }
+  }
+  void set(std::size_t i, const math::vec3& min, const math::vec3& max) {
+    x[i] = (min.x + max.x) * 0.5f;
+    y[i] = (min.y + max.y) * 0.5f;
+    z[i] = (min.z + max.z) * 0.5f;
+    extentX[i] = (max.x - min.x) * 0.5f;
+    extentY[i] = (max.y - min.y) * 0.5f;
+    extentZ[i] = (max.z - min.z) * 0.5f;
+  }
+};
+
+namespace culling_detail {
+
+#if defined(SIMD_MATH_AVX) && defined(__AVX2__)
+// lane permutation per 8-bit mask that moves the set lanes to the front
+struct CompactTable {
+  alignas(32) std::uint32_t lanes[256][8];
+
+  constexpr CompactTable() : lanes{} {
+    for (unsigned mask = 0; mask < 256; ++mask) {
+      unsigned next = 0;
+      for (unsigned lane = 0; lane < 8; ++lane) {
+        if ((mask & (1u << lane)) != 0) {
+          lanes[mask][next++] = lane;
+        }
+      }
+    }
+  }
+};
+
+inline constexpr CompactTable kCompactTable;
+#endif
+
+// write first + lane for every set bit of mask, returns the new end
+inline std::uint32_t* appendLanes(unsigned mask, std::uint32_t first, std::uint32_t* out) {
+  for (; mask != 0; mask &= mask - 1) {
+    *out++ = first + static_cast<std::uint32_t>(std::countr_zero(mask));
+  }
+  return out;
+}
+
+// Spheres when Boxes is false (ex holds the radii, ey and ez are unused), boxes otherwise.
+// visible[k] = firstIndex + i for every object i in [0, count) that passes; returns k.
+// ------------------------------------------------------------------------
+template <bool Boxes>
+std::size_t cull(const Frustum& frustum, const float* x, const float* y, const float* z, const float* ex,
+                 const float* ey, const float* ez, std::size_t count, std::uint32_t firstIndex,
+                 std::uint32_t* visible) {
+  std::array<math::vec3, 6> absNormals;
+  for (std::size_t p = 0; p < 6; ++p) {
+    const math::vec4& plane = frustum.planes[p];
+    absNormals[p] = {std::abs(plane.x), std::abs(plane.y), std::abs(plane.z)};
+  }
+  std::uint32_t* out = visible;
+  std::size_t i = 0;
+#if defined(SIMD_MATH_AVX)
+  for (; i + 8 <= count; i += 8) {
+    const __m256 cx = _mm256_loadu_ps(x + i);
+    const __m256 cy = _mm256_loadu_ps(y + i);
+    const __m256 cz = _mm256_loadu_ps(z + i);
+    const __m256 rx = _mm256_loadu_ps(ex + i);
+    __m256 ry = rx, rz = rx;
+    if constexpr (Boxes) {
+      ry = _mm256_loadu_ps(ey + i);
+      rz = _mm256_loadu_ps(ez + i);
+    }
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (std::size_t p = 0; p < 6; ++p) {
+      const math::vec4& plane = frustum.planes[p];
+      __m256 distance = _mm256_add_ps(_mm256_set1_ps(plane.w), _mm256_mul_ps(_mm256_set1_ps(plane.x), cx));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), cy));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), cz));
+      __m256 reach = rx;
+      if constexpr (Boxes) {
+        reach = _mm256_mul_ps(_mm256_set1_ps(absNormals[p].x), rx);
+        reach = _mm256_add_ps(reach, _mm256_mul_ps(_mm256_set1_ps(absNormals[p].y), ry));
+        reach = _mm256_add_ps(reach, _mm256_mul_ps(_mm256_set1_ps(absNormals[p].z), rz));
+      }
+      const __m256 passes = _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ);
+      inside = _mm256_and_ps(inside, passes);
+    }
+    const auto mask = static_cast<unsigned>(_mm256_movemask_ps(inside));
+#if defined(__AVX2__)
+    // store all 8 lanes, keep the popcount; out never passes visible + i, so this stays in bounds
+    const __m256i lanes = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(firstIndex + i)),
+                                           _mm256_load_si256(reinterpret_cast<const __m256i*>(
+                                               kCompactTable.lanes[mask])));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), lanes);
+    out += std::popcount(mask);
+#else
+    out = appendLanes(mask, firstIndex + static_cast<std::uint32_t>(i), out);
+#endif
+  }
+#elif defined(SIMD_MATH_SSE)
+  for (; i + 4 <= count; i += 4) {
+    const __m128 cx = _mm_loadu_ps(x + i);
+    const __m128 cy = _mm_loadu_ps(y + i);
+    const __m128 cz = _mm_loadu_ps(z + i);
+    const __m128 rx = _mm_loadu_ps(ex + i);
+    __m128 ry = rx, rz = rx;
+    if constexpr (Boxes) {
+      ry = _mm_loadu_ps(ey + i);
+      rz = _mm_loadu_ps(ez + i);
+    }
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (std::size_t p = 0; p < 6; ++p) {
+      const math::vec4& plane = frustum.planes[p];
+      __m128 distance = _mm_add_ps(_mm_set1_ps(plane.w), _mm_mul_ps(_mm_set1_ps(plane.x), cx));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+      __m128 reach = rx;
+      if constexpr (Boxes) {
+        reach = _mm_mul_ps(_mm_set1_ps(absNormals[p].x), rx);
+        reach = _mm_add_ps(reach, _mm_mul_ps(_mm_set1_ps(absNormals[p].y), ry));
+        reach = _mm_add_ps(reach, _mm_mul_ps(_mm_set1_ps(absNormals[p].z), rz));
+      }
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+    }
+    out = appendLanes(static_cast<unsigned>(_mm_movemask_ps(inside)), firstIndex + static_cast<std::uint32_t>(i),
+                      out);
+  }
+#elif defined(SIMD_MATH_NEON)
+  const uint32x4_t laneBits = {1, 2, 4, 8};
+  for (; i + 4 <= count; i += 4) {
+    const float32x4_t cx = vld1q_f32(x + i);
+    const float32x4_t cy = vld1q_f32(y + i);
+    const float32x4_t cz = vld1q_f32(z + i);
+    const float32x4_t rx = vld1q_f32(ex + i);
+    float32x4_t ry = rx, rz = rx;
+    if constexpr (Boxes) {
+      ry = vld1q_f32(ey + i);
+      rz = vld1q_f32(ez + i);
+    }
+    uint32x4_t inside = vdupq_n_u32(0xFFFFFFFFu);
+    for (std::size_t p = 0; p < 6; ++p) {
+      const math::vec4& plane = frustum.planes[p];
+      float32x4_t distance = vmlaq_n_f32(vdupq_n_f32(plane.w), cx, plane.x);
+      distance = vmlaq_n_f32(distance, cy, plane.y);
+      distance = vmlaq_n_f32(distance, cz, plane.z);
+      float32x4_t reach = rx;
+      if constexpr (Boxes) {
+        reach = vmulq_n_f32(rx, absNormals[p].x);
+        reach = vmlaq_n_f32(reach, ry, absNormals[p].y);
+        reach = vmlaq_n_f32(reach, rz, absNormals[p].z);
+      }
+      inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(distance, reach), vdupq_n_f32(0.0f)));
+    }
+    out = appendLanes(vaddvq_u32(vandq_u32(inside, laneBits)), firstIndex + static_cast<std::uint32_t>(i), out);
+  }
+#endif
+  for (; i < count; ++i) {
+    bool inside;
+    if constexpr (Boxes) {
+      inside = frustum.intersectsAabb({x[i], y[i], z[i]}, {ex[i], ey[i], ez[i]});
+    } else {
+      inside = frustum.intersectsSphere({x[i], y[i], z[i]}, ex[i]);
+    }
+    if (inside) {
+      *out++ = firstIndex + static_cast<std::uint32_t>(i);
+    }
+  }
+  return static_cast<std::size_t>(out - visible);
+}
+
+}  // namespace culling_detail
+
+// The kernels for one range, e.g. inside a job of your own: visible[k] = firstIndex + i for
+// every object i in [0, count) that intersects the frustum, returns k. visible needs room for
+// count indices.
+// ------------------------------------------------------------------------
+inline std::size_t cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z,
+                               const float* radius, std::size_t count, std::uint32_t firstIndex,
+                               std::uint32_t* visible) {
+  return culling_detail::cull<false>(frustum, x, y, z, radius, nullptr, nullptr, count, firstIndex, visible);
+}
+
+inline std::size_t cullAabbs(const Frustum& frustum, const float* x, const float* y, const float* z,
+                             const float* extentX, const float* extentY, const float* extentZ, std::size_t count,
+                             std::uint32_t firstIndex, std::uint32_t* visible) {
+  return culling_detail::cull<true>(frustum, x, y, z, extentX, extentY, extentZ, count, firstIndex, visible);
+}
+
+// Culls whole SoA sets, in blocks of kBlock objects spread over a ThreadPool. Each block
+// writes its visible indices to its own slice of one buffer, the slices are then moved together;
+// the result is in ascending index order and stays valid until the next cull().
+class FrustumCuller {
+ public:
+  static constexpr std::size_t kBlock = 16 * 1024;
+
+  // ------------------------------------------------------------------------
+  std::span<const std::uint32_t> cull(const Frustum& frustum, const SphereSoA& spheres, ThreadPool* pool = nullptr) {
+    return run(spheres.size(), pool, [&](std::size_t first, std::size_t count, std::uint32_t* out) {
+      return cullSpheres(frustum, spheres.x.data() + first, spheres.y.data() + first, spheres.z.data() + first,
+                         spheres.radius.data() + first, count, static_cast<std::uint32_t>(first), out);
+    });
+  }
+
+  std::span<const std::uint32_t> cull(const Frustum& frustum, const AabbSoA& boxes, ThreadPool* pool = nullptr) {
+    return run(boxes.size(), pool, [&](std::size_t first, std::size_t count, std::uint32_t* out) {
+      return cullAabbs(frustum, boxes.x.data() + first, boxes.y.data() + first, boxes.z.data() + first,
+                       boxes.extentX.data() + first, boxes.extentY.data() + first, boxes.extentZ.data() + first,
+                       count, static_cast<std::uint32_t>(first), out);
+    });
+  }
+
+ private:
+  std::vector<std::uint32_t> visible_;
+  std::vector<std::size_t> blockCounts_;
+
+  // ------------------------------------------------------------------------
+  template <typename Kernel>
+  std::span<const std::uint32_t> run(std::size_t count, ThreadPool* pool, Kernel&& kernel) {
+    visible_.resize(count);
+    const std::size_t blocks = (count + kBlock - 1) / kBlock;
+    blockCounts_.resize(blocks);
+    auto cullBlock = [&](std::size_t block, std::size_t) {
+      const std::size_t first = block * kBlock;
+      blockCounts_[block] = kernel(first, std::min(kBlock, count - first), visible_.data() + first);
+    };
+    if (pool != nullptr) {
+      pool->parallelFor(blocks, cullBlock);
+    } else {
+      for (std::size_t block = 0; block < blocks; ++block) {
+        cullBlock(block, 0);
+      }
+    }
+    // every slice starts at or after the end of the compacted ones before it
+    std::size_t total = blocks > 0 ? blockCounts_[0] : 0;
+    for (std::size_t block = 1; block < blocks; ++block) {
+      const std::uint32_t* slice = visible_.data() + block * kBlock;
+      std::copy(slice, slice + blockCounts_[block], visible_.data() + total);
+      total += blockCounts_[block];
+    }
+    return {visible_.data(), total};
+  }
+};
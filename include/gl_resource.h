@@ -0,0 +1,261 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "gl_state.h"
+#include "logger.h"
+
+enum class GlResourceKind : std::uint8_t { Buffer, Texture, VertexArray, Program, Framebuffer };
+
+// index into a GlResourceRegistry plus the generation of the slot it was issued for
+struct GlHandle {
+  static constexpr std::uint32_t kInvalid = 0xFFFFFFFFu;
+  std::uint32_t index = kInvalid;
+  std::uint32_t generation = 0;
+
+  bool valid() const { return index != kInvalid; }
+};
+
+// Slot map of GL object names with fence-gated deferred deletion.
+//
+// A released slot's generation is bumped, so every handle still pointing at it resolves to 0
+// instead of a name that may since have been reused. The object itself is not deleted right
+// away: the GPU may still read it in a frame that is in flight, and deleting it under the
+// driver's feet can stall. endFrame() fences the objects released during the frame and deletes
+// those of earlier frames whose fence has signalled; deletion goes through GlStateCache so its
+// shadowed bindings are forgotten as well. The destructor deletes whatever is left, so declare
+// the registry after the GlStateCache and before any GlResource that uses it.
+class GlResourceRegistry {
+ public:
+  // ------------------------------------------------------------------------
+  GlResourceRegistry(GlStateCache& glState, quill::Logger* logger) : glState_(glState), logger_(logger) {}
+
+  GlResourceRegistry(const GlResourceRegistry&) = delete;
+  GlResourceRegistry& operator=(const GlResourceRegistry&) = delete;
+
+  ~GlResourceRegistry() {
+    flush();
+    std::size_t leaked = 0;
+    for (const Slot& slot : slots_) {
+      if (slot.live) {
+        destroy(slot.kind, slot.name);
+        ++leaked;
+      }
+    }
+    if (leaked > 0) {
+      LOG_WARNING(logger_, "gl resources: {} objects were still registered at shutdown", leaked);
+    }
+  }
+
+  // take ownership of an existing object
+  // ------------------------------------------------------------------------
+  GlHandle add(GlResourceKind kind, GLuint name) {
+    GlHandle handle;
+    if (!freeSlots_.empty()) {
+      handle.index = freeSlots_.back();
+      freeSlots_.pop_back();
+    } else {
+      handle.index = static_cast<std::uint32_t>(slots_.size());
+      slots_.emplace_back();
+    }
+    Slot& slot = slots_[handle.index];
+    slot.name = name;
+    slot.kind = kind;
+    slot.live = true;
+    handle.generation = slot.generation;
+    ++live_;
+    return handle;
+  }
+
+  // 0 for a released or never issued handle
+  GLuint get(GlHandle handle) const { return alive(handle) ? slots_[handle.index].name : 0; }
+
+  bool alive(GlHandle handle) const {
+    return handle.index < slots_.size() && slots_[handle.index].live &&
+           slots_[handle.index].generation == handle.generation;
+  }
+
+  // invalidate the handle now, delete the object once the GPU is done with the current frame
+  // ------------------------------------------------------------------------
+  void release(GlHandle handle) {
+    if (!alive(handle)) {
+      return;
+    }
+    Slot& slot = slots_[handle.index];
+    current_.push_back({slot.kind, slot.name});
+    slot.live = false;
+    slot.name = 0;
+    ++slot.generation;
+    freeSlots_.push_back(handle.index);
+    --live_;
+  }
+
+  // once per frame, after the frame's last command (e.g. right after the swap)
+  // ------------------------------------------------------------------------
+  void endFrame() {
+    if (!current_.empty()) {
+      Batch& batch = fenced_.emplace_back();
+      batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      batch.resources.swap(current_);
+    }
+    // frames complete in order, so stop at the first fence that has not signalled
+    while (!fenced_.empty() && glClientWaitSync(fenced_.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+      deleteBatch(fenced_.front());
+      fenced_.pop_front();
+    }
+  }
+
+  // delete everything released so far without waiting, e.g. at shutdown or after glFinish()
+  // ------------------------------------------------------------------------
+  void flush() {
+    for (Batch& batch : fenced_) {
+      deleteBatch(batch);
+    }
+    fenced_.clear();
+    for (const Pending& pending : current_) {
+      destroy(pending.kind, pending.name);
+    }
+    deleted_ += current_.size();
+    current_.clear();
+  }
+
+  std::size_t live() const { return live_; }
+  std::size_t pending() const {
+    std::size_t count = current_.size();
+    for (const Batch& batch : fenced_) {
+      count += batch.resources.size();
+    }
+    return count;
+  }
+  std::uint64_t deleted() const { return deleted_; }
+
+ private:
+  struct Slot {
+    GLuint name = 0;
+    GlResourceKind kind = GlResourceKind::Buffer;
+    std::uint32_t generation = 1;  // never 0, so a default GlHandle is never alive
+    bool live = false;
+  };
+
+  struct Pending {
+    GlResourceKind kind;
+    GLuint name;
+  };
+
+  struct Batch {
+    GLsync fence = nullptr;
+    std::vector<Pending> resources;
+  };
+
+  GlStateCache& glState_;
+  quill::Logger* logger_;
+  std::vector<Slot> slots_;
+  std::vector<std::uint32_t> freeSlots_;
+  std::vector<Pending> current_;  // released during the current frame
+  std::deque<Batch> fenced_;      // oldest first
+  std::size_t live_ = 0;
+  std::uint64_t deleted_ = 0;
+
+  void deleteBatch(Batch& batch) {
+    glDeleteSync(batch.fence);
+    for (const Pending& pending : batch.resources) {
+      destroy(pending.kind, pending.name);
+    }
+    deleted_ += batch.resources.size();
+  }
+
+  void destroy(GlResourceKind kind, GLuint name) {
+    switch (kind) {
+      case GlResourceKind::Buffer:
+        glState_.deleteBuffer(name);
+        break;
+      case GlResourceKind::Texture:
+        glState_.deleteTexture(name);
+        break;
+      case GlResourceKind::VertexArray:
+        glState_.deleteVertexArray(name);
+        break;
+      case GlResourceKind::Program:
+        glState_.deleteProgram(name);
+        break;
+      case GlResourceKind::Framebuffer:
+        glState_.deleteFramebuffer(name);
+        break;
+    }
+  }
+};
+
+// Move-only owner of one registered GL object; destruction releases it to the registry.
+template <GlResourceKind Kind>
+class GlResource {
+ public:
+  GlResource() = default;
+
+  // take ownership of an existing object, e.g. a program linked elsewhere
+  GlResource(GlResourceRegistry& registry, GLuint name) : registry_(&registry), handle_(registry.add(Kind, name)) {}
+
+  // a new, empty object of the kind
+  // ------------------------------------------------------------------------
+  static GlResource generate(GlResourceRegistry& registry) {
+    GLuint name = 0;
+    if constexpr (Kind == GlResourceKind::Buffer) {
+      glGenBuffers(1, &name);
+    } else if constexpr (Kind == GlResourceKind::Texture) {
+      glGenTextures(1, &name);
+    } else if constexpr (Kind == GlResourceKind::VertexArray) {
+      glGenVertexArrays(1, &name);
+    } else if constexpr (Kind == GlResourceKind::Program) {
+      name = glCreateProgram();
+    } else {
+      glGenFramebuffers(1, &name);
+    }
+    return GlResource(registry, name);
+  }
+
+  GlResource(const GlResource&) = delete;
+  GlResource& operator=(const GlResource&) = delete;
+
+  GlResource(GlResource&& other) noexcept
+      : registry_(std::exchange(other.registry_, nullptr)), handle_(std::exchange(other.handle_, {})) {}
+
+  GlResource& operator=(GlResource&& other) noexcept {
+    if (this != &other) {
+      reset();
+      registry_ = std::exchange(other.registry_, nullptr);
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  ~GlResource() { reset(); }
+
+  void reset() {
+    if (registry_ != nullptr) {
+      registry_->release(handle_);
+    }
+    registry_ = nullptr;
+    handle_ = {};
+  }
+
+  // the GL name, 0 when empty
+  GLuint get() const { return registry_ != nullptr ? registry_->get(handle_) : 0; }
+  GlHandle handle() const { return handle_; }
+  GlResourceRegistry* registry() const { return registry_; }
+  explicit operator bool() const { return get() != 0; }
+
+ private:
+  GlResourceRegistry* registry_ = nullptr;
+  GlHandle handle_;
+};
+
+using GlBuffer = GlResource<GlResourceKind::Buffer>;
+using GlTexture = GlResource<GlResourceKind::Texture>;
+using GlVertexArray = GlResource<GlResourceKind::VertexArray>;
+using GlProgram = GlResource<GlResourceKind::Program>;
+using GlFramebuffer = GlResource<GlResourceKind::Framebuffer>;
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Shadows the GL state the renderer touches and skips calls that would not change it.
+//
+// Every setter compares against the last value it issued and returns true when it actually
+// called GL. State starts out unknown, so the first call of each kind is always issued. Code
+// that changes state without going through the cache (a UI library, ...) must be
+// followed by invalidate(), or invalidateTextures() / invalidateBuffers() when only that part
+// is affected. Objects should be deleted through the cache so a recycled name is not mistaken
+// for a binding that is still current.
+class GlStateCache {
+ public:
+  static constexpr std::size_t kTextureUnits = 32;
+  static constexpr std::size_t kUniformBindings = 16;
+
+  // ------------------------------------------------------------------------
+  bool useProgram(GLuint program) {
+    if (!program_.set(program)) {
+      return skip();
+    }
+    glUseProgram(program);
+    return issue();
+  }
+
+  // the element array binding is VAO state, so it is forgotten whenever the VAO changes
+  // ------------------------------------------------------------------------
+  bool bindVertexArray(GLuint vertexArray) {
+    if (!vertexArray_.set(vertexArray)) {
+      return skip();
+    }
+    glBindVertexArray(vertexArray);
+    buffers_[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)].forget();
+    return issue();
+  }
+
+  // ------------------------------------------------------------------------
+  bool bindBuffer(GLenum target, GLuint buffer) {
+    std::size_t slot = bufferSlot(target);
+    if (slot < buffers_.size() && !buffers_[slot].set(buffer)) {
+      return skip();
+    }
+    glBindBuffer(target, buffer);
+    return issue();
+  }
+
+  // indexed binding, e.g. a uniform block's range; glBindBufferRange also binds the buffer to
+  // the generic target, and the shadow of that follows. Uniform buffer bindings below
+  // kUniformBindings are shadowed, anything else is passed through.
+  // ------------------------------------------------------------------------
+  bool bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (target == GL_UNIFORM_BUFFER && index < kUniformBindings &&
+        !uniformRanges_[index].set({buffer, offset, size})) {
+      return skip();
+    }
+    glBindBufferRange(target, index, buffer, offset, size);
+    if (std::size_t slot = bufferSlot(target); slot < buffers_.size()) {
+      buffers_[slot].set(buffer);
+    }
+    return issue();
+  }
+
+  // ------------------------------------------------------------------------
+  bool activeTexture(GLuint unit) {
+    if (!activeUnit_.set(unit)) {
+      return skip();
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    return issue();
+  }
+
+  // bind texture to unit; glActiveTexture is only issued when the binding really changes
+  // ------------------------------------------------------------------------
+  bool bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    std::size_t slot = textureSlot(target);
+    if (unit < kTextureUnits && slot < kTextureTargets.size()) {
+      if (!textures_[unit][slot].set(texture)) {
+        return skip();
+      }
+    }
+    activeTexture(unit);
+    glBindTexture(target, texture);
+    return issue();
+  }
+
+  // GL_FRAMEBUFFER sets both the draw and the read binding
+  // ------------------------------------------------------------------------
+  bool bindFramebuffer(GLenum target, GLuint framebuffer) {
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if ((!draw || drawFramebuffer_.is(framebuffer)) && (!read || readFramebuffer_.is(framebuffer))) {
+      return skip();
+    }
+    if (draw) {
+      drawFramebuffer_.set(framebuffer);
+    }
+    if (read) {
+      readFramebuffer_.set(framebuffer);
+    }
+    glBindFramebuffer(target, framebuffer);
+    return issue();
+  }
+
+  // ------------------------------------------------------------------------
+  bool viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (!viewport_.set({x, y, width, height})) {
+      return skip();
+    }
+    glViewport(x, y, width, height);
+    return issue();
+  }
+
+  // capabilities outside the shadowed set are passed through unconditionally
+  // ------------------------------------------------------------------------
+  bool setEnabled(GLenum capability, bool enabled) {
+    std::size_t slot = capabilitySlot(capability);
+    if (slot < capabilities_.size() && !capabilities_[slot].set(enabled)) {
+      return skip();
+    }
+    enabled ? glEnable(capability) : glDisable(capability);
+    return issue();
+  }
+
+  // ------------------------------------------------------------------------
+  void deleteProgram(GLuint program) {
+    if (program_.is(program)) {
+      program_.forget();
+    }
+    glDeleteProgram(program);
+  }
+
+  void deleteVertexArray(GLuint vertexArray) {
+    if (vertexArray_.is(vertexArray)) {
+      vertexArray_.forget();
+    }
+    glDeleteVertexArrays(1, &vertexArray);
+  }
+
+  void deleteBuffer(GLuint buffer) {
+    for (auto& binding : buffers_) {
+      if (binding.is(buffer)) {
+        binding.forget();
+      }
+    }
+    for (auto& range : uniformRanges_) {
+      if (range.known && range.value.buffer == buffer) {
+        range.forget();
+      }
+    }
+    glDeleteBuffers(1, &buffer);
+  }
+
+  void deleteTexture(GLuint texture) {
+    for (auto& unit : textures_) {
+      for (auto& binding : unit) {
+        if (binding.is(texture)) {
+          binding.forget();
+        }
+      }
+    }
+    glDeleteTextures(1, &texture);
+  }
+
+  void deleteFramebuffer(GLuint framebuffer) {
+    if (drawFramebuffer_.is(framebuffer)) {
+      drawFramebuffer_.forget();
+    }
+    if (readFramebuffer_.is(framebuffer)) {
+      readFramebuffer_.forget();
+    }
+    glDeleteFramebuffers(1, &framebuffer);
+  }
+
+  // ------------------------------------------------------------------------
+  void invalidate() {
+    program_.forget();
+    vertexArray_.forget();
+    drawFramebuffer_.forget();
+    readFramebuffer_.forget();
+    viewport_.forget();
+    for (auto& capability : capabilities_) {
+      capability.forget();
+    }
+    invalidateBuffers();
+    invalidateTextures();
+  }
+
+  void invalidateBuffers() {
+    for (auto& binding : buffers_) {
+      binding.forget();
+    }
+    for (auto& range : uniformRanges_) {
+      range.forget();
+    }
+  }
+
+  void invalidateTextures() {
+    activeUnit_.forget();
+    for (auto& unit : textures_) {
+      for (auto& binding : unit) {
+        binding.forget();
+      }
+    }
+  }
+
+  // last program issued through the cache, 0 if unknown
+  GLuint program() const { return program_.known ? program_.value : 0; }
+
+  // true when the cache knows the value is current, i.e. the matching setter would skip
+  bool programIs(GLuint program) const { return program_.is(program); }
+  bool vertexArrayIs(GLuint vertexArray) const { return vertexArray_.is(vertexArray); }
+  bool enabledIs(GLenum capability, bool enabled) const {
+    std::size_t slot = capabilitySlot(capability);
+    return slot < capabilities_.size() && capabilities_[slot].is(enabled);
+  }
+
+  std::uint64_t issuedCalls() const { return issued_; }
+  std::uint64_t skippedCalls() const { return skipped_; }
+  void resetCounters() { issued_ = skipped_ = 0; }
+
+ private:
+  template <typename T>
+  struct Shadowed {
+    T value{};
+    bool known = false;
+
+    bool is(const T& v) const { return known && value == v; }
+    // false if v is already current
+    bool set(const T& v) {
+      if (is(v)) {
+        return false;
+      }
+      value = v;
+      known = true;
+      return true;
+    }
+    void forget() { known = false; }
+  };
+
+  struct Viewport {
+    GLint x, y;
+    GLsizei width, height;
+
+    bool operator==(const Viewport&) const = default;
+  };
+
+  struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+
+    bool operator==(const BufferRange&) const = default;
+  };
+
+  // not the copy targets: StreamBuffer and MeshPool bind them raw as scratch bindings for
+  // uploads and copies, so a shadow of them would go stale
+  static constexpr std::array<GLenum, 5> kBufferTargets = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER,
+                                                           GL_UNIFORM_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+                                                           GL_DRAW_INDIRECT_BUFFER};
+  static constexpr std::array<GLenum, 4> kTextureTargets = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP,
+                                                            GL_TEXTURE_3D};
+  static constexpr std::array<GLenum, 8> kCapabilities = {
+      GL_BLEND,        GL_DEPTH_TEST,       GL_STENCIL_TEST, GL_CULL_FACE,
+      GL_SCISSOR_TEST, GL_FRAMEBUFFER_SRGB, GL_MULTISAMPLE,  GL_POLYGON_OFFSET_FILL};
+
+  Shadowed<GLuint> program_;
+  Shadowed<GLuint> vertexArray_;
+  Shadowed<GLuint> activeUnit_;
+  Shadowed<GLuint> drawFramebuffer_;
+  Shadowed<GLuint> readFramebuffer_;
+  Shadowed<Viewport> viewport_;
+  std::array<Shadowed<GLuint>, kBufferTargets.size()> buffers_;
+  std::array<Shadowed<BufferRange>, kUniformBindings> uniformRanges_;
+  std::array<std::array<Shadowed<GLuint>, kTextureTargets.size()>, kTextureUnits> textures_;
+  std::array<Shadowed<bool>, kCapabilities.size()> capabilities_;
+  std::uint64_t issued_ = 0;
+  std::uint64_t skipped_ = 0;
+
+  bool issue() {
+    ++issued_;
+    return true;
+  }
+  bool skip() {
+    ++skipped_;
+    return false;
+  }
+
+  // index into the shadow arrays; the array size for anything that is not shadowed
+  template <std::size_t N>
+  static std::size_t slotOf(const std::array<GLenum, N>& list, GLenum value) {
+    for (std::size_t i = 0; i < N; ++i) {
+      if (list[i] == value) {
+        return i;
+      }
+    }
+    return N;
+  }
+  static std::size_t bufferSlot(GLenum target) { return slotOf(kBufferTargets, target); }
+  static std::size_t textureSlot(GLenum target) { return slotOf(kTextureTargets, target); }
+  static std::size_t capabilitySlot(GLenum capability) { return slotOf(kCapabilities, capability); }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a. constexpr so that names and sources can be hashed at compile time.
+// ------------------------------------------------------------------------
+constexpr std::uint64_t kFnv1aOffset = 14695981039346656037ull;
+constexpr std::uint64_t kFnv1aPrime = 1099511628211ull;
+
+constexpr std::uint64_t fnv1a64(std::string_view text, std::uint64_t seed = kFnv1aOffset) {
+  std::uint64_t hash = seed;
+  for (char c : text) {
+    hash ^= static_cast<std::uint8_t>(c);
+    hash *= kFnv1aPrime;
+  }
+  return hash;
+}
+
+// mix a second hash into the first (boost::hash_combine, widened to 64 bits)
+// ------------------------------------------------------------------------
+constexpr std::uint64_t hashCombine(std::uint64_t seed, std::uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 12) + (seed >> 4));
+}
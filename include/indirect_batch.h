@@ -0,0 +1,239 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "logger.h"
+#include "mesh_pool.h"
+#include "pipeline_state.h"
+#include "stream_buffer.h"
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// one pipeline's share of an IndirectDrawList: commands()[first, first + count)
+struct IndirectGroup {
+  const PipelineState* pipeline;
+  std::size_t first;
+  std::size_t count;
+};
+
+// The bookkeeping half of IndirectBatcher: collects the frame's draws and turns them into
+// DrawElementsIndirectCommands grouped by pipeline. It never touches GL.
+//
+// add() hands out draw ids in the order draws arrive. build() sorts the draws by pipeline id,
+// keeping arrival order inside a pipeline, and writes one command per draw whose baseInstance
+// is the draw id, plus one group per pipeline in ascending pipeline id order.
+class IndirectDrawList {
+ public:
+  static constexpr std::uint32_t kNoDraw = 0xFFFFFFFFu;
+
+  explicit IndirectDrawList(std::size_t maxDraws) : maxDraws_(maxDraws) {
+    draws_.reserve(maxDraws);
+    order_.reserve(maxDraws);
+    commands_.reserve(maxDraws);
+  }
+
+  std::size_t maxDraws() const { return maxDraws_; }
+  std::size_t size() const { return draws_.size(); }
+  std::uint64_t dropped() const { return dropped_; }  // draws refused since construction
+
+  // returns the draw id, or kNoDraw when maxDraws are already queued
+  // ------------------------------------------------------------------------
+  std::uint32_t add(const PipelineState& pipeline, const MeshRange& mesh, GLuint instances = 1) {
+    if (draws_.size() == maxDraws_) {
+      ++dropped_;
+      return kNoDraw;
+    }
+    draws_.push_back({&pipeline, mesh, instances});
+    return static_cast<std::uint32_t>(draws_.size() - 1);
+  }
+
+  // ------------------------------------------------------------------------
+  void build() {
+    order_.resize(draws_.size());
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::sort(order_.begin(), order_.end(), [this](std::uint32_t a, std::uint32_t b) {
+      const std::uint32_t pa = draws_[a].pipeline->id;
+      const std::uint32_t pb = draws_[b].pipeline->id;
+      return pa != pb ? pa < pb : a < b;
+    });
+
+    commands_.clear();
+    groups_.clear();
+    for (std::uint32_t id : order_) {
+      const Draw& draw = draws_[id];
+      if (groups_.empty() || groups_.back().pipeline != draw.pipeline) {
+        groups_.push_back({draw.pipeline, commands_.size(), 0});
+      }
+      ++groups_.back().count;
+      commands_.push_back({draw.mesh.indexCount, draw.instances, draw.mesh.firstIndex, draw.mesh.baseVertex, id});
+    }
+  }
+
+  // what the last build() produced
+  const std::vector<IndirectGroup>& groups() const { return groups_; }
+  const std::vector<DrawElementsIndirectCommand>& commands() const { return commands_; }
+
+  void clear() {
+    draws_.clear();
+    commands_.clear();
+    groups_.clear();
+  }
+
+ private:
+  struct Draw {
+    const PipelineState* pipeline;
+    MeshRange mesh;
+    GLuint instances;
+  };
+
+  std::size_t maxDraws_;
+  std::vector<Draw> draws_;
+  std::vector<std::uint32_t> order_;
+  std::vector<DrawElementsIndirectCommand> commands_;
+  std::vector<IndirectGroup> groups_;
+  std::uint64_t dropped_ = 0;
+};
+
+// Merges the frame's draws that share a pipeline into one glMultiDrawElementsIndirect.
+//
+// add() collects the visible draws and returns a draw id; the caller stores per-draw data
+// (model matrix, material, ...) at that index in a buffer of its own. flush() groups the draws
+// by pipeline (see IndirectDrawList), copies each group's commands into the StreamBuffer and
+// issues one multi-draw per group.
+//
+// Shaders read the id as `layout (location = 7) in uint aDrawId;`. With multi-draw the id comes
+// from a static 0..N-1 buffer through the command's baseInstance: the attribute's divisor is so
+// large that every instance of a draw reads the same element. That needs
+// GL_ARB_multi_draw_indirect, GL_ARB_draw_indirect and GL_ARB_base_instance (all core in 4.3);
+// without them, e.g. on the 3.3 context main.cpp creates, flush() loops over
+// glDrawElementsInstancedBaseVertex and sets the id as a constant attribute before each draw.
+//
+// The StreamBuffer's beginFrame() / endFrame() bracket is the caller's.
+class IndirectBatcher {
+ public:
+  static constexpr GLuint kDrawIdAttribute = 7;
+  static constexpr std::uint32_t kNoDraw = IndirectDrawList::kNoDraw;
+
+  // ------------------------------------------------------------------------
+  IndirectBatcher(GlResourceRegistry& resources, GlStateCache& glState, StreamBuffer& stream, std::size_t maxDraws,
+                  quill::Logger* logger)
+      : stream_(stream),
+        logger_(logger),
+        multiDraw_(GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_base_instance),
+        drawIds_(GlBuffer::generate(resources)),
+        draws_(maxDraws) {
+    std::vector<GLuint> ids(maxDraws);
+    std::iota(ids.begin(), ids.end(), 0u);
+    glState.bindBuffer(GL_ARRAY_BUFFER, drawIds_.get());
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(ids.size() * sizeof(GLuint)), ids.data(), GL_STATIC_DRAW);
+    LOG_INFO(logger_, "indirect batcher: {}", multiDraw_ ? "glMultiDrawElementsIndirect" : "draw loop fallback");
+  }
+
+  bool multiDraw() const { return multiDraw_; }
+  std::size_t maxDraws() const { return draws_.maxDraws(); }
+
+  // once per vertex array used by batched pipelines: adds the aDrawId attribute
+  // ------------------------------------------------------------------------
+  void attachDrawIds(GlStateCache& glState, GLuint vertexArray) {
+    glState.bindVertexArray(vertexArray);
+    glState.bindBuffer(GL_ARRAY_BUFFER, drawIds_.get());
+    glVertexAttribIPointer(kDrawIdAttribute, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glVertexAttribDivisor(kDrawIdAttribute, kDrawIdDivisor);
+    if (multiDraw_) {
+      glEnableVertexAttribArray(kDrawIdAttribute);
+    } else {
+      glDisableVertexAttribArray(kDrawIdAttribute);  // the constant set per draw is used instead
+    }
+  }
+
+  // returns the draw id, or kNoDraw when maxDraws are already queued
+  // ------------------------------------------------------------------------
+  std::uint32_t add(const PipelineState& pipeline, const MeshRange& mesh, GLuint instances = 1) {
+    // the id buffer holds exactly maxDraws ids
+    const std::uint32_t id = draws_.add(pipeline, mesh, instances);
+    if (id == kNoDraw && draws_.dropped() == 1) {
+      LOG_ERROR(logger_, "indirect batcher: more than {} draws in a frame", draws_.maxDraws());
+    }
+    return id;
+  }
+
+  // issue and clear the draws added since the last flush(); returns the GL draw calls made
+  // ------------------------------------------------------------------------
+  std::size_t flush(PipelineContext& context, GlStateCache& glState) {
+    draws_.build();
+    std::size_t calls = 0;
+    for (const IndirectGroup& group : draws_.groups()) {
+      context.apply(*group.pipeline);
+      calls += multiDraw_ ? multiDrawGroup(glState, group) : loopGroup(group);
+    }
+    drawCalls_ += calls;
+    batchedDraws_ += draws_.size();
+    draws_.clear();
+    return calls;
+  }
+
+  // totals since construction
+  std::uint64_t drawCalls() const { return drawCalls_; }
+  std::uint64_t batchedDraws() const { return batchedDraws_; }
+  std::uint64_t dropped() const { return draws_.dropped(); }
+
+ private:
+  // every instance of a draw reads the element at baseInstance
+  static constexpr GLuint kDrawIdDivisor = 1u << 30;
+
+  StreamBuffer& stream_;
+  quill::Logger* logger_;
+  bool multiDraw_;
+  GlBuffer drawIds_;
+  IndirectDrawList draws_;
+  std::uint64_t drawCalls_ = 0;
+  std::uint64_t batchedDraws_ = 0;
+
+  // ------------------------------------------------------------------------
+  std::size_t multiDrawGroup(GlStateCache& glState, const IndirectGroup& group) {
+    const std::size_t bytes = group.count * sizeof(DrawElementsIndirectCommand);
+    StreamRange range = stream_.write(draws_.commands().data() + group.first, bytes, alignof(GLuint));
+    if (!range.valid()) {
+      return loopGroup(group);
+    }
+    glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream_.buffer());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(range.offset),
+                                static_cast<GLsizei>(group.count), 0);
+    return 1;
+  }
+
+  // ------------------------------------------------------------------------
+  std::size_t loopGroup(const IndirectGroup& group) {
+    for (std::size_t i = group.first; i < group.first + group.count; ++i) {
+      const DrawElementsIndirectCommand& command = draws_.commands()[i];
+      const void* indices = reinterpret_cast<const void*>(std::size_t{command.firstIndex} * sizeof(GLuint));
+      const auto count = static_cast<GLsizei>(command.count);
+      const auto instances = static_cast<GLsizei>(command.instanceCount);
+      if (multiDraw_) {
+        // the id attribute is an enabled array here, so it has to come through baseInstance
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices, instances,
+                                                      command.baseVertex, command.baseInstance);
+      } else {
+        glVertexAttribI1ui(kDrawIdAttribute, command.baseInstance);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices, instances,
+                                          command.baseVertex);
+      }
+    }
+    return group.count;
+  }
+};
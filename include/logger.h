@@ -5,7 +5,7 @@
 #include <string>
 #include <vector>
 
-static quill::Logger* initLogger(const std::string& logFilename = "app.log", const std::string& name = "app") {
+inline quill::Logger* initLogger(const std::string& logFilename = "app.log", const std::string& name = "app") {
   quill::start(false, {});
 
   auto file_handler = quill::rotating_file_handler(logFilename, "a", 1024 * 1024 * 5, 5);
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "logger.h"
+#include "offset_allocator.h"
+
+// one mesh inside the element / vertex buffers of a vertex array (32-bit indices)
+struct MeshRange {
+  GLuint indexCount = 0;
+  GLuint firstIndex = 0;
+  GLint baseVertex = 0;
+};
+
+struct MeshHandle {
+  static constexpr std::uint32_t kInvalid = 0xFFFFFFFFu;
+  std::uint32_t index = kInvalid;
+
+  bool valid() const { return index != kInvalid; }
+};
+
+// where MeshAllocator::defragment() moved one mesh, in vertices and in 32-bit indices
+struct MeshMove {
+  GLuint vertexFrom = 0;
+  GLuint vertexTo = 0;
+  GLuint vertexCount = 0;
+  GLuint indexFrom = 0;
+  GLuint indexTo = 0;
+  GLuint indexCount = 0;
+};
+
+// The bookkeeping half of MeshPool: vertex and index ranges sub-allocated with an
+// OffsetAllocator each, and the handle slots. It never touches GL, MeshPool moves the data.
+class MeshAllocator {
+ public:
+  MeshAllocator(GLuint vertexCapacity, GLuint indexCapacity)
+      : vertexAllocator_(vertexCapacity), indexAllocator_(indexCapacity) {}
+
+  // returns an invalid handle when either range does not fit
+  // ------------------------------------------------------------------------
+  MeshHandle add(GLuint vertexCount, GLuint indexCount) {
+    OffsetAllocator::Allocation vertexAllocation = vertexAllocator_.allocate(vertexCount);
+    OffsetAllocator::Allocation indexAllocation = indexAllocator_.allocate(indexCount);
+    if (!vertexAllocation.valid() || !indexAllocation.valid()) {
+      vertexAllocator_.free(vertexAllocation);
+      indexAllocator_.free(indexAllocation);
+      return {};
+    }
+
+    MeshHandle handle;
+    if (!freeSlots_.empty()) {
+      handle.index = freeSlots_.back();
+      freeSlots_.pop_back();
+    } else {
+      handle.index = static_cast<std::uint32_t>(meshes_.size());
+      meshes_.emplace_back();
+    }
+    Mesh& mesh = meshes_[handle.index];
+    mesh.vertices = vertexAllocation;
+    mesh.indices = indexAllocation;
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.live = true;
+    return handle;
+  }
+
+  // ------------------------------------------------------------------------
+  void remove(MeshHandle handle) {
+    if (!contains(handle)) {
+      return;
+    }
+    Mesh& mesh = meshes_[handle.index];
+    vertexAllocator_.free(mesh.vertices);
+    indexAllocator_.free(mesh.indices);
+    mesh.live = false;
+    freeSlots_.push_back(handle.index);
+  }
+
+  bool contains(MeshHandle handle) const { return handle.index < meshes_.size() && meshes_[handle.index].live; }
+
+  MeshRange range(MeshHandle handle) const {
+    const Mesh& mesh = meshes_[handle.index];
+    MeshRange range;
+    range.indexCount = mesh.indexCount;
+    range.firstIndex = mesh.indices.offset;
+    range.baseVertex = static_cast<GLint>(mesh.vertices.offset);
+    return range;
+  }
+
+  GLuint vertexCount(MeshHandle handle) const { return meshes_[handle.index].vertexCount; }
+  GLuint vertexCapacity() const { return vertexAllocator_.size(); }
+  GLuint indexCapacity() const { return indexAllocator_.size(); }
+  GLuint freeVertices() const { return vertexAllocator_.freeStorage(); }
+  GLuint freeIndices() const { return indexAllocator_.freeStorage(); }
+
+  // 0 when all free space is one block, close to 1 when it is scattered in small holes
+  // ------------------------------------------------------------------------
+  float fragmentation() const {
+    auto of = [](const OffsetAllocator& allocator) {
+      const std::uint32_t free = allocator.freeStorage();
+      return free == 0 ? 0.0f : 1.0f - static_cast<float>(allocator.largestFreeRegion()) / static_cast<float>(free);
+    };
+    return std::max(of(vertexAllocator_), of(indexAllocator_));
+  }
+
+  // pack every live mesh to the front of the space: vertices in the order of the old vertex
+  // ranges, indices in the order of the old index ranges, each exactly end to end (no bin
+  // round-up, so whatever fit before fits again). Returns the copies from the old ranges to the
+  // new ones, in the order of the vertex data.
+  // ------------------------------------------------------------------------
+  std::vector<MeshMove> defragment() {
+    std::vector<std::uint32_t> vertexOrder;
+    for (std::uint32_t i = 0; i < meshes_.size(); ++i) {
+      if (meshes_[i].live) {
+        vertexOrder.push_back(i);
+      }
+    }
+    std::vector<std::uint32_t> indexOrder = vertexOrder;
+    std::sort(vertexOrder.begin(), vertexOrder.end(), [this](std::uint32_t a, std::uint32_t b) {
+      return meshes_[a].vertices.offset < meshes_[b].vertices.offset;
+    });
+    std::sort(indexOrder.begin(), indexOrder.end(), [this](std::uint32_t a, std::uint32_t b) {
+      return meshes_[a].indices.offset < meshes_[b].indices.offset;
+    });
+
+    std::vector<MeshMove> moves(meshes_.size());
+    for (std::uint32_t index : vertexOrder) {
+      moves[index].vertexFrom = meshes_[index].vertices.offset;
+      moves[index].indexFrom = meshes_[index].indices.offset;
+    }
+    vertexAllocator_.reset();
+    indexAllocator_.reset();
+    for (std::uint32_t index : vertexOrder) {
+      Mesh& mesh = meshes_[index];
+      mesh.vertices = vertexAllocator_.allocateFromLargest(mesh.vertexCount);
+      assert(mesh.vertices.valid());
+    }
+    for (std::uint32_t index : indexOrder) {
+      Mesh& mesh = meshes_[index];
+      mesh.indices = indexAllocator_.allocateFromLargest(mesh.indexCount);
+      assert(mesh.indices.valid());
+    }
+
+    std::vector<MeshMove> ordered;
+    ordered.reserve(vertexOrder.size());
+    for (std::uint32_t index : vertexOrder) {
+      const Mesh& mesh = meshes_[index];
+      MeshMove& move = moves[index];
+      move.vertexTo = mesh.vertices.offset;
+      move.vertexCount = mesh.vertexCount;
+      move.indexTo = mesh.indices.offset;
+      move.indexCount = mesh.indexCount;
+      ordered.push_back(move);
+    }
+    return ordered;
+  }
+
+ private:
+  struct Mesh {
+    OffsetAllocator::Allocation vertices;
+    OffsetAllocator::Allocation indices;
+    GLuint vertexCount = 0;
+    GLuint indexCount = 0;
+    bool live = false;
+  };
+
+  OffsetAllocator vertexAllocator_;
+  OffsetAllocator indexAllocator_;
+  std::vector<Mesh> meshes_;
+  std::vector<std::uint32_t> freeSlots_;
+};
+
+// All meshes of one vertex format in one vertex buffer and one element buffer.
+//
+// Vertices and indices are sub-allocated by a MeshAllocator (in units of vertices and of
+// 32-bit indices), so every mesh of the format shares a single vertex array and is
+// drawn with glDrawElementsBaseVertex(..., firstIndex * 4, baseVertex) from range(). Handles
+// stay valid across defragment(), which packs all live meshes to the front of fresh buffers
+// with glCopyBufferSubData; the ranges change, so look them up again afterwards.
+//
+// setupAttributes is called with the vertex array and the vertex buffer bound and must
+// specify the format's attribute pointers (offsets relative to the buffer start). The buffers
+// and the vertex array are owned through the registry, so the buffers replaced by defragment()
+// are only deleted once the frames still drawing from them are done.
+class MeshPool {
+ public:
+  // ------------------------------------------------------------------------
+  MeshPool(GlResourceRegistry& resources, GlStateCache& glState, GLsizei vertexStride, GLuint vertexCapacity,
+           GLuint indexCapacity, std::function<void()> setupAttributes, quill::Logger* logger)
+      : resources_(resources),
+        stride_(vertexStride),
+        setupAttributes_(std::move(setupAttributes)),
+        logger_(logger),
+        allocator_(vertexCapacity, indexCapacity),
+        vertexArray_(GlVertexArray::generate(resources)),
+        vertexBuffer_(createBuffer(vertexBytes(vertexCapacity))),
+        elementBuffer_(createBuffer(indexBytes(indexCapacity))) {
+    attachBuffers(glState);
+  }
+
+  MeshPool(const MeshPool&) = delete;
+  MeshPool& operator=(const MeshPool&) = delete;
+
+  GLuint vertexArray() const { return vertexArray_.get(); }
+
+  // point another vertex array at the pool's buffers, e.g. one that adds per-instance
+  // attributes (SpriteBatch), and leave it bound. defragment() replaces the buffers, so this
+  // has to be repeated afterwards.
+  // ------------------------------------------------------------------------
+  void attachTo(GlStateCache& glState, GLuint vertexArray) const {
+    glState.bindVertexArray(vertexArray);
+    glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer_.get());
+    setupAttributes_();
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer_.get());
+  }
+
+  // upload a mesh; returns an invalid handle when either buffer has no room left
+  // ------------------------------------------------------------------------
+  MeshHandle add(const void* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount) {
+    const MeshHandle handle = allocator_.add(vertexCount, indexCount);
+    if (!handle.valid()) {
+      LOG_ERROR(logger_, "mesh pool: no room for {} vertices / {} indices (free: {} / {}), try defragment()",
+                vertexCount, indexCount, allocator_.freeVertices(), allocator_.freeIndices());
+      return {};
+    }
+
+    const MeshRange r = allocator_.range(handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer_.get());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexBytes(static_cast<GLuint>(r.baseVertex)), vertexBytes(vertexCount),
+                    vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, elementBuffer_.get());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes(r.firstIndex), indexBytes(indexCount), indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return handle;
+  }
+
+  void remove(MeshHandle handle) { allocator_.remove(handle); }
+  bool contains(MeshHandle handle) const { return allocator_.contains(handle); }
+  MeshRange range(MeshHandle handle) const { return allocator_.range(handle); }
+
+  // ------------------------------------------------------------------------
+  void draw(MeshHandle handle, GLenum mode = GL_TRIANGLES) const {
+    MeshRange r = range(handle);
+    glDrawElementsBaseVertex(mode, static_cast<GLsizei>(r.indexCount), GL_UNSIGNED_INT,
+                             reinterpret_cast<const void*>(indexBytes(r.firstIndex)), r.baseVertex);
+  }
+
+  float fragmentation() const { return allocator_.fragmentation(); }
+
+  // pack every live mesh to the front of new buffers; the vertex array is rebuilt in place
+  // ------------------------------------------------------------------------
+  void defragment(GlStateCache& glState) {
+    GlBuffer newVertexBuffer = createBuffer(vertexBytes(allocator_.vertexCapacity()));
+    GlBuffer newElementBuffer = createBuffer(indexBytes(allocator_.indexCapacity()));
+    const std::vector<MeshMove> moves = allocator_.defragment();
+    for (const MeshMove& move : moves) {
+      copy(vertexBuffer_.get(), newVertexBuffer.get(), vertexBytes(move.vertexFrom), vertexBytes(move.vertexTo),
+           vertexBytes(move.vertexCount));
+      copy(elementBuffer_.get(), newElementBuffer.get(), indexBytes(move.indexFrom), indexBytes(move.indexTo),
+           indexBytes(move.indexCount));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // the old buffers are released, not deleted: frames in flight may still draw from them
+    vertexBuffer_ = std::move(newVertexBuffer);
+    elementBuffer_ = std::move(newElementBuffer);
+    attachBuffers(glState);
+    LOG_INFO(logger_, "mesh pool: defragmented {} meshes", moves.size());
+  }
+
+ private:
+  GlResourceRegistry& resources_;
+  GLsizei stride_;
+  std::function<void()> setupAttributes_;
+  quill::Logger* logger_;
+  MeshAllocator allocator_;
+  GlVertexArray vertexArray_;
+  GlBuffer vertexBuffer_;
+  GlBuffer elementBuffer_;
+
+  GLsizeiptr vertexBytes(GLuint vertices) const { return static_cast<GLsizeiptr>(vertices) * stride_; }
+  static GLsizeiptr indexBytes(GLuint indices) { return static_cast<GLsizeiptr>(indices) * sizeof(GLuint); }
+
+  GlBuffer createBuffer(GLsizeiptr bytes) {
+    GlBuffer buffer = GlBuffer::generate(resources_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.get());
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+  }
+
+  static void copy(GLuint from, GLuint to, GLintptr fromOffset, GLintptr toOffset, GLsizeiptr bytes) {
+    glBindBuffer(GL_COPY_READ_BUFFER, from);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, to);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, fromOffset, toOffset, bytes);
+  }
+
+  // the element buffer binding is vertex array state, so it is bound with the array bound
+  void attachBuffers(GlStateCache& glState) {
+    attachTo(glState, vertexArray_.get());
+    glState.bindVertexArray(0);
+  }
+};
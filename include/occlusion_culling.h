@@ -0,0 +1,479 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "bvh.h"
+#include "simd_math.h"
+#include "thread_pool.h"
+
+#if defined(SIMD_MATH_AVX) && defined(__AVX2__)
+#define OCCLUSION_AVX2 1
+#endif
+
+// Software occlusion culling with a masked, low resolution depth buffer (after Andersson et
+// al., "Masked Software Occlusion Culling").
+//
+// The screen is split into tiles of 32 x 8 pixels. A tile stores no per-pixel depths, only a
+// 256-bit coverage mask and two depths: z0 bounds the depth of every pixel of the tile, z1 the
+// depth of the pixels in the mask (the "working layer"). A triangle that covers part of a tile
+// merges into the working layer; once the mask is full the layer becomes the new z0. The tiles
+// are the coarse level of the hierarchy: an occludee is hidden when its nearest depth lies
+// behind z0 of every tile its screen rectangle touches. Depths are NDC depths mapped to [0, 1],
+// which are affine in screen space, so a triangle's farthest depth within a tile is read off its
+// depth plane at the tile corners.
+//
+// rasterize() transforms, sets up and bins the queued occluder triangles on a ThreadPool (one
+// bin list per worker and tile row), then rasterizes the tile rows in parallel, so no two
+// threads touch the same tile. With AVX2 the coverage of all 8 rows of a tile is computed in one
+// register: per-row span ends from the edge equations, turned into bit masks by variable shifts.
+//
+// Everything errs on the side of visible: triangles with a vertex behind the camera are not
+// rasterized, and boxes reaching behind it are always visible. The result depends on the order
+// triangles reach a tile in, which varies with threading, but is conservative in any order.
+class OcclusionBuffer {
+ public:
+  static constexpr int kTileWidth = 32;
+  static constexpr int kTileHeight = 8;
+  static constexpr std::size_t kTrianglesPerJob = 256;
+
+  // the size is rounded up to whole tiles
+  // ------------------------------------------------------------------------
+  OcclusionBuffer(int width, int height)
+      : tilesX_(std::max(1, (width + kTileWidth - 1) / kTileWidth)),
+        tilesY_(std::max(1, (height + kTileHeight - 1) / kTileHeight)),
+        tiles_(static_cast<std::size_t>(tilesX_ * tilesY_)) {
+    clear();
+  }
+
+  int width() const { return tilesX_ * kTileWidth; }
+  int height() const { return tilesY_ * kTileHeight; }
+
+  // forget the occluders, start a new frame
+  // ------------------------------------------------------------------------
+  void clear() {
+    for (Tile& tile : tiles_) {
+      tile = {};
+    }
+    occluders_.clear();
+    rasterizedTriangles_ = 0;
+  }
+
+  // queue a triangle mesh, counter-clockwise front faces; back faces are skipped, so closed
+  // meshes work as they are. vertices and indices must stay alive until rasterize().
+  // ------------------------------------------------------------------------
+  void addOccluder(std::span<const math::vec3> vertices, std::span<const std::uint32_t> indices,
+                   const math::mat4& modelViewProjection) {
+    occluders_.push_back({vertices, indices, modelViewProjection});
+  }
+
+  // ------------------------------------------------------------------------
+  void rasterize(ThreadPool* pool = nullptr) {
+    const std::size_t workers = pool != nullptr ? pool->size() : 1;
+    jobs_.clear();
+    std::size_t triangleCount = 0;
+    for (std::size_t occluder = 0; occluder < occluders_.size(); ++occluder) {
+      const std::size_t count = occluders_[occluder].indices.size() / 3;
+      for (std::size_t first = 0; first < count; first += kTrianglesPerJob) {
+        jobs_.push_back({occluder, first, std::min(kTrianglesPerJob, count - first), triangleCount + first, 0});
+      }
+      triangleCount += count;
+    }
+    triangles_.resize(triangleCount);
+    bins_.resize(workers * static_cast<std::size_t>(tilesY_));
+    for (auto& bin : bins_) {
+      bin.clear();
+    }
+
+    // transform, set up and bin
+    auto setupJob = [this](std::size_t index, std::size_t worker) {
+      Job& job = jobs_[index];
+      const Occluder& occluder = occluders_[job.occluder];
+      for (std::size_t t = 0; t < job.count; ++t) {
+        const std::uint32_t* corner = occluder.indices.data() + (job.first + t) * 3;
+        const std::size_t slot = job.slot + t;
+        if (!setup(occluder, corner, triangles_[slot])) {
+          continue;
+        }
+        ++job.accepted;
+        for (int row = triangles_[slot].tileY0; row <= triangles_[slot].tileY1; ++row) {
+          bins_[worker * static_cast<std::size_t>(tilesY_) + static_cast<std::size_t>(row)].push_back(
+              static_cast<std::uint32_t>(slot));
+        }
+      }
+    };
+    // rasterize one tile row, taking the binned triangles of every worker
+    auto rasterizeRow = [this, workers](std::size_t row, std::size_t) {
+      for (std::size_t worker = 0; worker < workers; ++worker) {
+        for (std::uint32_t slot : bins_[worker * static_cast<std::size_t>(tilesY_) + row]) {
+          rasterizeTriangleRow(triangles_[slot], static_cast<int>(row));
+        }
+      }
+    };
+    if (pool != nullptr) {
+      pool->parallelFor(jobs_.size(), setupJob);
+      pool->parallelFor(static_cast<std::size_t>(tilesY_), rasterizeRow);
+    } else {
+      for (std::size_t index = 0; index < jobs_.size(); ++index) {
+        setupJob(index, 0);
+      }
+      for (std::size_t row = 0; row < static_cast<std::size_t>(tilesY_); ++row) {
+        rasterizeRow(row, 0);
+      }
+    }
+    for (const Job& job : jobs_) {
+      rasterizedTriangles_ += job.accepted;
+    }
+    occluders_.clear();
+  }
+
+  // false when the world space box is certainly hidden behind the rasterized occluders
+  // ------------------------------------------------------------------------
+  bool isVisible(const Aabb& box, const math::mat4& viewProjection) const {
+    float minX = std::numeric_limits<float>::max(), minY = minX, nearest = minX;
+    float maxX = -minX, maxY = -minX;
+    for (int corner = 0; corner < 8; ++corner) {
+      const math::vec3 p{(corner & 1) != 0 ? box.max.x : box.min.x, (corner & 2) != 0 ? box.max.y : box.min.y,
+                         (corner & 4) != 0 ? box.max.z : box.min.z};
+      const math::vec4 clip = viewProjection * math::vec4(p, 1.0f);
+      if (clip.w <= kMinW) {
+        return true;
+      }
+      const ScreenPoint s = toScreen(clip);
+      minX = std::min(minX, s.x);
+      maxX = std::max(maxX, s.x);
+      minY = std::min(minY, s.y);
+      maxY = std::max(maxY, s.y);
+      nearest = std::min(nearest, s.depth);
+    }
+    if (maxX < 0.0f || maxY < 0.0f || minX >= static_cast<float>(width()) || minY >= static_cast<float>(height())) {
+      return false;  // off screen
+    }
+    // pixels whose square the rectangle touches
+    const int pixelX0 = static_cast<int>(std::max(minX, 0.0f));
+    const int pixelX1 = static_cast<int>(std::min(maxX, static_cast<float>(width() - 1)));
+    const int pixelY0 = static_cast<int>(std::max(minY, 0.0f));
+    const int pixelY1 = static_cast<int>(std::min(maxY, static_cast<float>(height() - 1)));
+    for (int ty = pixelY0 / kTileHeight; ty <= pixelY1 / kTileHeight; ++ty) {
+      for (int tx = pixelX0 / kTileWidth; tx <= pixelX1 / kTileWidth; ++tx) {
+        // hidden in this tile when behind z0, or behind z1 and within the working layer
+        const Tile& tile = tiles_[static_cast<std::size_t>(ty * tilesX_ + tx)];
+        if (nearest < tile.z0 &&
+            (nearest < tile.z1 || !insideWorkingLayer(tile, tx, ty, pixelX0, pixelX1, pixelY0, pixelY1))) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // keep the candidates whose box is visible, e.g. after frustum culling
+  // ------------------------------------------------------------------------
+  void filterVisible(std::span<const std::uint32_t> candidates, std::span<const Aabb> boxes,
+                     const math::mat4& viewProjection, std::vector<std::uint32_t>& visible) const {
+    for (std::uint32_t index : candidates) {
+      if (isVisible(boxes[index], viewProjection)) {
+        visible.push_back(index);
+      }
+    }
+  }
+
+  // depth every pixel of the tile is known to be at or in front of; 1 where nothing was drawn
+  float tileDepth(int tileX, int tileY) const { return tiles_[static_cast<std::size_t>(tileY * tilesX_ + tileX)].z0; }
+  int tilesX() const { return tilesX_; }
+  int tilesY() const { return tilesY_; }
+  // occluder triangles that reached the bins (not back facing, behind the camera or off screen)
+  std::uint64_t rasterizedTriangles() const { return rasterizedTriangles_; }
+
+ private:
+  static constexpr float kMinW = 1e-5f;
+
+  struct alignas(32) Tile {
+    std::uint32_t mask[kTileHeight] = {};  // bit x of row y: pixel (x, y) is in the working layer
+    float z0 = 1.0f;
+    float z1 = 0.0f;
+  };
+
+  struct Occluder {
+    std::span<const math::vec3> vertices;
+    std::span<const std::uint32_t> indices;
+    math::mat4 modelViewProjection;
+  };
+
+  struct Job {
+    std::size_t occluder;
+    std::size_t first;  // triangle within the occluder
+    std::size_t count;
+    std::size_t slot;      // of the first triangle in triangles_
+    std::size_t accepted;  // triangles that survived setup
+  };
+
+  struct ScreenPoint {
+    float x, y, depth;
+  };
+
+  // an edge bounds the pixel centers of a row from the left (x >= at(y)), from the right
+  // (x < at(y)), or, when horizontal, keeps rows above or below it
+  enum class EdgeKind : std::uint8_t { Left, Right, Above, Below };
+
+  struct Edge {
+    EdgeKind kind;
+    float x0, y0, slope;  // x at row center y is x0 + (y - y0) * slope
+  };
+
+  struct Triangle {
+    std::array<Edge, 3> edges;
+    float depthX, depthY, depth0;  // depth = depth0 + depthX * x + depthY * y
+    float maxDepth;
+    int tileX0, tileX1, tileY0, tileY1;
+  };
+
+  int tilesX_;
+  int tilesY_;
+  std::vector<Tile> tiles_;
+  std::vector<Occluder> occluders_;
+  std::vector<Job> jobs_;
+  std::vector<Triangle> triangles_;
+  std::vector<std::vector<std::uint32_t>> bins_;  // per worker and tile row
+  std::uint64_t rasterizedTriangles_ = 0;
+
+  // pixels, y up, and depth in [0, 1]
+  ScreenPoint toScreen(const math::vec4& clip) const {
+    const float invW = 1.0f / clip.w;
+    return {(clip.x * invW * 0.5f + 0.5f) * static_cast<float>(width()),
+            (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(height()), clip.z * invW * 0.5f + 0.5f};
+  }
+
+  // whether the tile's part of the pixel rectangle lies within the working layer, whose pixels
+  // are at or in front of z1
+  // ------------------------------------------------------------------------
+  static bool insideWorkingLayer(const Tile& tile, int tileX, int tileY, int x0, int x1, int y0, int y1) {
+    const int left = std::max(x0 - tileX * kTileWidth, 0);
+    const int right = std::min(x1 - tileX * kTileWidth + 1, kTileWidth);
+    const std::uint32_t columns = (right >= kTileWidth ? 0xFFFFFFFFu : (1u << right) - 1u) & ~((1u << left) - 1u);
+    const int firstRow = std::max(y0 - tileY * kTileHeight, 0);
+    const int lastRow = std::min(y1 - tileY * kTileHeight, kTileHeight - 1);
+    for (int row = firstRow; row <= lastRow; ++row) {
+      if ((columns & ~tile.mask[row]) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the tile column / row of a pixel coordinate, clamped to the buffer
+  int tileColumn(float x) const {
+    return static_cast<int>(std::clamp(x, 0.0f, static_cast<float>(width() - 1))) / kTileWidth;
+  }
+  int tileRow(float y) const {
+    return static_cast<int>(std::clamp(y, 0.0f, static_cast<float>(height() - 1))) / kTileHeight;
+  }
+
+  // false for triangles that are skipped: behind the camera, back facing, too small or off screen
+  // ------------------------------------------------------------------------
+  bool setup(const Occluder& occluder, const std::uint32_t* corner, Triangle& triangle) const {
+    std::array<ScreenPoint, 3> v;
+    for (int i = 0; i < 3; ++i) {
+      const math::vec4 clip = occluder.modelViewProjection * math::vec4(occluder.vertices[corner[i]], 1.0f);
+      if (clip.w <= kMinW) {
+        return false;
+      }
+      v[static_cast<std::size_t>(i)] = toScreen(clip);
+    }
+    const float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+    if (!(area > 0.0f)) {
+      return false;
+    }
+
+    const float minX = std::min({v[0].x, v[1].x, v[2].x});
+    const float maxX = std::max({v[0].x, v[1].x, v[2].x});
+    const float minY = std::min({v[0].y, v[1].y, v[2].y});
+    const float maxY = std::max({v[0].y, v[1].y, v[2].y});
+    if (maxX < 0.0f || maxY < 0.0f || minX >= static_cast<float>(width()) || minY >= static_cast<float>(height())) {
+      return false;
+    }
+    triangle.tileX0 = tileColumn(minX);
+    triangle.tileX1 = tileColumn(maxX);
+    triangle.tileY0 = tileRow(minY);
+    triangle.tileY1 = tileRow(maxY);
+
+    // counter-clockwise: the inside is left of every edge
+    for (std::size_t i = 0; i < 3; ++i) {
+      const ScreenPoint& a = v[i];
+      const ScreenPoint& b = v[(i + 1) % 3];
+      const float dx = b.x - a.x;
+      const float dy = b.y - a.y;
+      Edge& edge = triangle.edges[i];
+      edge.x0 = a.x;
+      edge.y0 = a.y;
+      if (dy == 0.0f) {
+        edge.kind = dx > 0.0f ? EdgeKind::Above : EdgeKind::Below;
+        edge.slope = 0.0f;
+      } else {
+        edge.kind = dy > 0.0f ? EdgeKind::Right : EdgeKind::Left;
+        edge.slope = dx / dy;
+      }
+    }
+
+    // depth plane through the three vertices
+    const float e1x = v[1].x - v[0].x, e1y = v[1].y - v[0].y, e1z = v[1].depth - v[0].depth;
+    const float e2x = v[2].x - v[0].x, e2y = v[2].y - v[0].y, e2z = v[2].depth - v[0].depth;
+    triangle.depthX = (e1z * e2y - e2z * e1y) / area;
+    triangle.depthY = (e2z * e1x - e1z * e2x) / area;
+    triangle.depth0 = v[0].depth - triangle.depthX * v[0].x - triangle.depthY * v[0].y;
+    triangle.maxDepth = std::max({v[0].depth, v[1].depth, v[2].depth});
+    return true;
+  }
+
+  // ------------------------------------------------------------------------
+  void rasterizeTriangleRow(const Triangle& triangle, int tileY) {
+    // span [left, right) of covered pixel centers for each of the tile row's 8 pixel rows
+    alignas(32) std::int32_t left[kTileHeight];
+    alignas(32) std::int32_t right[kTileHeight];
+    rowSpans(triangle, tileY * kTileHeight, left, right);
+
+    const float y0 = static_cast<float>(tileY * kTileHeight);
+    const float y1 = y0 + static_cast<float>(kTileHeight);
+    const float rowDepth = triangle.depth0 + triangle.depthY * (triangle.depthY > 0.0f ? y1 : y0);
+    for (int tileX = triangle.tileX0; tileX <= triangle.tileX1; ++tileX) {
+      const int x0 = tileX * kTileWidth;
+      // the farthest depth of the triangle's plane over the tile, no farther than its vertices
+      const float cornerX = static_cast<float>(triangle.depthX > 0.0f ? x0 + kTileWidth : x0);
+      const float depth = std::min(triangle.maxDepth, rowDepth + triangle.depthX * cornerX);
+      Tile& tile = tiles_[static_cast<std::size_t>(tileY * tilesX_ + tileX)];
+      if (depth >= tile.z0) {
+        continue;  // behind what the tile already has everywhere
+      }
+      updateTile(tile, left, right, x0, depth);
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  static void rowSpans(const Triangle& triangle, int pixelY, std::int32_t* left, std::int32_t* right) {
+    const float limit = static_cast<float>(1 << 24);
+#if defined(OCCLUSION_AVX2)
+    const __m256 y = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(pixelY)),
+                                   _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+    __m256 low = _mm256_set1_ps(-limit);
+    __m256 high = _mm256_set1_ps(limit);
+    for (const Edge& edge : triangle.edges) {
+      if (edge.kind == EdgeKind::Above || edge.kind == EdgeKind::Below) {
+        const __m256 edgeY = _mm256_set1_ps(edge.y0);
+        const __m256 keep = edge.kind == EdgeKind::Above ? _mm256_cmp_ps(y, edgeY, _CMP_GE_OQ)
+                                                         : _mm256_cmp_ps(y, edgeY, _CMP_LE_OQ);
+        high = _mm256_blendv_ps(_mm256_set1_ps(-limit), high, keep);
+        continue;
+      }
+      __m256 x = _mm256_add_ps(_mm256_set1_ps(edge.x0),
+                               _mm256_mul_ps(_mm256_sub_ps(y, _mm256_set1_ps(edge.y0)), _mm256_set1_ps(edge.slope)));
+      x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-limit)), _mm256_set1_ps(limit));
+      // pixel px is covered when its center px + 0.5 is inside
+      const __m256 bound = _mm256_ceil_ps(_mm256_sub_ps(x, _mm256_set1_ps(0.5f)));
+      if (edge.kind == EdgeKind::Left) {
+        low = _mm256_max_ps(low, bound);
+      } else {
+        high = _mm256_min_ps(high, bound);
+      }
+    }
+    _mm256_store_si256(reinterpret_cast<__m256i*>(left), _mm256_cvtps_epi32(low));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(right), _mm256_cvtps_epi32(high));
+#else
+    for (int row = 0; row < kTileHeight; ++row) {
+      const float y = static_cast<float>(pixelY + row) + 0.5f;
+      float low = -limit;
+      float high = limit;
+      for (const Edge& edge : triangle.edges) {
+        if (edge.kind == EdgeKind::Above || edge.kind == EdgeKind::Below) {
+          if (edge.kind == EdgeKind::Above ? !(y >= edge.y0) : !(y <= edge.y0)) {
+            high = -limit;
+          }
+          continue;
+        }
+        const float x = std::clamp(edge.x0 + (y - edge.y0) * edge.slope, -limit, limit);
+        const float bound = std::ceil(x - 0.5f);
+        if (edge.kind == EdgeKind::Left) {
+          low = std::max(low, bound);
+        } else {
+          high = std::min(high, bound);
+        }
+      }
+      left[row] = static_cast<std::int32_t>(low);
+      right[row] = static_cast<std::int32_t>(high);
+    }
+#endif
+  }
+
+  // merge the triangle's coverage of the tile at pixel column x0 into its layers
+  // ------------------------------------------------------------------------
+  static void updateTile(Tile& tile, const std::int32_t* left, const std::int32_t* right, int x0, float depth) {
+#if defined(OCCLUSION_AVX2)
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i zero = _mm256_setzero_si256();
+    const auto tileOffsets = [x0, zero](const std::int32_t* ends) {
+      const __m256i offsets = _mm256_sub_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(ends)),
+                                               _mm256_set1_epi32(x0));
+      return _mm256_min_epi32(_mm256_max_epi32(offsets, zero), _mm256_set1_epi32(kTileWidth));
+    };
+    // bits [l, r) of each row; a shift by 32 yields 0
+    const __m256i coverage =
+        _mm256_andnot_si256(_mm256_sllv_epi32(ones, tileOffsets(right)), _mm256_sllv_epi32(ones, tileOffsets(left)));
+    if (_mm256_testz_si256(coverage, coverage)) {
+      return;
+    }
+    __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(tile.mask));
+    const bool empty = _mm256_testz_si256(mask, mask) != 0;
+#else
+    std::array<std::uint32_t, kTileHeight> coverage;
+    bool covered = false;
+    bool empty = true;
+    for (int row = 0; row < kTileHeight; ++row) {
+      const int l = std::clamp(left[row] - x0, 0, kTileWidth);
+      const int r = std::clamp(right[row] - x0, 0, kTileWidth);
+      const auto bits = [](int n) { return n >= kTileWidth ? 0xFFFFFFFFu : (1u << n) - 1u; };
+      coverage[static_cast<std::size_t>(row)] = bits(r) & ~bits(l);
+      covered |= coverage[static_cast<std::size_t>(row)] != 0;
+      empty &= tile.mask[row] == 0;
+    }
+    if (!covered) {
+      return;
+    }
+#endif
+    // A triangle nearer than the working layer by more than the layer is ahead of z0 would only
+    // add coverage at the layer's far depth: start the layer over with just this triangle. The
+    // dropped pixels are still bounded by z0.
+    if (!empty && tile.z1 - depth > tile.z0 - tile.z1) {
+      tile.z1 = 0.0f;
+#if defined(OCCLUSION_AVX2)
+      mask = zero;
+#else
+      std::fill(std::begin(tile.mask), std::end(tile.mask), 0u);
+#endif
+    }
+    tile.z1 = std::max(tile.z1, depth);
+#if defined(OCCLUSION_AVX2)
+    mask = _mm256_or_si256(mask, coverage);
+    const bool full = _mm256_testc_si256(mask, ones) != 0;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tile.mask), full ? zero : mask);
+#else
+    bool full = true;
+    for (int row = 0; row < kTileHeight; ++row) {
+      tile.mask[row] |= coverage[static_cast<std::size_t>(row)];
+      full &= tile.mask[row] == 0xFFFFFFFFu;
+    }
+    if (full) {
+      std::fill(std::begin(tile.mask), std::end(tile.mask), 0u);
+    }
+#endif
+    if (full) {
+      // every pixel is at or in front of both layers now
+      tile.z0 = std::min(tile.z0, tile.z1);
+      tile.z1 = 0.0f;
+    }
+  }
+};
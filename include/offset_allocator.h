@@ -0,0 +1,264 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit (TLSF) allocator over an abstract range [0, size).
+//
+// It only hands out offsets, the memory itself lives elsewhere (e.g. a GL buffer). Free
+// blocks are binned by a small floating point encoding of their size (5 bit exponent, 3 bit
+// mantissa = 256 bins); two levels of bitmasks find a bin with a large enough block in O(1),
+// and free() merges a block with its free neighbours in O(1). Node storage is allocated once,
+// so at most maxAllocations blocks (used and free) can exist at a time.
+class OffsetAllocator {
+ public:
+  static constexpr std::uint32_t kNoSpace = 0xFFFFFFFFu;
+
+  struct Allocation {
+    std::uint32_t offset = kNoSpace;
+    std::uint32_t node = kNoSpace;
+
+    bool valid() const { return offset != kNoSpace; }
+  };
+
+  // ------------------------------------------------------------------------
+  explicit OffsetAllocator(std::uint32_t size, std::uint32_t maxAllocations = 64 * 1024)
+      : size_(size), nodes_(maxAllocations + 1) {
+    reset();
+  }
+
+  // forget every allocation
+  // ------------------------------------------------------------------------
+  void reset() {
+    freeStorage_ = 0;
+    usedBinsTop_ = 0;
+    for (auto& bin : usedBins_) {
+      bin = 0;
+    }
+    for (auto& head : binHeads_) {
+      head = kUnused;
+    }
+    freeNodes_.clear();
+    for (std::uint32_t i = static_cast<std::uint32_t>(nodes_.size()); i-- > 0;) {
+      freeNodes_.push_back(i);
+    }
+    if (size_ > 0) {
+      insertFree(0, size_, kUnused, kUnused);
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  Allocation allocate(std::uint32_t size) {
+    if (size == 0 || freeNodes_.empty()) {
+      return {};
+    }
+    // smallest bin whose every block is guaranteed to fit
+    const std::uint32_t minBin = binRoundUp(size);
+    const std::uint32_t minTop = minBin >> kMantissaBits;
+    const std::uint32_t minLeaf = minBin & kMantissaMask;
+    std::uint32_t top = minTop;
+    std::uint32_t leaf = kUnused;
+    if (minTop < kTopBins && (usedBinsTop_ & (1u << minTop)) != 0) {
+      leaf = lowestBitFrom(usedBins_[minTop], minLeaf);
+    }
+    if (leaf == kUnused) {
+      top = lowestBitFrom(usedBinsTop_, minTop + 1);
+      if (top == kUnused) {
+        return {};
+      }
+      leaf = static_cast<std::uint32_t>(std::countr_zero(usedBins_[top]));
+    }
+
+    return take(binHeads_[(top << kMantissaBits) | leaf], size);
+  }
+
+  // exactly size from the front of a block in the highest used bin, without the round-up of
+  // allocate(); invalid when that block is smaller. With a single free block, e.g. right after
+  // reset(), repeated calls pack allocations front to back until the space is used up exactly.
+  // ------------------------------------------------------------------------
+  Allocation allocateFromLargest(std::uint32_t size) {
+    if (size == 0 || freeNodes_.empty() || usedBinsTop_ == 0) {
+      return {};
+    }
+    const auto top = static_cast<std::uint32_t>(31 - std::countl_zero(usedBinsTop_));
+    const auto leaf = static_cast<std::uint32_t>(31 - std::countl_zero(std::uint32_t{usedBins_[top]}));
+    const std::uint32_t index = binHeads_[(top << kMantissaBits) | leaf];
+    if (nodes_[index].size < size) {
+      return {};
+    }
+    return take(index, size);
+  }
+
+  // ------------------------------------------------------------------------
+  void free(Allocation allocation) {
+    if (!allocation.valid()) {
+      return;
+    }
+    std::uint32_t index = allocation.node;
+    std::uint32_t offset = nodes_[index].offset;
+    std::uint32_t size = nodes_[index].size;
+    std::uint32_t previous = nodes_[index].previous;
+    std::uint32_t next = nodes_[index].next;
+
+    if (previous != kUnused && !nodes_[previous].used) {
+      offset = nodes_[previous].offset;
+      size += nodes_[previous].size;
+      removeFree(previous);
+      freeNodes_.push_back(previous);
+      previous = nodes_[previous].previous;
+    }
+    if (next != kUnused && !nodes_[next].used) {
+      size += nodes_[next].size;
+      removeFree(next);
+      freeNodes_.push_back(next);
+      next = nodes_[next].next;
+    }
+    freeNodes_.push_back(index);
+
+    const std::uint32_t merged = insertFree(offset, size, previous, next);
+    if (previous != kUnused) {
+      nodes_[previous].next = merged;
+    }
+    if (next != kUnused) {
+      nodes_[next].previous = merged;
+    }
+  }
+
+  std::uint32_t size() const { return size_; }
+  std::uint32_t freeStorage() const { return freeStorage_; }
+
+  // a lower bound of the largest block allocate() can still return
+  std::uint32_t largestFreeRegion() const {
+    if (usedBinsTop_ == 0) {
+      return 0;
+    }
+    const auto top = static_cast<std::uint32_t>(31 - std::countl_zero(usedBinsTop_));
+    const auto leaf = static_cast<std::uint32_t>(31 - std::countl_zero(std::uint32_t{usedBins_[top]}));
+    return binSize((top << kMantissaBits) | leaf);
+  }
+
+ private:
+  static constexpr std::uint32_t kUnused = 0xFFFFFFFFu;
+  static constexpr std::uint32_t kMantissaBits = 3;
+  static constexpr std::uint32_t kMantissaValue = 1u << kMantissaBits;
+  static constexpr std::uint32_t kMantissaMask = kMantissaValue - 1;
+  static constexpr std::uint32_t kTopBins = 32;
+  static constexpr std::uint32_t kBins = kTopBins * kMantissaValue;
+
+  struct Node {
+    std::uint32_t offset = 0;
+    std::uint32_t size = 0;
+    std::uint32_t binPrevious = kUnused;  // free list of the bin
+    std::uint32_t binNext = kUnused;
+    std::uint32_t previous = kUnused;  // physical neighbours
+    std::uint32_t next = kUnused;
+    bool used = false;
+  };
+
+  std::uint32_t size_;
+  std::uint32_t freeStorage_ = 0;
+  std::uint32_t usedBinsTop_ = 0;
+  std::uint8_t usedBins_[kTopBins] = {};
+  std::uint32_t binHeads_[kBins] = {};
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> freeNodes_;
+
+  // size -> bin, rounding up (allocation) or down (insertion); the "+" lets a rounded-up
+  // mantissa carry into the exponent
+  static std::uint32_t binRoundUp(std::uint32_t size) {
+    if (size < kMantissaValue) {
+      return size;
+    }
+    const auto mantissaStart = static_cast<std::uint32_t>(31 - std::countl_zero(size)) - kMantissaBits;
+    std::uint32_t mantissa = (size >> mantissaStart) & kMantissaMask;
+    if ((size & ((1u << mantissaStart) - 1)) != 0) {
+      ++mantissa;
+    }
+    return ((mantissaStart + 1) << kMantissaBits) + mantissa;
+  }
+
+  static std::uint32_t binRoundDown(std::uint32_t size) {
+    if (size < kMantissaValue) {
+      return size;
+    }
+    const auto mantissaStart = static_cast<std::uint32_t>(31 - std::countl_zero(size)) - kMantissaBits;
+    return ((mantissaStart + 1) << kMantissaBits) | ((size >> mantissaStart) & kMantissaMask);
+  }
+
+  static std::uint32_t binSize(std::uint32_t bin) {
+    const std::uint32_t exponent = bin >> kMantissaBits;
+    const std::uint32_t mantissa = bin & kMantissaMask;
+    return exponent == 0 ? mantissa : (mantissa | kMantissaValue) << (exponent - 1);
+  }
+
+  static std::uint32_t lowestBitFrom(std::uint32_t mask, std::uint32_t from) {
+    if (from >= 32) {
+      return kUnused;
+    }
+    const std::uint32_t masked = mask & (~0u << from);
+    return masked == 0 ? kUnused : static_cast<std::uint32_t>(std::countr_zero(masked));
+  }
+
+  // mark the first size units of free block index used, the rest stays free
+  // ------------------------------------------------------------------------
+  Allocation take(std::uint32_t index, std::uint32_t size) {
+    Node& node = nodes_[index];
+    const std::uint32_t blockSize = node.size;
+    removeFree(index);
+    node.used = true;
+    node.size = size;
+    if (blockSize > size) {
+      // the remainder goes back to the bins as the block's right neighbour
+      const std::uint32_t remainder = insertFree(node.offset + size, blockSize - size, index, node.next);
+      if (node.next != kUnused) {
+        nodes_[node.next].previous = remainder;
+      }
+      node.next = remainder;
+    }
+    return {node.offset, index};
+  }
+
+  // ------------------------------------------------------------------------
+  std::uint32_t insertFree(std::uint32_t offset, std::uint32_t size, std::uint32_t previous, std::uint32_t next) {
+    const std::uint32_t bin = binRoundDown(size);
+    const std::uint32_t top = bin >> kMantissaBits;
+    const std::uint32_t leaf = bin & kMantissaMask;
+    if (binHeads_[bin] == kUnused) {
+      usedBins_[top] = static_cast<std::uint8_t>(usedBins_[top] | (1u << leaf));
+      usedBinsTop_ |= 1u << top;
+    }
+
+    const std::uint32_t index = freeNodes_.back();
+    freeNodes_.pop_back();
+    Node& node = nodes_[index];
+    node = Node{offset, size, kUnused, binHeads_[bin], previous, next, false};
+    if (node.binNext != kUnused) {
+      nodes_[node.binNext].binPrevious = index;
+    }
+    binHeads_[bin] = index;
+    freeStorage_ += size;
+    return index;
+  }
+
+  void removeFree(std::uint32_t index) {
+    Node& node = nodes_[index];
+    if (node.binPrevious != kUnused) {
+      nodes_[node.binPrevious].binNext = node.binNext;
+    } else {
+      const std::uint32_t bin = binRoundDown(node.size);
+      binHeads_[bin] = node.binNext;
+      if (node.binNext == kUnused) {
+        const std::uint32_t top = bin >> kMantissaBits;
+        usedBins_[top] = static_cast<std::uint8_t>(usedBins_[top] & ~(1u << (bin & kMantissaMask)));
+        if (usedBins_[top] == 0) {
+          usedBinsTop_ &= ~(1u << top);
+        }
+      }
+    }
+    if (node.binNext != kUnused) {
+      nodes_[node.binNext].binPrevious = node.binPrevious;
+    }
+    freeStorage_ -= node.size;
+  }
+};
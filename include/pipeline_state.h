@@ -0,0 +1,247 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state.h"
+#include "hash.h"
+#include "shader.h"
+
+// fixed-function state groups; the defaults match a fresh GL context
+// ------------------------------------------------------------------------
+struct BlendState {
+  bool enabled = false;
+  GLenum srcColor = GL_ONE;
+  GLenum dstColor = GL_ZERO;
+  GLenum srcAlpha = GL_ONE;
+  GLenum dstAlpha = GL_ZERO;
+  GLenum colorEquation = GL_FUNC_ADD;
+  GLenum alphaEquation = GL_FUNC_ADD;
+
+  bool operator==(const BlendState&) const = default;
+
+  // non-premultiplied "over" blending, e.g. for awesomeface.png
+  static BlendState alphaBlend() {
+    return {true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_FUNC_ADD, GL_FUNC_ADD};
+  }
+};
+
+struct DepthStencilState {
+  bool depthTest = false;
+  bool depthWrite = true;
+  GLenum depthFunc = GL_LESS;
+  bool stencilTest = false;
+  GLenum stencilFunc = GL_ALWAYS;
+  GLint stencilRef = 0;
+  GLuint stencilReadMask = 0xFFFFFFFFu;
+  GLuint stencilWriteMask = 0xFFFFFFFFu;
+  GLenum stencilFail = GL_KEEP;
+  GLenum depthFail = GL_KEEP;
+  GLenum depthPass = GL_KEEP;
+
+  bool operator==(const DepthStencilState&) const = default;
+};
+
+struct RasterState {
+  bool cullFace = false;
+  GLenum cullMode = GL_BACK;
+  GLenum frontFace = GL_CCW;
+  GLenum polygonMode = GL_FILL;
+  bool scissorTest = false;
+
+  bool operator==(const RasterState&) const = default;
+};
+
+// everything a draw needs besides its resources and uniforms. The program is referenced
+// through its Shader so that a hot-reloaded program is picked up without recreating the state;
+// the vertex array carries the vertex layout.
+struct PipelineDesc {
+  const Shader* shader = nullptr;
+  GLuint vertexArray = 0;
+  BlendState blend;
+  DepthStencilState depthStencil;
+  RasterState raster;
+
+  bool operator==(const PipelineDesc&) const = default;
+};
+
+// immutable, interned pipeline state; compare by pointer
+struct PipelineState {
+  PipelineDesc desc;
+  std::uint64_t hash;
+  std::uint32_t id;
+};
+
+// field-wise hash (hashing the raw bytes would pick up padding)
+// ------------------------------------------------------------------------
+inline std::uint64_t hashPipelineDesc(const PipelineDesc& desc) {
+  std::uint64_t hash = hashCombine(kFnv1aOffset, reinterpret_cast<std::uintptr_t>(desc.shader));
+  auto mix = [&hash](std::initializer_list<std::uint64_t> fields) {
+    for (std::uint64_t field : fields) {
+      hash = hashCombine(hash, field);
+    }
+  };
+
+  const BlendState& b = desc.blend;
+  const DepthStencilState& d = desc.depthStencil;
+  const RasterState& r = desc.raster;
+  mix({desc.vertexArray});
+  mix({b.enabled, b.srcColor, b.dstColor, b.srcAlpha, b.dstAlpha, b.colorEquation, b.alphaEquation});
+  mix({d.depthTest, d.depthWrite, d.depthFunc, d.stencilTest, d.stencilFunc, static_cast<std::uint32_t>(d.stencilRef),
+       d.stencilReadMask, d.stencilWriteMask, d.stencilFail, d.depthFail, d.depthPass});
+  mix({r.cullFace, r.cullMode, r.frontFace, r.polygonMode, r.scissorTest});
+  return hash;
+}
+
+// Interns pipeline states: creating the same description twice returns the same object, so
+// renderers can compare and sort states by pointer or id.
+class PipelineCache {
+ public:
+  // ------------------------------------------------------------------------
+  const PipelineState* create(const PipelineDesc& desc) {
+    std::uint64_t hash = hashPipelineDesc(desc);
+    auto& bucket = buckets_[hash];
+    for (const PipelineState* state : bucket) {
+      if (state->desc == desc) {
+        return state;
+      }
+    }
+    const PipelineState& state = states_.emplace_back(
+        PipelineState{desc, hash, static_cast<std::uint32_t>(states_.size())});
+    bucket.push_back(&state);
+    return &state;
+  }
+
+  std::size_t size() const { return states_.size(); }
+
+ private:
+  std::deque<PipelineState> states_;  // stable addresses
+  std::unordered_map<std::uint64_t, std::vector<const PipelineState*>> buckets_;
+};
+
+// Applies pipeline states, issuing only the GL calls whose value differs from the state that
+// was applied last. Program, vertex array and enable bits go through the shared GlStateCache,
+// so binds made through the cache elsewhere are seen here too. Call invalidate() after code
+// that changes GL state behind the cache's back.
+class PipelineContext {
+ public:
+  // GL calls a full apply() issues; anything below that per apply is saved
+  static constexpr std::uint64_t kCallsPerApply = 17;
+
+  explicit PipelineContext(GlStateCache& glState) : glState_(glState) {}
+
+  // ------------------------------------------------------------------------
+  void apply(const PipelineState& state) {
+    GLuint program = state.desc.shader != nullptr ? state.desc.shader->shaderProgram : 0;
+    if (valid_ && &state == last_ && cacheAgrees(state.desc, program)) {
+      savedCalls_ += kCallsPerApply;
+      return;
+    }
+
+    const std::uint64_t issuedBefore = issuedCalls_;
+    const PipelineDesc& next = state.desc;
+    const bool force = !valid_;
+    const PipelineDesc& prev = current_;
+
+    issuedCalls_ += glState_.useProgram(program);
+    issuedCalls_ += glState_.bindVertexArray(next.vertexArray);
+
+    // blend
+    issuedCalls_ += glState_.setEnabled(GL_BLEND, next.blend.enabled);
+    if (force || next.blend.srcColor != prev.blend.srcColor || next.blend.dstColor != prev.blend.dstColor ||
+        next.blend.srcAlpha != prev.blend.srcAlpha || next.blend.dstAlpha != prev.blend.dstAlpha) {
+      glBlendFuncSeparate(next.blend.srcColor, next.blend.dstColor, next.blend.srcAlpha, next.blend.dstAlpha);
+      ++issuedCalls_;
+    }
+    if (force || next.blend.colorEquation != prev.blend.colorEquation ||
+        next.blend.alphaEquation != prev.blend.alphaEquation) {
+      glBlendEquationSeparate(next.blend.colorEquation, next.blend.alphaEquation);
+      ++issuedCalls_;
+    }
+
+    // depth / stencil
+    const DepthStencilState& ds = next.depthStencil;
+    const DepthStencilState& pds = prev.depthStencil;
+    issuedCalls_ += glState_.setEnabled(GL_DEPTH_TEST, ds.depthTest);
+    if (force || ds.depthWrite != pds.depthWrite) {
+      glDepthMask(ds.depthWrite ? GL_TRUE : GL_FALSE);
+      ++issuedCalls_;
+    }
+    if (force || ds.depthFunc != pds.depthFunc) {
+      glDepthFunc(ds.depthFunc);
+      ++issuedCalls_;
+    }
+    issuedCalls_ += glState_.setEnabled(GL_STENCIL_TEST, ds.stencilTest);
+    if (force || ds.stencilFunc != pds.stencilFunc || ds.stencilRef != pds.stencilRef ||
+        ds.stencilReadMask != pds.stencilReadMask) {
+      glStencilFunc(ds.stencilFunc, ds.stencilRef, ds.stencilReadMask);
+      ++issuedCalls_;
+    }
+    if (force || ds.stencilWriteMask != pds.stencilWriteMask) {
+      glStencilMask(ds.stencilWriteMask);
+      ++issuedCalls_;
+    }
+    if (force || ds.stencilFail != pds.stencilFail || ds.depthFail != pds.depthFail || ds.depthPass != pds.depthPass) {
+      glStencilOp(ds.stencilFail, ds.depthFail, ds.depthPass);
+      ++issuedCalls_;
+    }
+
+    // raster
+    const RasterState& rs = next.raster;
+    const RasterState& prs = prev.raster;
+    issuedCalls_ += glState_.setEnabled(GL_CULL_FACE, rs.cullFace);
+    if (force || rs.cullMode != prs.cullMode) {
+      glCullFace(rs.cullMode);
+      ++issuedCalls_;
+    }
+    if (force || rs.frontFace != prs.frontFace) {
+      glFrontFace(rs.frontFace);
+      ++issuedCalls_;
+    }
+    if (force || rs.polygonMode != prs.polygonMode) {
+      glPolygonMode(GL_FRONT_AND_BACK, rs.polygonMode);
+      ++issuedCalls_;
+    }
+    issuedCalls_ += glState_.setEnabled(GL_SCISSOR_TEST, rs.scissorTest);
+
+    savedCalls_ += kCallsPerApply - (issuedCalls_ - issuedBefore);
+    current_ = next;
+    last_ = &state;
+    valid_ = true;
+  }
+
+  // forget the shadowed state, including the GlStateCache's; the next apply() issues every call
+  void invalidate() {
+    valid_ = false;
+    glState_.invalidate();
+  }
+
+  std::uint64_t issuedCalls() const { return issuedCalls_; }
+  std::uint64_t savedCalls() const { return savedCalls_; }
+
+ private:
+  GlStateCache& glState_;
+  PipelineDesc current_;
+  const PipelineState* last_ = nullptr;
+  bool valid_ = false;
+  std::uint64_t issuedCalls_ = 0;
+  std::uint64_t savedCalls_ = 0;
+
+  // the state kept in the GlStateCache can be changed by anyone using the cache (e.g.
+  // MeshPool::defragment() unbinding its vertex array), so reapplying the last state may
+  // only be skipped while the cache still holds all of it
+  bool cacheAgrees(const PipelineDesc& desc, GLuint program) const {
+    return glState_.programIs(program) && glState_.vertexArrayIs(desc.vertexArray) &&
+           glState_.enabledIs(GL_BLEND, desc.blend.enabled) &&
+           glState_.enabledIs(GL_DEPTH_TEST, desc.depthStencil.depthTest) &&
+           glState_.enabledIs(GL_STENCIL_TEST, desc.depthStencil.stencilTest) &&
+           glState_.enabledIs(GL_CULL_FACE, desc.raster.cullFace) &&
+           glState_.enabledIs(GL_SCISSOR_TEST, desc.raster.scissorTest);
+  }
+};
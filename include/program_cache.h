@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "hash.h"
+#include "logger.h"
+
+namespace fs = std::filesystem;
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+//
+// Entries are keyed by a hash of the shader sources, the injected defines and the
+// GL_RENDERER / GL_VERSION strings, so a driver or GPU change simply misses. A binary
+// the driver refuses to load is counted as rejected, removed from disk and treated as
+// a miss so the caller falls back to compiling from source.
+//
+// Must be constructed while a GL context is current.
+class ProgramBinaryCache {
+ public:
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t rejected = 0;
+    std::uint64_t stored = 0;
+  };
+
+  ProgramBinaryCache(fs::path directory, quill::Logger* logger) : directory_(std::move(directory)), logger_(logger) {
+    GLint formats = 0;
+    if (GLAD_GL_ARB_get_program_binary) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    supported_ = formats > 0;
+    if (!supported_) {
+      LOG_INFO(logger_, "program binary cache disabled: driver exposes no program binary formats");
+      return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    if (ec) {
+      LOG_ERROR(logger_, "program binary cache disabled: cannot create {}, error: {}", directory_.string(),
+                ec.message());
+      supported_ = false;
+      return;
+    }
+
+    auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    auto version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    driverHash_ = hashCombine(fnv1a64(renderer ? renderer : ""), fnv1a64(version ? version : ""));
+  }
+
+  bool supported() const { return supported_; }
+  const Stats& stats() const { return stats_; }
+
+  // key for one program; defines are whatever text was injected ahead of the sources
+  // ------------------------------------------------------------------------
+  std::uint64_t key(std::string_view vertexSource, std::string_view fragmentSource,
+                    std::string_view defines = {}) const {
+    std::uint64_t hash = hashCombine(driverHash_, fnv1a64(vertexSource));
+    hash = hashCombine(hash, fnv1a64(fragmentSource));
+    return hashCombine(hash, fnv1a64(defines));
+  }
+
+  // must be called before glLinkProgram for the binary to be retrievable afterwards
+  // ------------------------------------------------------------------------
+  void prepare(GLuint program) const {
+    if (supported_) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+  }
+
+  // returns a linked program, or 0 on a miss / rejected binary
+  // ------------------------------------------------------------------------
+  GLuint load(std::uint64_t key) {
+    if (!supported_) {
+      return 0;
+    }
+
+    std::ifstream file(entryPath(key), std::ios::binary);
+    Header header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kMagic ||
+        header.key != key) {
+      ++stats_.misses;
+      return 0;
+    }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+      ++stats_.misses;
+      return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+      glDeleteProgram(program);
+      file.close();
+      std::error_code ec;
+      fs::remove(entryPath(key), ec);
+      ++stats_.rejected;
+      ++stats_.misses;
+      return 0;
+    }
+
+    ++stats_.hits;
+    return program;
+  }
+
+  // ------------------------------------------------------------------------
+  void store(std::uint64_t key, GLuint program) {
+    if (!supported_) {
+      return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+      return;
+    }
+    std::vector<char> binary(static_cast<std::size_t>(length));
+    Header header{kMagic, 0, key, 0};
+    glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+    header.length = static_cast<std::uint32_t>(length);
+
+    std::ofstream file(entryPath(key), std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !file.write(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+      LOG_ERROR(logger_, "program binary cache: failed to write {}", entryPath(key).string());
+      return;
+    }
+    ++stats_.stored;
+  }
+
+  // ------------------------------------------------------------------------
+  void logStats() const {
+    LOG_INFO(logger_, "program binary cache: {} hits, {} misses ({} rejected), {} stored", stats_.hits,
+             stats_.misses, stats_.rejected, stats_.stored);
+  }
+
+ private:
+  static constexpr std::uint32_t kMagic = 0x4243474c;  // "LGCB"
+
+  struct Header {
+    std::uint32_t magic;
+    GLenum format;
+    std::uint64_t key;
+    std::uint32_t length;
+  };
+
+  fs::path directory_;
+  quill::Logger* logger_;
+  bool supported_ = false;
+  std::uint64_t driverHash_ = 0;
+  Stats stats_;
+
+  fs::path entryPath(std::uint64_t key) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory_ / name;
+  }
+};
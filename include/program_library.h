@@ -0,0 +1,277 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "gl_resource.h"
+#include "logger.h"
+#include "program_cache.h"
+#include "shader.h"
+#include "shader_preprocessor.h"
+#include "shader_stats.h"
+
+// Non-blocking program creation.
+//
+// submit() issues every glCompileShader / glLinkProgram call immediately and never queries
+// a status, so the driver can overlap the work with whatever the application does next
+// (texture loading, buffer setup). With GL_KHR_parallel_shader_compile or
+// GL_ARB_parallel_shader_compile the driver's worker threads are enabled and poll() only
+// finalizes programs whose GL_COMPLETION_STATUS is true; without the extension the first
+// status query in poll() is where the driver blocks.
+//
+// With a ShaderBuildReport every program is recorded when it is finalized: compileMs and linkMs
+// are the time spent issuing the calls plus the link status query in poll(), which is where a
+// driver without parallel compilation does the work; completionMs is the time from submit()
+// until poll() first saw the program done, so it depends on how often poll() is called.
+//
+// Programs are owned through GlProgram handles of the registry: a failed link, a hot reload
+// and the library's destruction release them, and the registry deletes them once the GPU is
+// done with them. Declare the library after the registry.
+class ProgramLibrary {
+ public:
+  using ProgramId = std::size_t;
+
+  // overrideDirectory: see loadShaderSource(); empty means embedded sources only
+  ProgramLibrary(GlResourceRegistry& resources, quill::Logger* logger, ProgramBinaryCache* cache = nullptr,
+                 fs::path overrideDirectory = {}, ShaderBuildReport* report = nullptr)
+      : resources_(resources),
+        logger_(logger),
+        cache_(cache),
+        report_(report),
+        preprocessor_(std::move(overrideDirectory)) {
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);  // let the driver pick the thread count
+      parallel_ = true;
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+      parallel_ = true;
+    }
+  }
+
+  ProgramLibrary(const ProgramLibrary&) = delete;
+  ProgramLibrary& operator=(const ProgramLibrary&) = delete;
+
+  // the programs themselves are released by their GlProgram, pending or adopted by a Shader
+  ~ProgramLibrary() {
+    for (auto& entry : entries_) {
+      if (entry.state == State::Pending) {
+        // programs that never reached poll() still own their stage objects
+        releaseStages(entry);
+      }
+    }
+  }
+
+  // true when the driver compiles on its own threads
+  bool parallel() const { return parallel_; }
+
+  // queue compile + link of one program; returns immediately
+  // ------------------------------------------------------------------------
+  ProgramId submit(std::string name, const std::string& vertexSource, const std::string& fragmentSource) {
+    Entry& entry = entries_.emplace_back();
+    entry.name = std::move(name);
+    entry.submitted = std::chrono::steady_clock::now();
+    entry.record.sourceBytes = vertexSource.size() + fragmentSource.size();
+
+    if (cache_ != nullptr) {
+      entry.key = cache_->key(vertexSource, fragmentSource);
+      if (GLuint program = cache_->load(entry.key); program != 0) {
+        entry.program = GlProgram(resources_, program);
+        entry.fromCache = true;
+        entry.record.queueMs = entry.record.linkMs = elapsedMs(entry.submitted);
+        ++pending_;
+        return entries_.size() - 1;
+      }
+    }
+
+    const char* vShaderCode = vertexSource.c_str();
+    const char* fShaderCode = fragmentSource.c_str();
+
+    entry.vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(entry.vertex, 1, &vShaderCode, nullptr);
+    glCompileShader(entry.vertex);
+
+    entry.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(entry.fragment, 1, &fShaderCode, nullptr);
+    glCompileShader(entry.fragment);
+    entry.record.compileMs = elapsedMs(entry.submitted);
+
+    // linking straight away is legal: the driver waits for the compiles internally
+    entry.program = GlProgram::generate(resources_);
+    const GLuint program = entry.program.get();
+    glAttachShader(program, entry.vertex);
+    glAttachShader(program, entry.fragment);
+    if (cache_ != nullptr) {
+      cache_->prepare(program);
+    }
+    glLinkProgram(program);
+
+    entry.record.queueMs = elapsedMs(entry.submitted);
+    entry.record.linkMs = entry.record.queueMs - entry.record.compileMs;
+    ++pending_;
+    return entries_.size() - 1;
+  }
+
+  // preprocess both files (with an optional permutation) and submit; returns an id that
+  // resolves to a failed program if either file cannot be loaded
+  // ------------------------------------------------------------------------
+  ProgramId submitFiles(std::string name, const char* vertexPath, const char* fragmentPath,
+                        const ShaderDefines& defines = {}) {
+    PreprocessedSource vertexSource;
+    PreprocessedSource fragmentSource;
+    if (!preprocessShaderFile(preprocessor_, vertexPath, defines, vertexSource, logger_) ||
+        !preprocessShaderFile(preprocessor_, fragmentPath, defines, fragmentSource, logger_)) {
+      Entry& entry = entries_.emplace_back();
+      entry.name = std::move(name);
+      entry.state = State::Failed;
+      addRecord(entry);
+      return entries_.size() - 1;
+    }
+    return submit(std::move(name), vertexSource.code, fragmentSource.code);
+  }
+
+  // finalize programs whose compilation is complete; onReady(id, shader) is called for each
+  // program that linked successfully. Returns the number of programs finalized this call.
+  // ------------------------------------------------------------------------
+  template <typename OnReady>
+  std::size_t poll(OnReady&& onReady) {
+    std::size_t finalized = 0;
+    for (std::size_t id = 0; id < entries_.size() && pending_ > 0; ++id) {
+      Entry& entry = entries_[id];
+      if (entry.state != State::Pending || !isComplete(entry)) {
+        continue;
+      }
+      finalize(entry);
+      --pending_;
+      ++finalized;
+      if (entry.state == State::Ready) {
+        onReady(id, *entry.shader);
+      }
+    }
+    return finalized;
+  }
+
+  std::size_t poll() {
+    return poll([](ProgramId, Shader&) {});
+  }
+
+  // block until every submitted program is finalized
+  // ------------------------------------------------------------------------
+  void finish() {
+    while (pending_ > 0) {
+      poll();
+    }
+  }
+
+  std::size_t pending() const { return pending_; }
+  bool ready(ProgramId id) const { return entries_[id].state == State::Ready; }
+  bool failed(ProgramId id) const { return entries_[id].state == State::Failed; }
+  const std::string& name(ProgramId id) const { return entries_[id].name; }
+
+  // nullptr until the program is ready (or if it failed)
+  Shader* get(ProgramId id) { return entries_[id].shader ? &*entries_[id].shader : nullptr; }
+
+ private:
+  enum class State { Pending, Ready, Failed };
+
+  struct Entry {
+    std::string name;
+    State state = State::Pending;
+    GLuint vertex = 0;
+    GLuint fragment = 0;
+    GlProgram program;  // moved into shader once linked
+    std::uint64_t key = 0;
+    bool fromCache = false;
+    std::chrono::steady_clock::time_point submitted;
+    ProgramBuildRecord record;
+    std::optional<Shader> shader;
+  };
+
+  GlResourceRegistry& resources_;
+  quill::Logger* logger_;
+  ProgramBinaryCache* cache_;
+  ShaderBuildReport* report_;
+  ShaderPreprocessor preprocessor_;  // shared so common includes are read once
+  bool parallel_ = false;
+  std::size_t pending_ = 0;
+  std::deque<Entry> entries_;  // deque so that Shader pointers stay valid across submits
+
+  bool isComplete(const Entry& entry) const {
+    if (!parallel_ || entry.fromCache) {
+      return true;
+    }
+    GLint complete = GL_FALSE;
+    glGetProgramiv(entry.program.get(), GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != GL_FALSE;
+  }
+
+  void finalize(Entry& entry) {
+    bool linked = true;
+    if (!entry.fromCache) {
+      const auto queryStart = std::chrono::steady_clock::now();
+      linked = Shader::checkCompileErrors(entry.program.get(), "PROGRAM", logger_);
+      entry.record.linkMs += elapsedMs(queryStart);
+    }
+    // the driver is done; logs, the cache store and reflection below are not build time
+    entry.record.completionMs = elapsedMs(entry.submitted);
+    if (!entry.fromCache) {
+      // stage logs are read for errors when the link failed, otherwise only for warnings
+      if (!linked) {
+        Shader::checkCompileErrors(entry.vertex, "VERTEX", logger_);
+        Shader::checkCompileErrors(entry.fragment, "FRAGMENT", logger_);
+      } else if (report_ != nullptr) {
+        Shader::collectWarnings(entry.vertex, "VERTEX", entry.record.warnings);
+        Shader::collectWarnings(entry.fragment, "FRAGMENT", entry.record.warnings);
+        Shader::collectWarnings(entry.program.get(), "PROGRAM", entry.record.warnings);
+      }
+      releaseStages(entry);
+    }
+
+    if (!linked) {
+      LOG_ERROR(logger_, "program {} failed to link", entry.name);
+      entry.program.reset();
+      entry.state = State::Failed;
+      addRecord(entry);
+      return;
+    }
+
+    if (cache_ != nullptr && !entry.fromCache) {
+      cache_->store(entry.key, entry.program.get());
+    }
+    entry.shader.emplace(std::move(entry.program), logger_);
+    entry.state = State::Ready;
+    addRecord(entry);
+  }
+
+  void addRecord(Entry& entry) {
+    if (report_ == nullptr) {
+      return;
+    }
+    ProgramBuildRecord& record = entry.record;
+    record.name = entry.name;
+    record.fromCache = entry.fromCache;
+    record.asynchronous = true;
+    record.success = entry.state == State::Ready;
+    report_->add(record);
+  }
+
+  static void releaseStages(Entry& entry) {
+    if (entry.vertex != 0) {
+      glDetachShader(entry.program.get(), entry.vertex);
+      glDeleteShader(entry.vertex);
+      entry.vertex = 0;
+    }
+    if (entry.fragment != 0) {
+      glDetachShader(entry.program.get(), entry.fragment);
+      glDeleteShader(entry.fragment);
+      entry.fragment = 0;
+    }
+  }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ecs.h"
+#include "frustum_culling.h"
+#include "indirect_batch.h"
+#include "mesh_pool.h"
+#include "occlusion_culling.h"
+#include "render_queue.h"
+#include "simd_math.h"
+#include "thread_pool.h"
+
+// Components of things that are drawn, and the systems that scan them.
+
+struct WorldTransform {
+  math::mat4 matrix;
+};
+
+// bounding sphere in model space
+struct LocalBounds {
+  math::vec3 center;
+  float radius = 0.0f;
+};
+
+// bounding sphere in world space, kept up to date by updateBounds()
+struct Bounds {
+  math::vec3 center;
+  float radius = 0.0f;
+};
+
+struct Renderable {
+  DrawItem draw;
+  unsigned pass = 0;
+};
+
+// drawn through an IndirectBatcher instead of the RenderQueue
+struct BatchedMesh {
+  const PipelineState* pipeline = nullptr;
+  MeshRange mesh;
+};
+
+// Bounds = LocalBounds moved by WorldTransform, with the radius grown by the largest axis scale
+// ------------------------------------------------------------------------
+inline void updateBounds(EcsWorld& world, ThreadPool& pool) {
+  world.parallelForChunks<const WorldTransform, const LocalBounds, Bounds>(
+      pool, [](std::size_t, std::span<const Entity>, std::span<const WorldTransform> transforms,
+               std::span<const LocalBounds> locals, std::span<Bounds> bounds) {
+        for (std::size_t i = 0; i < bounds.size(); ++i) {
+          const math::mat4& m = transforms[i].matrix;
+          const float scale2 =
+              std::max({math::dot(m[0].xyz(), m[0].xyz()), math::dot(m[1].xyz(), m[1].xyz()),
+                        math::dot(m[2].xyz(), m[2].xyz())});
+          bounds[i].center = math::transformPoint(m, locals[i].center);
+          bounds[i].radius = locals[i].radius * std::sqrt(scale2);
+        }
+      });
+}
+
+// submit every entity with a Renderable, Bounds and WorldTransform whose bounds intersect the
+// view frustum and, given an OcclusionBuffer rasterized for this view, are not hidden behind its
+// occluders; draws are keyed by the depth of the bounds' center in [0, 1] after viewProjection.
+// Given models, the WorldTransform of each submitted draw is appended to it and the draw's
+// userData set to its index, for the per-draw uniforms of RenderQueue::execute()'s onDraw.
+// Returns the number of entities culled.
+// ------------------------------------------------------------------------
+inline std::size_t submitRenderables(EcsWorld& world, RenderQueue& queue, const math::mat4& viewProjection,
+                                     const OcclusionBuffer* occlusion = nullptr,
+                                     std::vector<math::mat4>* models = nullptr) {
+  const Frustum frustum = Frustum::fromMatrix(viewProjection);
+  std::size_t culled = 0;
+  world.forEachChunk<const Renderable, const Bounds, const WorldTransform>(
+      [&](std::span<const Entity>, std::span<const Renderable> renderables, std::span<const Bounds> bounds,
+          std::span<const WorldTransform> transforms) {
+        for (std::size_t i = 0; i < renderables.size(); ++i) {
+          const math::vec3& center = bounds[i].center;
+          const math::vec3 extents(bounds[i].radius);
+          if (!frustum.intersectsSphere(center, bounds[i].radius) ||
+              (occlusion != nullptr && !occlusion->isVisible({center - extents, center + extents}, viewProjection))) {
+            ++culled;
+            continue;
+          }
+          const math::vec4 clip = viewProjection * math::vec4(center, 1.0f);
+          const float depth01 = clip.w != 0.0f ? clip.z / clip.w * 0.5f + 0.5f : 0.0f;
+          DrawItem draw = renderables[i].draw;
+          if (models != nullptr) {
+            draw.userData = static_cast<std::uint32_t>(models->size());
+            models->push_back(transforms[i].matrix);
+          }
+          queue.submit(renderables[i].pass, draw, depth01);
+        }
+      });
+  return culled;
+}
+
+// add every entity with a BatchedMesh, Bounds and WorldTransform whose bounds intersect the view
+// frustum to batcher, and store its WorldTransform at models[draw id] for the shader's per-draw
+// block; models grows as needed and must be cleared together with the batcher's flush().
+// Returns the number of entities culled.
+// ------------------------------------------------------------------------
+inline std::size_t submitBatched(EcsWorld& world, IndirectBatcher& batcher, const math::mat4& viewProjection,
+                                 std::vector<math::mat4>& models) {
+  const Frustum frustum = Frustum::fromMatrix(viewProjection);
+  std::size_t culled = 0;
+  world.forEachChunk<const BatchedMesh, const Bounds, const WorldTransform>(
+      [&](std::span<const Entity>, std::span<const BatchedMesh> meshes, std::span<const Bounds> bounds,
+          std::span<const WorldTransform> transforms) {
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+          if (!frustum.intersectsSphere(bounds[i].center, bounds[i].radius)) {
+            ++culled;
+            continue;
+          }
+          const std::uint32_t id = batcher.add(*meshes[i].pipeline, meshes[i].mesh);
+          if (id == IndirectBatcher::kNoDraw) {
+            continue;
+          }
+          if (id >= models.size()) {
+            models.resize(id + 1);
+          }
+          models[id] = transforms[i].matrix;
+        }
+      });
+  return culled;
+}
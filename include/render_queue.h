@@ -0,0 +1,205 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "gl_state.h"
+#include "pipeline_state.h"
+
+// Sort key layout, most significant bits first. Sorting the keys ascending groups draws by
+// pass, puts opaque before translucent geometry, and then minimizes state changes:
+//
+//   opaque:      pass:4 | 0 | program:11 | pipeline:12 | textures:12 | depth:24
+//   translucent: pass:4 | 1 | ~depth:24  | program:11 | pipeline:12 | textures:12
+//
+// Opaque draws sort by state and then front to back (early depth rejection); translucent
+// draws sort back to front, which blending requires, and by state only among equal depths.
+// The vertex array is part of the pipeline (see PipelineDesc). Program names, pipeline ids and
+// texture set ids are truncated to their field width: a collision only costs sort quality.
+namespace render_key {
+constexpr unsigned kPassBits = 4;
+constexpr unsigned kProgramBits = 11;
+constexpr unsigned kPipelineBits = 12;
+constexpr unsigned kTextureBits = 12;
+constexpr unsigned kDepthBits = 24;
+
+constexpr std::uint64_t field(std::uint64_t value, unsigned bits, unsigned shift) {
+  return (value & ((std::uint64_t{1} << bits) - 1)) << shift;
+}
+
+// depth01: view depth normalized to [0, 1], e.g. distance / far plane
+constexpr std::uint64_t quantizeDepth(float depth01) {
+  const float clamped = depth01 < 0.0f ? 0.0f : (depth01 > 1.0f ? 1.0f : depth01);
+  return static_cast<std::uint64_t>(clamped * static_cast<float>((1u << kDepthBits) - 1));
+}
+
+// ------------------------------------------------------------------------
+constexpr std::uint64_t make(unsigned pass, bool translucent, std::uint32_t program, std::uint32_t pipeline,
+                             std::uint32_t textureSet, float depth01) {
+  const std::uint64_t depth = quantizeDepth(depth01);
+  std::uint64_t key = field(pass, kPassBits, 60) | field(translucent ? 1 : 0, 1, 59);
+  if (!translucent) {
+    return key | field(program, kProgramBits, 48) | field(pipeline, kPipelineBits, 36) |
+           field(textureSet, kTextureBits, 24) | field(depth, kDepthBits, 0);
+  }
+  const std::uint64_t farFirst = ((std::uint64_t{1} << kDepthBits) - 1) - depth;
+  return key | field(farFirst, kDepthBits, 35) | field(program, kProgramBits, 24) |
+         field(pipeline, kPipelineBits, 12) | field(textureSet, kTextureBits, 0);
+}
+}  // namespace render_key
+
+// a sort key and the index of the draw it belongs to
+struct RenderSortItem {
+  std::uint64_t key;
+  std::uint32_t index;
+};
+
+// Stable LSD radix sort by key, 8 bits per pass; passes where every key has the same byte are
+// skipped. scratch must be at least as large as items.
+// ------------------------------------------------------------------------
+inline void radixSort(std::span<RenderSortItem> items, std::span<RenderSortItem> scratch) {
+  const std::size_t size = items.size();
+  std::array<std::array<std::uint32_t, 256>, 8> histograms{};
+  for (const RenderSortItem& item : items) {
+    for (unsigned byte = 0; byte < 8; ++byte) {
+      ++histograms[byte][(item.key >> (byte * 8)) & 0xFF];
+    }
+  }
+
+  RenderSortItem* source = items.data();
+  RenderSortItem* target = scratch.data();
+  for (unsigned byte = 0; byte < 8; ++byte) {
+    auto& histogram = histograms[byte];
+    if (std::find(histogram.begin(), histogram.end(), size) != histogram.end()) {
+      continue;  // every key has the same byte here
+    }
+    std::uint32_t offset = 0;
+    for (auto& count : histogram) {
+      std::uint32_t bucketSize = count;
+      count = offset;
+      offset += bucketSize;
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+      target[histogram[(source[i].key >> (byte * 8)) & 0xFF]++] = source[i];
+    }
+    std::swap(source, target);
+  }
+  if (source != items.data()) {
+    std::copy(source, source + size, items.data());
+  }
+}
+
+// textures bound to units 0..count-1 for a draw, registered once with RenderQueue::addTextureSet
+struct TextureSet {
+  static constexpr std::size_t kMaxTextures = 4;
+
+  std::array<GLuint, kMaxTextures> textures{};
+  GLenum target = GL_TEXTURE_2D;
+  std::size_t count = 0;
+};
+
+// one draw; indexType 0 means glDrawArrays starting at first
+struct DrawItem {
+  const PipelineState* pipeline = nullptr;
+  std::uint16_t textureSet = 0;
+  GLenum mode = GL_TRIANGLES;
+  GLsizei count = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  std::size_t offset = 0;  // byte offset into the element buffer
+  GLint baseVertex = 0;    // added to every index, e.g. MeshRange::baseVertex
+  GLint first = 0;
+  GLsizei instances = 1;
+  std::uint32_t userData = 0;  // e.g. an index into the caller's per-draw data
+};
+
+// Per-frame draw list.
+//
+// submit() stores the draw and its key into arrays sized once at construction, so submitting
+// never allocates; a full queue drops the draw and reports it. execute() radix-sorts the
+// (key, index) pairs and issues the draws in key order through the PipelineContext and
+// GlStateCache.
+class RenderQueue {
+ public:
+  explicit RenderQueue(std::size_t capacity) : items_(capacity), keys_(capacity), scratch_(capacity) {
+    textureSets_.emplace_back();  // id 0: no textures
+  }
+
+  // at setup time; returns the id to pass to submit()
+  // ------------------------------------------------------------------------
+  std::uint16_t addTextureSet(std::initializer_list<GLuint> textures, GLenum target = GL_TEXTURE_2D) {
+    TextureSet& set = textureSets_.emplace_back();
+    set.target = target;
+    for (GLuint texture : textures) {
+      if (set.count < TextureSet::kMaxTextures) {
+        set.textures[set.count++] = texture;
+      }
+    }
+    return static_cast<std::uint16_t>(textureSets_.size() - 1);
+  }
+
+  // ------------------------------------------------------------------------
+  bool submit(unsigned pass, const DrawItem& item, float depth01) {
+    if (size_ == items_.size()) {
+      ++dropped_;
+      return false;
+    }
+    const PipelineDesc& desc = item.pipeline->desc;
+    const bool translucent = desc.blend.enabled;
+    const GLuint program = desc.shader != nullptr ? desc.shader->shaderProgram : 0;
+    items_[size_] = item;
+    keys_[size_] = {render_key::make(pass, translucent, program, item.pipeline->id, item.textureSet, depth01),
+                    static_cast<std::uint32_t>(size_)};
+    ++size_;
+    return true;
+  }
+
+  // sort, then draw everything submitted since the last execute(); onDraw(item) runs right
+  // before each draw call, with the item's pipeline and textures already bound
+  // ------------------------------------------------------------------------
+  template <typename OnDraw>
+  void execute(PipelineContext& context, GlStateCache& glState, OnDraw&& onDraw) {
+    radixSort(std::span(keys_.data(), size_), scratch_);
+    for (std::size_t i = 0; i < size_; ++i) {
+      const DrawItem& item = items_[keys_[i].index];
+      context.apply(*item.pipeline);
+      const TextureSet& set = textureSets_[item.textureSet];
+      for (std::size_t unit = 0; unit < set.count; ++unit) {
+        glState.bindTexture(static_cast<GLuint>(unit), set.target, set.textures[unit]);
+      }
+      onDraw(item);
+      if (item.indexType == 0) {
+        glDrawArraysInstanced(item.mode, item.first, item.count, item.instances);
+      } else {
+        glDrawElementsInstancedBaseVertex(item.mode, item.count, item.indexType,
+                                          reinterpret_cast<const void*>(item.offset), item.instances,
+                                          item.baseVertex);
+      }
+    }
+    size_ = 0;
+  }
+
+  void execute(PipelineContext& context, GlStateCache& glState) {
+    execute(context, glState, [](const DrawItem&) {});
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return items_.size(); }
+  // draws rejected because the queue was full, since construction
+  std::uint64_t dropped() const { return dropped_; }
+
+ private:
+  std::vector<DrawItem> items_;
+  std::vector<RenderSortItem> keys_;
+  std::vector<RenderSortItem> scratch_;
+  std::vector<TextureSet> textureSets_;
+  std::size_t size_ = 0;
+  std::uint64_t dropped_ = 0;
+};
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "simd_math.h"
+#include "thread_pool.h"
+
+// node id plus the generation of the id it was issued for
+struct SceneNode {
+  static constexpr std::uint32_t kInvalid = 0xFFFFFFFFu;
+  std::uint32_t id = kInvalid;
+  std::uint32_t generation = 0;
+
+  bool valid() const { return id != kInvalid; }
+};
+
+// Transform hierarchy for large scenes.
+//
+// Local transforms (translation, rotation, scale) live in structure-of-arrays form, ordered by
+// hierarchy depth so that every parent comes before its children and each depth is one
+// contiguous range. Setting a local transform marks the node dirty; update() walks the depths
+// in order and recomputes the world matrix of a node only when it or one of its ancestors
+// changed, spreading every depth over the ThreadPool in chunks (nodes of one depth only read
+// the depth above, so a depth needs no synchronization beyond the barrier parallelFor has).
+//
+// SceneNode ids are stable; the storage order is not. add() and remove() only record the
+// change, the order is rebuilt by the next update(). remove() takes the whole subtree with it.
+// An id is reused once update() has dropped its node, with its generation bumped, so a handle
+// kept past remove() is no longer contained: setters ignore it and getters return defaults.
+class SceneGraph {
+ public:
+  static constexpr std::size_t kChunk = 1024;  // nodes per parallel task
+
+  // ------------------------------------------------------------------------
+  explicit SceneGraph(std::size_t reserve = 0) {
+    for (auto* stream : floatStreams()) {
+      stream->reserve(reserve);
+    }
+    parent_.reserve(reserve);
+    depth_.reserve(reserve);
+    ids_.reserve(reserve);
+    flags_.reserve(reserve);
+    world_.reserve(reserve);
+    positions_.reserve(reserve);
+    generations_.reserve(reserve);
+  }
+
+  SceneGraph(const SceneGraph&) = delete;
+  SceneGraph& operator=(const SceneGraph&) = delete;
+
+  // an invalid or removed parent makes the node a root
+  // ------------------------------------------------------------------------
+  SceneNode add(SceneNode parent = {}, const math::vec3& translation = {}, const math::quat& rotation = {},
+                const math::vec3& scale = math::vec3(1.0f)) {
+    SceneNode node;
+    if (!freeIds_.empty()) {
+      node.id = freeIds_.back();
+      freeIds_.pop_back();
+    } else {
+      node.id = static_cast<std::uint32_t>(positions_.size());
+      positions_.push_back(kNone);
+      generations_.push_back(1);  // never 0, so a default SceneNode is never contained
+    }
+    node.generation = generations_[node.id];
+    const auto position = static_cast<std::uint32_t>(ids_.size());
+    positions_[node.id] = position;
+
+    const std::uint32_t parentPosition = contains(parent) ? positions_[parent.id] : kNone;
+    parent_.push_back(parentPosition);
+    depth_.push_back(parentPosition == kNone ? 0 : depth_[parentPosition] + 1);
+    ids_.push_back(node.id);
+    flags_.push_back(kLocalDirty);
+    world_.emplace_back();
+    for (auto* stream : floatStreams()) {
+      stream->push_back(0.0f);
+    }
+    writeLocal(position, translation, rotation, scale);
+    orderDirty_ = true;
+    ++dirty_;
+    return node;
+  }
+
+  // removes the node and, with the next update(), all of its descendants
+  // ------------------------------------------------------------------------
+  void remove(SceneNode node) {
+    if (!contains(node)) {
+      return;
+    }
+    flags_[positions_[node.id]] |= kRemoved;
+    orderDirty_ = true;
+  }
+
+  bool contains(SceneNode node) const {
+    return node.id < positions_.size() && generations_[node.id] == node.generation && positions_[node.id] != kNone &&
+           (flags_[positions_[node.id]] & kRemoved) == 0;
+  }
+
+  std::size_t size() const { return ids_.size(); }
+  std::size_t depthCount() const { return levels_.empty() ? 0 : levels_.size() - 1; }
+
+  // ------------------------------------------------------------------------
+  void setLocal(SceneNode node, const math::vec3& translation, const math::quat& rotation, const math::vec3& scale) {
+    if (const std::uint32_t p = markDirty(node); p != kNone) {
+      writeLocal(p, translation, rotation, scale);
+    }
+  }
+
+  void setTranslation(SceneNode node, const math::vec3& translation) {
+    const std::uint32_t p = markDirty(node);
+    if (p == kNone) {
+      return;
+    }
+    tx_[p] = translation.x;
+    ty_[p] = translation.y;
+    tz_[p] = translation.z;
+  }
+
+  void setRotation(SceneNode node, const math::quat& rotation) {
+    const std::uint32_t p = markDirty(node);
+    if (p == kNone) {
+      return;
+    }
+    rx_[p] = rotation.x;
+    ry_[p] = rotation.y;
+    rz_[p] = rotation.z;
+    rw_[p] = rotation.w;
+  }
+
+  void setScale(SceneNode node, const math::vec3& scale) {
+    const std::uint32_t p = markDirty(node);
+    if (p == kNone) {
+      return;
+    }
+    sx_[p] = scale.x;
+    sy_[p] = scale.y;
+    sz_[p] = scale.z;
+  }
+
+  // the getters return the defaults of add() for a node that is not contained
+  // ------------------------------------------------------------------------
+  math::vec3 translation(SceneNode node) const {
+    if (!contains(node)) {
+      return {};
+    }
+    const std::uint32_t p = positions_[node.id];
+    return {tx_[p], ty_[p], tz_[p]};
+  }
+
+  math::quat rotation(SceneNode node) const {
+    if (!contains(node)) {
+      return {};
+    }
+    const std::uint32_t p = positions_[node.id];
+    return {rx_[p], ry_[p], rz_[p], rw_[p]};
+  }
+
+  math::vec3 scale(SceneNode node) const {
+    if (!contains(node)) {
+      return math::vec3(1.0f);
+    }
+    const std::uint32_t p = positions_[node.id];
+    return {sx_[p], sy_[p], sz_[p]};
+  }
+
+  // as of the last update(); the identity for a node that is not contained
+  const math::mat4& world(SceneNode node) const { return contains(node) ? world_[positions_[node.id]] : kIdentity; }
+
+  // world matrices and node ids in storage order, e.g. to build draw lists after update()
+  std::span<const math::mat4> worldMatrices() const { return world_; }
+  std::span<const std::uint32_t> nodeIds() const { return ids_; }
+  // whether the world matrix at a storage position changed in the last update()
+  bool changed(std::size_t position) const { return (flags_[position] & kChanged) != 0; }
+
+  // recompute the world matrices of dirty subtrees; returns how many were recomputed
+  // ------------------------------------------------------------------------
+  std::size_t update(ThreadPool* pool = nullptr) {
+    if (orderDirty_) {
+      rebuildOrder();
+    }
+    if (dirty_ == 0 && !changedLastUpdate_) {
+      return 0;  // nothing to recompute and no changed flags to clear
+    }
+
+    std::atomic<std::size_t> recomputed{0};
+    for (std::size_t level = 0; level + 1 < levels_.size(); ++level) {
+      const std::size_t begin = levels_[level];
+      const std::size_t end = levels_[level + 1];
+      const std::size_t chunks = (end - begin + kChunk - 1) / kChunk;
+      auto updateChunk = [&, begin, end](std::size_t chunk, std::size_t) {
+        const std::size_t first = begin + chunk * kChunk;
+        const std::size_t count = updateRange(first, std::min(first + kChunk, end));
+        recomputed.fetch_add(count, std::memory_order_relaxed);
+      };
+      if (pool != nullptr && chunks > 1) {
+        pool->parallelFor(chunks, updateChunk);
+      } else {
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+          updateChunk(chunk, 0);
+        }
+      }
+    }
+    dirty_ = 0;
+    changedLastUpdate_ = recomputed.load() > 0;
+    return recomputed.load();
+  }
+
+ private:
+  static constexpr std::uint32_t kNone = 0xFFFFFFFFu;
+  static constexpr std::uint8_t kLocalDirty = 1;
+  static constexpr std::uint8_t kChanged = 2;  // world matrix recomputed by the last update()
+  static constexpr std::uint8_t kRemoved = 4;
+  static constexpr math::mat4 kIdentity{};
+
+  // local transforms, one stream per component
+  std::vector<float> tx_, ty_, tz_;
+  std::vector<float> rx_, ry_, rz_, rw_;
+  std::vector<float> sx_, sy_, sz_;
+  std::vector<std::uint32_t> parent_;  // storage position of the parent, kNone for roots
+  std::vector<std::uint32_t> depth_;
+  std::vector<std::uint32_t> ids_;  // storage position -> id
+  std::vector<std::uint8_t> flags_;
+  std::vector<math::mat4> world_;
+
+  std::vector<std::uint32_t> positions_;    // id -> storage position, kNone when free
+  std::vector<std::uint32_t> generations_;  // id -> generation, bumped when the id is freed
+  std::vector<std::uint32_t> freeIds_;
+  std::vector<std::size_t> levels_;  // first position of every depth, plus the end
+  bool orderDirty_ = false;
+  bool changedLastUpdate_ = false;
+  std::size_t dirty_ = 0;
+
+  std::vector<float>* floatStreams_[10] = {&tx_, &ty_, &tz_, &rx_, &ry_, &rz_, &rw_, &sx_, &sy_, &sz_};
+  std::span<std::vector<float>* const> floatStreams() { return floatStreams_; }
+
+  // the node's storage position, kNone (and nothing marked) when it is not contained
+  std::uint32_t markDirty(SceneNode node) {
+    if (!contains(node)) {
+      return kNone;
+    }
+    const std::uint32_t p = positions_[node.id];
+    flags_[p] |= kLocalDirty;
+    ++dirty_;
+    return p;
+  }
+
+  void writeLocal(std::uint32_t p, const math::vec3& translation, const math::quat& rotation,
+                  const math::vec3& scale) {
+    tx_[p] = translation.x;
+    ty_[p] = translation.y;
+    tz_[p] = translation.z;
+    rx_[p] = rotation.x;
+    ry_[p] = rotation.y;
+    rz_[p] = rotation.z;
+    rw_[p] = rotation.w;
+    sx_[p] = scale.x;
+    sy_[p] = scale.y;
+    sz_[p] = scale.z;
+  }
+
+  // one depth's nodes in [first, last); their parents are final already
+  // ------------------------------------------------------------------------
+  std::size_t updateRange(std::size_t first, std::size_t last) {
+    std::size_t recomputed = 0;
+    for (std::size_t i = first; i < last; ++i) {
+      const std::uint32_t parent = parent_[i];
+      const bool dirty = (flags_[i] & kLocalDirty) != 0 || (parent != kNone && (flags_[parent] & kChanged) != 0);
+      if (!dirty) {
+        flags_[i] = 0;
+        continue;
+      }
+      const math::mat4 local = math::compose({tx_[i], ty_[i], tz_[i]}, {rx_[i], ry_[i], rz_[i], rw_[i]},
+                                             {sx_[i], sy_[i], sz_[i]});
+      world_[i] = parent == kNone ? local : world_[parent] * local;
+      flags_[i] = kChanged;
+      ++recomputed;
+    }
+    return recomputed;
+  }
+
+  // drop removed subtrees and stable-sort the rest by depth (a counting sort, so O(n))
+  // ------------------------------------------------------------------------
+  void rebuildOrder() {
+    const std::size_t count = ids_.size();
+    // nodes added since the last rebuild may sit before their parents' depth: bucket by depth
+    // first, then removal can follow every parent chain from the top down
+    std::vector<std::uint32_t> byDepth(count);
+    std::vector<std::size_t> depthCounts;
+    for (std::size_t i = 0; i < count; ++i) {
+      if (depth_[i] >= depthCounts.size()) {
+        depthCounts.resize(depth_[i] + 1, 0);
+      }
+      ++depthCounts[depth_[i]];
+    }
+    levels_.assign(depthCounts.size() + 1, 0);
+    for (std::size_t d = 0; d < depthCounts.size(); ++d) {
+      levels_[d + 1] = levels_[d] + depthCounts[d];
+    }
+    {
+      std::vector<std::size_t> next(levels_.begin(), levels_.end() - 1);
+      for (std::uint32_t i = 0; i < count; ++i) {
+        byDepth[next[depth_[i]]++] = i;
+      }
+    }
+    for (std::uint32_t old : byDepth) {
+      if (parent_[old] != kNone && (flags_[parent_[old]] & kRemoved) != 0) {
+        flags_[old] |= kRemoved;
+      }
+    }
+
+    // old position -> new position, removed nodes are dropped
+    std::vector<std::uint32_t> newPosition(count, kNone);
+    std::vector<std::uint32_t> order;
+    order.reserve(count);
+    std::fill(levels_.begin(), levels_.end(), 0);
+    for (std::uint32_t old : byDepth) {
+      if ((flags_[old] & kRemoved) != 0) {
+        positions_[ids_[old]] = kNone;
+        ++generations_[ids_[old]];
+        freeIds_.push_back(ids_[old]);
+        continue;
+      }
+      newPosition[old] = static_cast<std::uint32_t>(order.size());
+      order.push_back(old);
+      ++levels_[depth_[old] + 1];
+    }
+    for (std::size_t d = 1; d < levels_.size(); ++d) {
+      levels_[d] += levels_[d - 1];
+    }
+    while (levels_.size() > 1 && levels_[levels_.size() - 1] == levels_[levels_.size() - 2]) {
+      levels_.pop_back();  // depths emptied by removal
+    }
+
+    auto permute = [&order](auto& values) {
+      std::remove_reference_t<decltype(values)> sorted;
+      sorted.reserve(values.capacity());
+      for (std::uint32_t old : order) {
+        sorted.push_back(values[old]);
+      }
+      values.swap(sorted);
+    };
+    for (auto* stream : floatStreams()) {
+      permute(*stream);
+    }
+    permute(depth_);
+    permute(ids_);
+    permute(flags_);
+    permute(world_);
+    permute(parent_);
+    for (std::uint32_t& parent : parent_) {
+      if (parent != kNone) {
+        parent = newPosition[parent];
+      }
+    }
+    for (std::uint32_t i = 0; i < ids_.size(); ++i) {
+      positions_[ids_[i]] = i;
+    }
+    orderDirty_ = false;
+  }
+};
@@ -2,158 +2,428 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "gl_resource.h"
+#include "hash.h"
 #include "logger.h"
+#include "program_cache.h"
+#include "shader_preprocessor.h"
+#include "shader_stats.h"
 
 namespace fs = std::filesystem;
 
+// resolved uniform location; resolve once with Shader::uniform() and reuse every draw
+struct UniformHandle {
+  GLint location = -1;
+
+  bool valid() const { return location >= 0; }
+};
+
+// uniform name hashed at compile time, e.g. shader.setInt(UniformName("texture2"), 1)
+struct UniformName {
+  std::uint64_t hash;
+
+  consteval UniformName(std::string_view name) : hash(fnv1a64(name)) {}
+};
+
+// one active uniform as reported by glGetActiveUniform after linking
+struct UniformInfo {
+  std::uint64_t hash;
+  GLint location;
+  GLenum type;
+  GLint size;
+  std::string name;
+};
+
+// load a shader source file through the preprocessor (#include, defines); logs and returns false on failure
+// ------------------------------------------------------------------------
+inline bool preprocessShaderFile(ShaderPreprocessor& preprocessor, const char* path, const ShaderDefines& defines,
+                                 PreprocessedSource& source, quill::Logger* logger) {
+  if (!preprocessor.process(path, defines, source)) {
+    LOG_ERROR(logger, "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: {}, error: {}", path, source.error);
+    return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------
+inline bool readShaderFile(const char* path, std::string& code, quill::Logger* logger) {
+  ShaderPreprocessor preprocessor;
+  PreprocessedSource source;
+  if (!preprocessShaderFile(preprocessor, path, {}, source, logger)) {
+    return false;
+  }
+  code = std::move(source.code);
+  return true;
+}
+
 class Shader {
  public:
-  unsigned int shaderProgram;
+  unsigned int shaderProgram = 0;  // the current program; see the GlProgram constructor for ownership
 
-  // constructor generates the shader on the fly
+  // constructor generates the shader on the fly from the embedded sources (paths are relative
+  // to resources/, e.g. "shaders/4.2.texture.vs"); with a cache the linked binary is reused
+  // across runs and the sources are only compiled on a miss. With a report the build is timed
+  // and recorded under the fragment path.
   // ------------------------------------------------------------------------
-  Shader(const char* vertexPath, const char* fragmentPath, quill::Logger* logger) : logger_(logger) {
-    // 1. retrieve the vertex/fragment source code from filePath
+  Shader(const char* vertexPath, const char* fragmentPath, quill::Logger* logger,
+         ProgramBinaryCache* cache = nullptr, ShaderBuildReport* report = nullptr)
+      : logger_(logger) {
+    // 1. retrieve the vertex/fragment source code from the shader bundle
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
-    try {
-      // open files
-      vShaderFile.open(vertexPath);
-      fShaderFile.open(fragmentPath);
-
-      std::stringstream vShaderStream, fShaderStream;
-      // read file's buffer contents into streams
-      vShaderStream << vShaderFile.rdbuf();
-      fShaderStream << fShaderFile.rdbuf();
-
-      // close file handlers
-      vShaderFile.close();
-      fShaderFile.close();
-
-      // convert stream into string
-      vertexCode = vShaderStream.str();
-      fragmentCode = fShaderStream.str();
-    } catch (std::ifstream::failure& e) {
-      LOG_ERROR(logger_, "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ, error: {}", e.what());
+    if (!readShaderFile(vertexPath, vertexCode, logger_) || !readShaderFile(fragmentPath, fragmentCode, logger_)) {
       return;
     }
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
-
-    // 2. compile shaders
-    unsigned int vertex, fragment;
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, nullptr);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    shaderProgram = buildProgram(vertexCode, fragmentCode, cache, report, fragmentPath);
+    if (shaderProgram != 0) {
+      reflectUniforms();
+    }
+  }
 
-    // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, nullptr);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+  // build from sources that are already in memory (e.g. preprocessed permutations)
+  // ------------------------------------------------------------------------
+  static Shader fromSource(const std::string& vertexCode, const std::string& fragmentCode, quill::Logger* logger,
+                           ProgramBinaryCache* cache = nullptr, ShaderBuildReport* report = nullptr,
+                           std::string_view name = {}) {
+    Shader shader(logger);
+    shader.shaderProgram = shader.buildProgram(vertexCode, fragmentCode, cache, report, name);
+    if (shader.shaderProgram != 0) {
+      shader.reflectUniforms();
+    }
+    return shader;
+  }
 
-    // shader Program
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertex);
-    glAttachShader(shaderProgram, fragment);
-    glLinkProgram(shaderProgram);
-    checkCompileErrors(shaderProgram, "PROGRAM");
+  // take ownership of a program that was already linked elsewhere (e.g. by ProgramLibrary); the
+  // program is released through its registry when the shader is destroyed or reloaded
+  // ------------------------------------------------------------------------
+  Shader(GlProgram linkedProgram, quill::Logger* logger)
+      : shaderProgram(linkedProgram.get()), logger_(logger), program_(std::move(linkedProgram)) {
+    reflectUniforms();
+  }
 
-    // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+  // rebuild from new sources; on failure the current program is kept and false is returned.
+  // Uniform values live in the program object, so callers must set them again afterwards. An
+  // owned program is released to its registry, which deletes it once the frames still using it
+  // are done; otherwise it is deleted right away.
+  // ------------------------------------------------------------------------
+  bool reload(const std::string& vertexCode, const std::string& fragmentCode, ProgramBinaryCache* cache = nullptr,
+              ShaderBuildReport* report = nullptr, std::string_view name = {}) {
+    GLuint program = buildProgram(vertexCode, fragmentCode, cache, report, name);
+    if (program == 0) {
+      return false;
+    }
+    if (GlResourceRegistry* registry = program_.registry(); registry != nullptr) {
+      program_ = GlProgram(*registry, program);
+    } else {
+      glDeleteProgram(shaderProgram);
+    }
+    shaderProgram = program;
+    reflectUniforms();
+    return true;
   }
 
   // activate the shader
   // ------------------------------------------------------------------------
   void use() { glUseProgram(shaderProgram); }
 
-  // utility uniform functions
+  // uniform reflection: every active uniform is looked up once after linking
+  // ------------------------------------------------------------------------
+  UniformHandle uniform(std::string_view name) const { return {locationOf(name)}; }
+  UniformHandle uniform(UniformName name) const { return {locationOf(name)}; }
+  const std::vector<UniformInfo>& uniforms() const { return uniforms_; }
+
+  // attach a named uniform block to a buffer binding point (GLSL 330 has no layout(binding = N))
   // ------------------------------------------------------------------------
-  void setBool(const std::string& name, bool value) const {
-    glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), (int)value);
+  bool bindUniformBlock(const char* blockName, GLuint binding) const {
+    GLuint index = glGetUniformBlockIndex(shaderProgram, blockName);
+    if (index == GL_INVALID_INDEX) {
+      return false;
+    }
+    glUniformBlockBinding(shaderProgram, index, binding);
+    return true;
   }
 
+  // utility uniform functions; the key is a UniformHandle (no lookup), a UniformName
+  // (table search, no driver call) or a plain string (hashed, then table search; array elements
+  // such as "lights[1]" are resolved by the driver on first use)
   // ------------------------------------------------------------------------
-  void setInt(const std::string& name, int value) const {
-    glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), value);
+  template <typename Key>
+  void setBool(const Key& key, bool value) const {
+    glUniform1i(locationOf(key), (int)value);
   }
 
   // ------------------------------------------------------------------------
-  void setFloat(const std::string& name, float value) const {
-    glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value);
+  template <typename Key>
+  void setInt(const Key& key, int value) const {
+    glUniform1i(locationOf(key), value);
   }
 
- private:
-  quill::Logger* logger_;
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setFloat(const Key& key, float value) const {
+    glUniform1f(locationOf(key), value);
+  }
+
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setVec2(const Key& key, float x, float y) const {
+    glUniform2f(locationOf(key), x, y);
+  }
+
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setVec3(const Key& key, float x, float y, float z) const {
+    glUniform3f(locationOf(key), x, y, z);
+  }
+
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setVec4(const Key& key, float x, float y, float z, float w) const {
+    glUniform4f(locationOf(key), x, y, z, w);
+  }
+
+  // matrices are column-major, as GLSL expects
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setMat3(const Key& key, const float* value, GLsizei count = 1) const {
+    glUniformMatrix3fv(locationOf(key), count, GL_FALSE, value);
+  }
+
+  // ------------------------------------------------------------------------
+  template <typename Key>
+  void setMat4(const Key& key, const float* value, GLsizei count = 1) const {
+    glUniformMatrix4fv(locationOf(key), count, GL_FALSE, value);
+  }
 
   // utility function for checking shader compilation/linking errors.
   // ------------------------------------------------------------------------
-  void checkCompileErrors(unsigned int shader, const std::string& type) {
+  static bool checkCompileErrors(unsigned int shader, const std::string& type, quill::Logger* logger) {
     int success;
     char infoLog[1024];
     if (type != "PROGRAM") {
       glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
       if (!success) {
         glGetShaderInfoLog(shader, 1024, nullptr, infoLog);
-        LOG_ERROR(logger_, "ERROR::SHADER_COMPILATION_ERROR of type: {}, error: {}", type, std::string(infoLog));
+        LOG_ERROR(logger, "ERROR::SHADER_COMPILATION_ERROR of type: {}, error: {}", type, std::string(infoLog));
       }
     } else {
       glGetProgramiv(shader, GL_LINK_STATUS, &success);
       if (!success) {
         glGetProgramInfoLog(shader, 1024, nullptr, infoLog);
-        LOG_ERROR(logger_, "ERROR::PROGRAM_LINKING_ERROR of type: {}, error: {}", type, std::string(infoLog));
+        LOG_ERROR(logger, "ERROR::PROGRAM_LINKING_ERROR of type: {}, error: {}", type, std::string(infoLog));
       }
     }
+    return success != 0;
+  }
+
+  // append the info log of a stage or program that built successfully, i.e. driver warnings
+  // ------------------------------------------------------------------------
+  static void collectWarnings(unsigned int object, const std::string& type, std::string& warnings) {
+    const bool program = type == "PROGRAM";
+    GLint length = 0;
+    if (program) {
+      glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    } else {
+      glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+    if (length <= 1) {
+      return;
+    }
+    std::string log(static_cast<std::size_t>(length), '\0');
+    if (program) {
+      glGetProgramInfoLog(object, length, nullptr, log.data());
+    } else {
+      glGetShaderInfoLog(object, length, nullptr, log.data());
+    }
+    log.resize(std::strlen(log.c_str()));
+    warnings += (warnings.empty() ? "" : "\n") + type + ": " + log;
+  }
+
+ private:
+  quill::Logger* logger_;
+  GlProgram program_;                          // empty unless the shader owns shaderProgram
+  std::vector<UniformInfo> uniforms_;          // sorted by name hash
+  mutable std::vector<UniformInfo> elements_;  // array elements past [0], sorted by name hash
+
+  explicit Shader(quill::Logger* logger) : logger_(logger) {}
+
+  // ------------------------------------------------------------------------
+  static GLint locationOf(UniformHandle handle) { return handle.location; }
+  GLint locationOf(UniformName name) const { return locationOf(name.hash); }
+
+  GLint locationOf(std::string_view name) const {
+    const std::uint64_t hash = fnv1a64(name);
+    const GLint location = locationOf(hash);
+    return location < 0 && name.find('[') != std::string_view::npos ? elementLocationOf(hash, name) : location;
+  }
+
+  GLint locationOf(std::uint64_t hash) const {
+    auto it = std::lower_bound(uniforms_.begin(), uniforms_.end(), hash,
+                               [](const UniformInfo& info, std::uint64_t h) { return info.hash < h; });
+    return it != uniforms_.end() && it->hash == hash ? it->location : -1;
+  }
+
+  // reflection lists arrays once, as "name[0]"; other elements are looked up once and cached,
+  // misses included
+  // ------------------------------------------------------------------------
+  GLint elementLocationOf(std::uint64_t hash, std::string_view name) const {
+    auto it = std::lower_bound(elements_.begin(), elements_.end(), hash,
+                               [](const UniformInfo& info, std::uint64_t h) { return info.hash < h; });
+    if (it != elements_.end() && it->hash == hash) {
+      return it->location;
+    }
+    std::string element(name);
+    const GLint location = glGetUniformLocation(shaderProgram, element.c_str());
+    elements_.insert(it, {hash, location, 0, 0, std::move(element)});
+    return location;
+  }
+
+  // build the flat uniform table; arrays are registered as both "name[0]" and "name"
+  // ------------------------------------------------------------------------
+  void reflectUniforms() {
+    uniforms_.clear();
+    elements_.clear();
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> buffer(static_cast<std::size_t>(std::max(maxLength, 1)));
+    for (GLint i = 0; i < count; ++i) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(shaderProgram, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size,
+                         &type, buffer.data());
+      std::string name(buffer.data(), static_cast<std::size_t>(length));
+      GLint location = glGetUniformLocation(shaderProgram, name.c_str());
+      if (location < 0) {
+        continue;  // member of a uniform block
+      }
+      uniforms_.push_back({fnv1a64(name), location, type, size, name});
+      if (auto bracket = name.find('['); bracket != std::string::npos) {
+        name.resize(bracket);
+        uniforms_.push_back({fnv1a64(name), location, type, size, name});
+      }
+    }
+    std::sort(uniforms_.begin(), uniforms_.end(),
+              [](const UniformInfo& a, const UniformInfo& b) { return a.hash < b.hash; });
+  }
+
+  // returns 0 on failure; with a report the attempt is recorded whether or not it succeeded
+  // ------------------------------------------------------------------------
+  GLuint buildProgram(const std::string& vertexCode, const std::string& fragmentCode, ProgramBinaryCache* cache,
+                      ShaderBuildReport* report, std::string_view name) {
+    ProgramBuildRecord record;
+    record.name = name;
+    record.sourceBytes = vertexCode.size() + fragmentCode.size();
+    GLuint program = compileAndLink(vertexCode, fragmentCode, cache, record);
+    record.success = program != 0;
+    if (report != nullptr) {
+      report->add(std::move(record));
+    }
+    return program;
+  }
+
+  // try the binary cache first, otherwise compile and link from source; returns 0 on failure
+  // ------------------------------------------------------------------------
+  GLuint compileAndLink(const std::string& vertexCode, const std::string& fragmentCode, ProgramBinaryCache* cache,
+                        ProgramBuildRecord& record) {
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t key = 0;
+    if (cache != nullptr) {
+      key = cache->key(vertexCode, fragmentCode);
+      if (GLuint program = cache->load(key); program != 0) {
+        record.fromCache = true;
+        record.linkMs = elapsedMs(start);
+        return program;
+      }
+      start = std::chrono::steady_clock::now();
+    }
+
+    const char* vShaderCode = vertexCode.c_str();
+    const char* fShaderCode = fragmentCode.c_str();
+
+    // 2. compile shaders (the status query is where a synchronous driver does the work)
+    unsigned int vertex, fragment;
+    // vertex shader
+    vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vShaderCode, nullptr);
+    glCompileShader(vertex);
+    if (checkCompileErrors(vertex, "VERTEX", logger_)) {
+      collectWarnings(vertex, "VERTEX", record.warnings);
+    }
+
+    // fragment Shader
+    fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &fShaderCode, nullptr);
+    glCompileShader(fragment);
+    if (checkCompileErrors(fragment, "FRAGMENT", logger_)) {
+      collectWarnings(fragment, "FRAGMENT", record.warnings);
+    }
+    record.compileMs = elapsedMs(start);
+
+    // shader Program
+    auto linkStart = std::chrono::steady_clock::now();
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    if (cache != nullptr) {
+      cache->prepare(program);
+    }
+    glLinkProgram(program);
+    bool linked = checkCompileErrors(program, "PROGRAM", logger_);
+    record.linkMs = elapsedMs(linkStart);
+    if (linked) {
+      collectWarnings(program, "PROGRAM", record.warnings);
+    }
+
+    // delete the shaders as they're linked into our program now and no longer necessary
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    if (!linked) {
+      glDeleteProgram(program);
+      return 0;
+    }
+    if (cache != nullptr) {
+      cache->store(key, program);
+    }
+    return program;
   }
 };
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) {
+// paths are relative to resources/ and resolved through the shader bundle, so the current
+// working directory no longer matters
+inline GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) {
   // Create the shaders
   GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
   GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-  auto working_dir = fs::current_path();
-  // Read the Vertex Shader code from the file
-  std::string VertexShaderCode;
-
-  auto f = working_dir.string() + vertex_file_path;
-  std::ifstream VertexShaderStream(f, std::ios::in);
-  if (VertexShaderStream.is_open()) {
-    std::stringstream sstr;
-    sstr << VertexShaderStream.rdbuf();
-    VertexShaderCode = sstr.str();
-    VertexShaderStream.close();
-  } else {
-    printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n",
-           vertex_file_path);
-    getchar();
+  // Read the Vertex and Fragment Shader code, expanding #include
+  ShaderPreprocessor preprocessor;
+  PreprocessedSource vertexSource;
+  PreprocessedSource fragmentSource;
+  if (!preprocessor.process(vertex_file_path, {}, vertexSource) ||
+      !preprocessor.process(fragment_file_path, {}, fragmentSource)) {
+    printf("Impossible to load shader: %s%s\n", vertexSource.error.c_str(), fragmentSource.error.c_str());
+    glDeleteShader(VertexShaderID);
+    glDeleteShader(FragmentShaderID);
     return 0;
   }
-
-  // Read the Fragment Shader code from the file
-  std::string FragmentShaderCode;
-  std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-  if (FragmentShaderStream.is_open()) {
-    std::stringstream sstr;
-    sstr << FragmentShaderStream.rdbuf();
-    FragmentShaderCode = sstr.str();
-    FragmentShaderStream.close();
-  }
+  std::string VertexShaderCode = std::move(vertexSource.code);
+  std::string FragmentShaderCode = std::move(fragmentSource.code);
 
   GLint Result = GL_FALSE;
   int InfoLogLength;
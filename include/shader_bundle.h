@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "hash.h"
+
+namespace fs = std::filesystem;
+
+// one shader file compiled into the executable by cmake/EmbedShaders.cmake
+struct EmbeddedShader {
+  std::string_view path;  // relative to the resources directory, e.g. "shaders/4.2.texture.vs"
+  std::string_view source;
+  std::uint64_t hash;  // fnv1a64(source), computed at compile time
+};
+
+// the generated table, sorted by path
+std::span<const EmbeddedShader> embeddedShaders();
+
+// ------------------------------------------------------------------------
+inline const EmbeddedShader* findEmbeddedShader(std::string_view path) {
+  auto shaders = embeddedShaders();
+  auto it = std::lower_bound(shaders.begin(), shaders.end(), path,
+                             [](const EmbeddedShader& shader, std::string_view p) { return shader.path < p; });
+  return it != shaders.end() && it->path == path ? &*it : nullptr;
+}
+
+// The single entry point for shader sources. path is relative to the resources directory.
+// Sources come from the embedded bundle; when overrideDirectory is set, a file at
+// <overrideDirectory>/<path> wins instead, so shaders can be edited (and hot reloaded)
+// without rebuilding.
+// ------------------------------------------------------------------------
+inline bool loadShaderSource(std::string_view path, std::string& source, const fs::path& overrideDirectory = {}) {
+  if (!overrideDirectory.empty()) {
+    std::ifstream file(overrideDirectory / path, std::ios::binary);
+    if (file) {
+      std::stringstream stream;
+      stream << file.rdbuf();
+      source = stream.str();
+      return true;
+    }
+  }
+  if (const EmbeddedShader* shader = findEmbeddedShader(path)) {
+    source.assign(shader->source);
+    return true;
+  }
+  return false;
+}
+
+// ------------------------------------------------------------------------
+inline bool shaderSourceExists(std::string_view path, const fs::path& overrideDirectory = {}) {
+  return (!overrideDirectory.empty() && fs::exists(overrideDirectory / path)) || findEmbeddedShader(path) != nullptr;
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "shader_bundle.h"
+
+namespace fs = std::filesystem;
+
+// Feature flags for one shader permutation. Defines are kept sorted so the same set always
+// produces the same text and the same permutation key regardless of insertion order.
+class ShaderDefines {
+ public:
+  ShaderDefines() = default;
+  ShaderDefines(std::initializer_list<std::pair<std::string, std::string>> defines) {
+    for (const auto& [name, value] : defines) {
+      set(name, value);
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  ShaderDefines& set(const std::string& name, const std::string& value = "1") {
+    auto it = std::lower_bound(defines_.begin(), defines_.end(), name,
+                               [](const auto& define, const std::string& n) { return define.first < n; });
+    if (it != defines_.end() && it->first == name) {
+      it->second = value;
+    } else {
+      defines_.emplace(it, name, value);
+    }
+    return *this;
+  }
+
+  bool empty() const { return defines_.empty(); }
+
+  // "#define NAME VALUE" lines, injected right after #version
+  // ------------------------------------------------------------------------
+  std::string text() const {
+    std::string text;
+    for (const auto& [name, value] : defines_) {
+      text += "#define " + name + " " + value + "\n";
+    }
+    return text;
+  }
+
+  // permutation key: identical for identical define sets
+  // ------------------------------------------------------------------------
+  std::uint64_t key() const {
+    std::uint64_t hash = kFnv1aOffset;
+    for (const auto& [name, value] : defines_) {
+      hash = fnv1a64(value, fnv1a64("=", fnv1a64(name, hash)));
+      hash = fnv1a64(";", hash);
+    }
+    return hash;
+  }
+
+  // human readable form for logs, e.g. "LIGHTS=4,USE_FOG=1"
+  // ------------------------------------------------------------------------
+  std::string name() const {
+    std::string name;
+    for (const auto& [define, value] : defines_) {
+      name += (name.empty() ? "" : ",") + define + "=" + value;
+    }
+    return name.empty() ? "<default>" : name;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> defines_;
+};
+
+// result of preprocessing one stage
+struct PreprocessedSource {
+  std::string code;
+  std::vector<fs::path> dependencies;  // the file itself followed by everything it included
+  std::string error;
+};
+
+// Expands #include "file" (relative to the including file, then the include directories),
+// strips #pragma once and injects defines after #version. Paths are relative to the resources
+// directory and are loaded with loadShaderSource(), i.e. from the embedded bundle unless an
+// override directory is given.
+//
+// Every file is included at most once per stage, as if it carried an include guard, and file
+// contents are cached across calls so shared headers are read from disk once. invalidate()
+// drops a cached file after it changed. Safe to use from a background thread.
+class ShaderPreprocessor {
+ public:
+  explicit ShaderPreprocessor(fs::path overrideDirectory = {}, std::vector<fs::path> includeDirectories = {})
+      : overrideDirectory_(std::move(overrideDirectory)), includeDirectories_(std::move(includeDirectories)) {}
+
+  const fs::path& overrideDirectory() const { return overrideDirectory_; }
+
+  // ------------------------------------------------------------------------
+  bool process(const fs::path& path, const ShaderDefines& defines, PreprocessedSource& out) {
+    out = {};
+    std::unordered_set<std::string> included;
+    std::vector<fs::path> stack;
+    std::string body;
+    if (!expand(normalize(path), body, out, included, stack)) {
+      return false;
+    }
+    out.code = injectDefines(body, defines.text());
+    return true;
+  }
+
+  // forget a cached file so the next process() rereads it
+  // ------------------------------------------------------------------------
+  void invalidate(const fs::path& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.erase(normalize(path).string());
+  }
+
+  // "./shaders/../shaders/a.vs" -> "shaders/a.vs", the form used as bundle key
+  static fs::path normalize(const fs::path& path) { return path.lexically_normal(); }
+
+ private:
+  fs::path overrideDirectory_;
+  std::vector<fs::path> includeDirectories_;
+  std::mutex mutex_;  // guards files_
+  std::unordered_map<std::string, std::string> files_;
+
+  // copy out under the lock: another thread may invalidate the entry meanwhile
+  bool read(const fs::path& path, std::string& contents) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path.string());
+    if (it == files_.end()) {
+      std::string source;
+      if (!loadShaderSource(path.generic_string(), source, overrideDirectory_)) {
+        return false;
+      }
+      it = files_.emplace(path.string(), std::move(source)).first;
+    }
+    contents = it->second;
+    return true;
+  }
+
+  fs::path resolve(const fs::path& includer, const std::string& name) const {
+    auto local = normalize(includer.parent_path() / name);
+    if (shaderSourceExists(local.generic_string(), overrideDirectory_)) {
+      return local;
+    }
+    for (const auto& directory : includeDirectories_) {
+      auto candidate = normalize(directory / name);
+      if (shaderSourceExists(candidate.generic_string(), overrideDirectory_)) {
+        return candidate;
+      }
+    }
+    return local;
+  }
+
+  bool expand(const fs::path& path, std::string& code, PreprocessedSource& out,
+              std::unordered_set<std::string>& included, std::vector<fs::path>& stack) {
+    if (std::find(stack.begin(), stack.end(), path) != stack.end()) {
+      out.error = "include cycle at " + path.string();
+      return false;
+    }
+    if (!included.insert(path.string()).second) {
+      return true;  // already expanded into this stage
+    }
+
+    std::string contents;
+    if (!read(path, contents)) {
+      out.error = "cannot open " + path.string();
+      return false;
+    }
+    out.dependencies.push_back(path);
+    stack.push_back(path);
+
+    std::istringstream lines(contents);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+      ++lineNumber;
+      std::string_view directive(line);
+      directive.remove_prefix(std::min(directive.find_first_not_of(" \t"), directive.size()));
+
+      if (directive.starts_with("#pragma once")) {
+        continue;
+      }
+      if (directive.starts_with("#include")) {
+        auto open = directive.find_first_of("\"<");
+        auto close = open == std::string_view::npos ? open : directive.find_first_of("\">", open + 1);
+        if (close == std::string_view::npos) {
+          out.error = path.string() + ":" + std::to_string(lineNumber) + ": malformed #include";
+          return false;
+        }
+        auto name = std::string(directive.substr(open + 1, close - open - 1));
+        if (!expand(resolve(path, name), code, out, included, stack)) {
+          return false;
+        }
+        // keep compiler messages pointing at the right line of this file
+        code += "#line " + std::to_string(lineNumber + 1) + "\n";
+        continue;
+      }
+      code += line;
+      code += '\n';
+    }
+
+    stack.pop_back();
+    return true;
+  }
+
+  static std::string injectDefines(const std::string& code, const std::string& defines) {
+    if (defines.empty()) {
+      return code;
+    }
+    // #version has to stay the first statement
+    auto version = code.find("#version");
+    if (version == std::string::npos) {
+      return defines + code;
+    }
+    auto lineEnd = code.find('\n', version);
+    if (lineEnd == std::string::npos) {
+      return code + "\n" + defines;
+    }
+    // #line resets numbering so errors still match the file on disk
+    auto versionLine = std::count(code.begin(), code.begin() + static_cast<std::ptrdiff_t>(lineEnd), '\n') + 1;
+    return code.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(versionLine + 1) + "\n" +
+           code.substr(lineEnd + 1);
+  }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+
+namespace fs = std::filesystem;
+
+// timing and diagnostics of building one program
+struct ProgramBuildRecord {
+  std::string name;
+  std::size_t sourceBytes = 0;  // both stages after preprocessing
+  bool fromCache = false;
+  bool asynchronous = false;  // built by ProgramLibrary
+  bool success = false;
+  double compileMs = 0.0;     // both stages; asynchronous: issuing the compile calls
+  double linkMs = 0.0;        // link + status query, or glProgramBinary on a cache hit
+  double queueMs = 0.0;       // asynchronous: CPU time spent issuing the compile and link calls
+  double completionMs = 0.0;  // asynchronous: from submit until poll() first saw the program done
+  std::string warnings;       // info logs of stages that compiled / linked successfully
+
+  // the build cost, compared against the slow threshold; completionMs also counts whatever ran
+  // between submit and poll and is only reported
+  double totalMs() const { return compileMs + linkMs; }
+};
+
+// ------------------------------------------------------------------------
+inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Collects a ProgramBuildRecord per program so a slow startup can be traced to the program that
+// caused it. log() writes one structured line per program through quill and flags programs
+// slower than the threshold; toJson() / writeJson() produce the same data for tooling.
+class ShaderBuildReport {
+ public:
+  explicit ShaderBuildReport(quill::Logger* logger, double slowThresholdMs = 50.0)
+      : logger_(logger), slowThresholdMs_(slowThresholdMs) {}
+
+  void add(ProgramBuildRecord record) { records_.push_back(std::move(record)); }
+  const std::vector<ProgramBuildRecord>& records() const { return records_; }
+  bool slow(const ProgramBuildRecord& record) const { return record.totalMs() > slowThresholdMs_; }
+
+  // ------------------------------------------------------------------------
+  void log() const {
+    double total = 0.0;
+    std::size_t cached = 0;
+    for (const auto& r : records_) {
+      total += r.totalMs();
+      cached += r.fromCache ? 1 : 0;
+      LOG_INFO(logger_,
+               "shader build: name={} ok={} cached={} async={} source={}B compile={:.2f}ms link={:.2f}ms "
+               "queue={:.2f}ms completion={:.2f}ms total={:.2f}ms",
+               r.name, r.success, r.fromCache, r.asynchronous, r.sourceBytes, r.compileMs, r.linkMs, r.queueMs,
+               r.completionMs, r.totalMs());
+      if (!r.warnings.empty()) {
+        LOG_WARNING(logger_, "shader build warnings: name={} log={}", r.name, r.warnings);
+      }
+      if (slow(r)) {
+        LOG_WARNING(logger_, "slow shader build: name={} total={:.2f}ms threshold={:.2f}ms", r.name, r.totalMs(),
+                    slowThresholdMs_);
+      }
+    }
+    LOG_INFO(logger_, "shader build summary: programs={} cached={} total={:.2f}ms", records_.size(), cached, total);
+  }
+
+  // ------------------------------------------------------------------------
+  std::string toJson() const {
+    std::string json = "{\n  \"slowThresholdMs\": " + number(slowThresholdMs_) + ",\n  \"programs\": [";
+    for (std::size_t i = 0; i < records_.size(); ++i) {
+      const auto& r = records_[i];
+      json += i == 0 ? "\n" : ",\n";
+      json += "    {\"name\": " + quote(r.name) + ", \"success\": " + boolean(r.success) +
+              ", \"fromCache\": " + boolean(r.fromCache) + ", \"asynchronous\": " + boolean(r.asynchronous) +
+              ", \"sourceBytes\": " + std::to_string(r.sourceBytes) + ", \"compileMs\": " + number(r.compileMs) +
+              ", \"linkMs\": " + number(r.linkMs) + ", \"queueMs\": " + number(r.queueMs) +
+              ", \"completionMs\": " + number(r.completionMs) + ", \"totalMs\": " + number(r.totalMs()) +
+              ", \"slow\": " + boolean(slow(r)) + ", \"warnings\": " + quote(r.warnings) + "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+  }
+
+  // ------------------------------------------------------------------------
+  bool writeJson(const fs::path& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!(file << toJson())) {
+      LOG_ERROR(logger_, "shader build report: failed to write {}", path.string());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  quill::Logger* logger_;
+  double slowThresholdMs_;
+  std::vector<ProgramBuildRecord> records_;
+
+  static std::string boolean(bool value) { return value ? "true" : "false"; }
+
+  static std::string number(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+  }
+
+  static std::string quote(std::string_view text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (c == '\n') {
+        quoted += "\\n";
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        quoted += escaped;
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+};
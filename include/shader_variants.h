@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "program_library.h"
+#include "shader_preprocessor.h"
+
+// Lazily submitted permutations of one vertex/fragment pair.
+//
+// submit() hands a permutation to the ProgramLibrary the first time its define set is requested
+// and returns the same ProgramId on every later call, so each permutation is compiled once
+// however often it is asked for. Define sets are told apart by ShaderDefines::key(), which does
+// not depend on the order the defines were set in. A permutation that fails to build keeps its
+// failed id, so it is reported once instead of being rebuilt every frame. The Shader is the
+// library's: programs.get(id) once the library has finalized it.
+class ShaderVariantCache {
+ public:
+  using ProgramId = ProgramLibrary::ProgramId;
+  // builds one permutation; the library constructor submits the files with the defines
+  using Submit = std::function<ProgramId(const ShaderDefines&)>;
+
+  // variants are named "<name> [<defines>]" in the library's logs and build report
+  // ------------------------------------------------------------------------
+  ShaderVariantCache(ProgramLibrary& programs, std::string name, std::string vertexPath, std::string fragmentPath)
+      : vertexPath_(std::move(vertexPath)), fragmentPath_(std::move(fragmentPath)) {
+    submit_ = [&programs, name = std::move(name), vertex = vertexPath_,
+               fragment = fragmentPath_](const ShaderDefines& defines) {
+      return programs.submitFiles(defines.empty() ? name : name + " [" + defines.name() + "]", vertex.c_str(),
+                                  fragment.c_str(), defines);
+    };
+  }
+
+  // with any builder, e.g. one that records what would be built
+  ShaderVariantCache(Submit submit, std::string vertexPath, std::string fragmentPath)
+      : vertexPath_(std::move(vertexPath)), fragmentPath_(std::move(fragmentPath)), submit_(std::move(submit)) {}
+
+  // ------------------------------------------------------------------------
+  ProgramId submit(const ShaderDefines& defines) {
+    const std::uint64_t key = defines.key();
+    if (auto it = variants_.find(key); it != variants_.end()) {
+      return it->second;
+    }
+    return variants_.emplace(key, submit_(defines)).first->second;
+  }
+
+  // true once submit() has been called for this permutation, whether or not it built
+  bool contains(const ShaderDefines& defines) const { return variants_.count(defines.key()) != 0; }
+  std::size_t size() const { return variants_.size(); }
+
+  // for ShaderWatcher::watch() of a variant
+  const std::string& vertexPath() const { return vertexPath_; }
+  const std::string& fragmentPath() const { return fragmentPath_; }
+
+ private:
+  std::string vertexPath_;
+  std::string fragmentPath_;
+  Submit submit_;
+  std::unordered_map<std::uint64_t, ProgramId> variants_;
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+#include "program_cache.h"
+#include "shader.h"
+#include "shader_preprocessor.h"
+
+namespace fs = std::filesystem;
+
+// Development hot reload for shader sources.
+//
+// Only meaningful together with an override directory (see loadShaderSource()): the watcher
+// watches <overrideDirectory>/<directory>, and a background thread waits on inotify for
+// writes there, rereads and preprocesses the sources of every program that depends on a
+// changed file (directly or through #include) and queues them. applyPending() is called once
+// per frame on the GL thread: it compiles the queued sources and swaps the new program in,
+// so a frame never sees a half-updated program. A failed compile keeps the old program.
+//
+// inotify is Linux only; on other platforms, or without an override directory, the watcher
+// is inert and applyPending() never reloads anything.
+class ShaderWatcher {
+ public:
+  ShaderWatcher(fs::path overrideDirectory, fs::path directory, quill::Logger* logger,
+                ProgramBinaryCache* cache = nullptr)
+      : directory_(std::move(directory)), logger_(logger), cache_(cache), preprocessor_(std::move(overrideDirectory)) {
+    if (preprocessor_.overrideDirectory().empty()) {
+      LOG_INFO(logger_, "shader hot reload disabled: shaders are embedded and no override directory is set");
+      return;
+    }
+#ifdef __linux__
+    auto watchedPath = preprocessor_.overrideDirectory() / directory_;
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // editors either rewrite in place (IN_CLOSE_WRITE) or save to a temp file and rename (IN_MOVED_TO)
+    if (inotify_ < 0 || inotify_add_watch(inotify_, watchedPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      LOG_ERROR(logger_, "shader hot reload disabled: cannot watch {}", watchedPath.string());
+      return;
+    }
+    thread_ = std::thread([this] { run(); });
+#else
+    LOG_INFO(logger_, "shader hot reload is only available on Linux (inotify)");
+#endif
+  }
+
+  ShaderWatcher(const ShaderWatcher&) = delete;
+  ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+  ~ShaderWatcher() {
+    stop_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+#ifdef __linux__
+    if (inotify_ >= 0) {
+      close(inotify_);
+    }
+#endif
+  }
+
+  // reload shader whenever one of its source files or their includes change; shader must
+  // outlive the watcher
+  // ------------------------------------------------------------------------
+  void watch(Shader& shader, std::string vertexPath, std::string fragmentPath, ShaderDefines defines = {}) {
+    Watched watched{&shader, std::move(vertexPath), std::move(fragmentPath), std::move(defines), {}};
+    PreprocessedSource vertexSource;
+    PreprocessedSource fragmentSource;
+    if (preprocessor_.process(watched.vertexPath, watched.defines, vertexSource) &&
+        preprocessor_.process(watched.fragmentPath, watched.defines, fragmentSource)) {
+      watched.dependencies = collectDependencies(vertexSource, fragmentSource);
+    } else {
+      watched.dependencies = {ShaderPreprocessor::normalize(watched.vertexPath),
+                              ShaderPreprocessor::normalize(watched.fragmentPath)};
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    watched_.push_back(std::move(watched));
+  }
+
+  // call at a frame boundary on the GL thread; onReloaded(shader) runs after each successful
+  // swap so that uniforms can be set again. Returns the number of programs swapped.
+  // ------------------------------------------------------------------------
+  template <typename OnReloaded>
+  std::size_t applyPending(OnReloaded&& onReloaded) {
+    std::vector<Reload> reloads;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reloads.swap(pending_);
+    }
+
+    std::size_t swapped = 0;
+    for (auto& reload : reloads) {
+      Shader& shader = *watched_[reload.index].shader;
+      const std::string& name = watched_[reload.index].fragmentPath;
+      if (shader.reload(reload.vertexCode, reload.fragmentCode, cache_)) {
+        LOG_INFO(logger_, "shader reloaded: {}", name);
+        onReloaded(shader);
+        ++swapped;
+      } else {
+        LOG_ERROR(logger_, "shader reload failed, keeping previous program: {}", name);
+      }
+    }
+    return swapped;
+  }
+
+  std::size_t applyPending() {
+    return applyPending([](Shader&) {});
+  }
+
+ private:
+  struct Watched {
+    Shader* shader;
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderDefines defines;
+    std::vector<fs::path> dependencies;
+  };
+
+  struct Reload {
+    std::size_t index;
+    std::string vertexCode;
+    std::string fragmentCode;
+  };
+
+  static std::vector<fs::path> collectDependencies(const PreprocessedSource& vertexSource,
+                                                   const PreprocessedSource& fragmentSource) {
+    std::vector<fs::path> dependencies = vertexSource.dependencies;
+    dependencies.insert(dependencies.end(), fragmentSource.dependencies.begin(), fragmentSource.dependencies.end());
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+    return dependencies;
+  }
+
+  fs::path directory_;  // relative to the override directory, like every shader path
+  quill::Logger* logger_;
+  ProgramBinaryCache* cache_;
+  ShaderPreprocessor preprocessor_;
+  std::atomic<bool> stop_ = false;
+  std::thread thread_;
+  int inotify_ = -1;
+
+  std::mutex mutex_;              // guards watched_ (appends) and pending_
+  std::vector<Watched> watched_;  // only ever appended to, so indices are stable
+  std::vector<Reload> pending_;
+
+#ifdef __linux__
+  // background thread: wait for events, reread affected sources, queue them for the GL thread
+  // ------------------------------------------------------------------------
+  void run() {
+    alignas(inotify_event) char buffer[4096];
+    while (!stop_) {
+      pollfd fd{inotify_, POLLIN, 0};
+      if (::poll(&fd, 1, 100) <= 0) {
+        continue;  // timeout: re-check stop_
+      }
+
+      std::vector<fs::path> changed;
+      ssize_t length;
+      while ((length = read(inotify_, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+          auto* event = reinterpret_cast<inotify_event*>(p);
+          if (event->len > 0) {
+            changed.push_back(ShaderPreprocessor::normalize(directory_ / event->name));
+          }
+          p += sizeof(inotify_event) + event->len;
+        }
+      }
+      if (!changed.empty()) {
+        queueReloads(changed);
+      }
+    }
+  }
+
+  void queueReloads(const std::vector<fs::path>& changed) {
+    std::vector<std::pair<std::size_t, Watched>> affected;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t i = 0; i < watched_.size(); ++i) {
+        for (const auto& dependency : watched_[i].dependencies) {
+          if (std::find(changed.begin(), changed.end(), dependency) != changed.end()) {
+            affected.emplace_back(i, watched_[i]);
+            break;
+          }
+        }
+      }
+    }
+
+    for (const auto& path : changed) {
+      preprocessor_.invalidate(path);
+    }
+
+    // file reads and preprocessing happen here, off the GL thread and outside the lock
+    for (const auto& [index, watched] : affected) {
+      PreprocessedSource vertexSource;
+      PreprocessedSource fragmentSource;
+      if (!preprocessShaderFile(preprocessor_, watched.vertexPath.c_str(), watched.defines, vertexSource, logger_) ||
+          !preprocessShaderFile(preprocessor_, watched.fragmentPath.c_str(), watched.defines, fragmentSource,
+                                logger_)) {
+        continue;
+      }
+      Reload reload{index, std::move(vertexSource.code), std::move(fragmentSource.code)};
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      // an edit may have added or removed includes
+      watched_[index].dependencies = collectDependencies(vertexSource, fragmentSource);
+      // a newer version of the same program replaces one that has not been applied yet
+      auto queued =
+          std::find_if(pending_.begin(), pending_.end(), [i = index](const Reload& r) { return r.index == i; });
+      if (queued != pending_.end()) {
+        *queued = std::move(reload);
+      } else {
+        pending_.push_back(std::move(reload));
+      }
+    }
+  }
+#endif
+};
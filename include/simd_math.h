@@ -0,0 +1,510 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// SIMD_MATH_SCALAR forces the portable code paths (e.g. to compare results). Otherwise SSE is
+// used on x86-64 (part of the baseline), AVX when the compiler targets it (ENABLE_AVX in
+// CMake) and NEON on ARM.
+#if !defined(SIMD_MATH_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_MATH_SSE 1
+#include <immintrin.h>
+#if defined(__AVX__)
+#define SIMD_MATH_AVX 1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_MATH_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+// Vectors, column-major matrices and quaternions for CPU-side transforms.
+//
+// Everything that is plain arithmetic is constexpr; the hot operations (dot4, mat4 * vec4,
+// mat4 * mat4) switch to intrinsics outside of constant evaluation. Conventions follow GLSL:
+// m.columns[c].x is row 0 of column c, m * v transforms a column vector, and projections map
+// to OpenGL's [-1, 1] clip space depth. data() can be passed straight to Shader::setMat4.
+//
+// For many elements at once use the batch functions at the end: transformPoints() works on
+// structure-of-arrays x / y / z streams, 8 points per iteration with AVX and 4 with SSE or NEON.
+namespace math {
+
+struct vec2 {
+  float x = 0.0f, y = 0.0f;
+
+  constexpr vec2() = default;
+  constexpr vec2(float x_, float y_) : x(x_), y(y_) {}
+  constexpr explicit vec2(float s) : x(s), y(s) {}
+
+  constexpr bool operator==(const vec2&) const = default;
+};
+
+struct vec3 {
+  float x = 0.0f, y = 0.0f, z = 0.0f;
+
+  constexpr vec3() = default;
+  constexpr vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+  constexpr explicit vec3(float s) : x(s), y(s), z(s) {}
+
+  constexpr bool operator==(const vec3&) const = default;
+};
+
+struct alignas(16) vec4 {
+  float x = 0.0f, y = 0.0f, z = 0.0f, w = 0.0f;
+
+  constexpr vec4() = default;
+  constexpr vec4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+  constexpr vec4(const vec3& v, float w_) : x(v.x), y(v.y), z(v.z), w(w_) {}
+  constexpr explicit vec4(float s) : x(s), y(s), z(s), w(s) {}
+
+  constexpr vec3 xyz() const { return {x, y, z}; }
+  constexpr bool operator==(const vec4&) const = default;
+};
+
+// component-wise arithmetic, generated for the three vector types
+#define SIMD_MATH_VECTOR_OPS(V, APPLY)                                                                       \
+  constexpr V operator+(const V& a, const V& b) { return APPLY(a, +, b); }                                   \
+  constexpr V operator-(const V& a, const V& b) { return APPLY(a, -, b); }                                   \
+  constexpr V operator*(const V& a, const V& b) { return APPLY(a, *, b); }                                   \
+  constexpr V operator/(const V& a, const V& b) { return APPLY(a, /, b); }                                   \
+  constexpr V operator*(const V& a, float s) { return a * V(s); }                                            \
+  constexpr V operator*(float s, const V& a) { return a * V(s); }                                            \
+  constexpr V operator/(const V& a, float s) { return a * (1.0f / s); }                                      \
+  constexpr V operator-(const V& a) { return a * -1.0f; }                                                    \
+  constexpr V& operator+=(V& a, const V& b) { return a = a + b; }                                            \
+  constexpr V& operator-=(V& a, const V& b) { return a = a - b; }                                            \
+  constexpr V& operator*=(V& a, float s) { return a = a * s; }
+
+#define SIMD_MATH_APPLY2(a, op, b) vec2((a).x op(b).x, (a).y op(b).y)
+#define SIMD_MATH_APPLY3(a, op, b) vec3((a).x op(b).x, (a).y op(b).y, (a).z op(b).z)
+#define SIMD_MATH_APPLY4(a, op, b) vec4((a).x op(b).x, (a).y op(b).y, (a).z op(b).z, (a).w op(b).w)
+
+SIMD_MATH_VECTOR_OPS(vec2, SIMD_MATH_APPLY2)
+SIMD_MATH_VECTOR_OPS(vec3, SIMD_MATH_APPLY3)
+SIMD_MATH_VECTOR_OPS(vec4, SIMD_MATH_APPLY4)
+
+#undef SIMD_MATH_VECTOR_OPS
+#undef SIMD_MATH_APPLY2
+#undef SIMD_MATH_APPLY3
+#undef SIMD_MATH_APPLY4
+
+constexpr float dot(const vec2& a, const vec2& b) { return a.x * b.x + a.y * b.y; }
+constexpr float dot(const vec3& a, const vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// ------------------------------------------------------------------------
+constexpr float dot(const vec4& a, const vec4& b) {
+  if (!std::is_constant_evaluated()) {
+#if defined(SIMD_MATH_SSE)
+    __m128 product = _mm_mul_ps(_mm_load_ps(&a.x), _mm_load_ps(&b.x));
+    __m128 swapped = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(product, swapped);
+    swapped = _mm_movehl_ps(swapped, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, swapped));
+#elif defined(SIMD_MATH_NEON)
+    float32x4_t product = vmulq_f32(vld1q_f32(&a.x), vld1q_f32(&b.x));
+    float32x2_t pairs = vadd_f32(vget_low_f32(product), vget_high_f32(product));
+    return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+#endif
+  }
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+constexpr vec3 cross(const vec3& a, const vec3& b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+template <typename V>
+constexpr V lerp(const V& a, const V& b, float t) {
+  return a + (b - a) * t;
+}
+
+template <typename V>
+float length(const V& v) {
+  return std::sqrt(dot(v, v));
+}
+
+// the zero vector stays zero
+template <typename V>
+V normalize(const V& v) {
+  const float squared = dot(v, v);
+  return squared > 0.0f ? v * (1.0f / std::sqrt(squared)) : v;
+}
+
+// column-major 3x3, e.g. the normal matrix
+struct mat3 {
+  vec3 columns[3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+
+  constexpr mat3() = default;
+  constexpr mat3(const vec3& c0, const vec3& c1, const vec3& c2) : columns{c0, c1, c2} {}
+
+  constexpr vec3& operator[](std::size_t column) { return columns[column]; }
+  constexpr const vec3& operator[](std::size_t column) const { return columns[column]; }
+  const float* data() const { return &columns[0].x; }
+};
+
+constexpr vec3 operator*(const mat3& m, const vec3& v) { return m[0] * v.x + m[1] * v.y + m[2] * v.z; }
+
+constexpr mat3 operator*(const mat3& a, const mat3& b) { return {a * b[0], a * b[1], a * b[2]}; }
+
+constexpr mat3 transpose(const mat3& m) {
+  return {{m[0].x, m[1].x, m[2].x}, {m[0].y, m[1].y, m[2].y}, {m[0].z, m[1].z, m[2].z}};
+}
+
+constexpr float determinant(const mat3& m) { return dot(m[0], cross(m[1], m[2])); }
+
+// the inverse's rows are the cross products of the columns; a singular matrix gives inf / nan
+constexpr mat3 inverse(const mat3& m) {
+  const float invDet = 1.0f / determinant(m);
+  return transpose(mat3(cross(m[1], m[2]) * invDet, cross(m[2], m[0]) * invDet, cross(m[0], m[1]) * invDet));
+}
+
+// column-major 4x4
+struct alignas(16) mat4 {
+  vec4 columns[4] = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f},
+                     {0.0f, 0.0f, 0.0f, 1.0f}};
+
+  constexpr mat4() = default;
+  constexpr mat4(const vec4& c0, const vec4& c1, const vec4& c2, const vec4& c3) : columns{c0, c1, c2, c3} {}
+  constexpr explicit mat4(const mat3& m)
+      : columns{{m[0], 0.0f}, {m[1], 0.0f}, {m[2], 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}} {}
+
+  constexpr vec4& operator[](std::size_t column) { return columns[column]; }
+  constexpr const vec4& operator[](std::size_t column) const { return columns[column]; }
+  const float* data() const { return &columns[0].x; }
+
+  constexpr mat3 upper3x3() const { return {columns[0].xyz(), columns[1].xyz(), columns[2].xyz()}; }
+};
+
+// ------------------------------------------------------------------------
+constexpr vec4 operator*(const mat4& m, const vec4& v) {
+  if (!std::is_constant_evaluated()) {
+#if defined(SIMD_MATH_SSE)
+    vec4 result;
+    __m128 sum = _mm_mul_ps(_mm_load_ps(&m[0].x), _mm_set1_ps(v.x));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(&m[1].x), _mm_set1_ps(v.y)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(&m[2].x), _mm_set1_ps(v.z)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(&m[3].x), _mm_set1_ps(v.w)));
+    _mm_store_ps(&result.x, sum);
+    return result;
+#elif defined(SIMD_MATH_NEON)
+    vec4 result;
+    float32x4_t sum = vmulq_n_f32(vld1q_f32(&m[0].x), v.x);
+    sum = vmlaq_n_f32(sum, vld1q_f32(&m[1].x), v.y);
+    sum = vmlaq_n_f32(sum, vld1q_f32(&m[2].x), v.z);
+    sum = vmlaq_n_f32(sum, vld1q_f32(&m[3].x), v.w);
+    vst1q_f32(&result.x, sum);
+    return result;
+#endif
+  }
+  return m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+}
+
+// ------------------------------------------------------------------------
+constexpr mat4 operator*(const mat4& a, const mat4& b) {
+  mat4 result;
+#if defined(SIMD_MATH_AVX)
+  if (!std::is_constant_evaluated()) {
+    // two result columns per iteration: both 128-bit lanes hold a's columns, each lane
+    // broadcasts the components of its own column of b
+    const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[0].x));
+    const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[1].x));
+    const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[2].x));
+    const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[3].x));
+    for (std::size_t c = 0; c < 4; c += 2) {
+      const __m256 columns = _mm256_loadu_ps(&b[c].x);
+      __m256 sum = _mm256_mul_ps(a0, _mm256_permute_ps(columns, 0x00));
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(a1, _mm256_permute_ps(columns, 0x55)));
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(a2, _mm256_permute_ps(columns, 0xAA)));
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(a3, _mm256_permute_ps(columns, 0xFF)));
+      _mm256_storeu_ps(&result[c].x, sum);
+    }
+    return result;
+  }
+#endif
+  for (std::size_t c = 0; c < 4; ++c) {
+    result[c] = a * b[c];
+  }
+  return result;
+}
+
+constexpr vec3 transformPoint(const mat4& m, const vec3& p) { return (m * vec4(p, 1.0f)).xyz(); }
+constexpr vec3 transformDirection(const mat4& m, const vec3& d) { return (m * vec4(d, 0.0f)).xyz(); }
+
+constexpr mat4 transpose(const mat4& m) {
+  return {{m[0].x, m[1].x, m[2].x, m[3].x},
+          {m[0].y, m[1].y, m[2].y, m[3].y},
+          {m[0].z, m[1].z, m[2].z, m[3].z},
+          {m[0].w, m[1].w, m[2].w, m[3].w}};
+}
+
+// general inverse through 2x2 sub-determinants; a singular matrix gives inf / nan
+// ------------------------------------------------------------------------
+constexpr mat4 inverse(const mat4& m) {
+  const vec3 a = m[0].xyz(), b = m[1].xyz(), c = m[2].xyz(), d = m[3].xyz();
+  const float x = m[0].w, y = m[1].w, z = m[2].w, w = m[3].w;
+
+  vec3 s = cross(a, b);
+  vec3 t = cross(c, d);
+  vec3 u = a * y - b * x;
+  vec3 v = c * w - d * z;
+  const float invDet = 1.0f / (dot(s, v) + dot(t, u));
+  s *= invDet;
+  t *= invDet;
+  u *= invDet;
+  v *= invDet;
+
+  const vec3 r0 = cross(b, v) + t * y;
+  const vec3 r1 = cross(v, a) - t * x;
+  const vec3 r2 = cross(d, u) + s * w;
+  const vec3 r3 = cross(u, c) - s * z;
+  return transpose(mat4({r0, -dot(b, t)}, {r1, dot(a, t)}, {r2, -dot(d, s)}, {r3, dot(c, s)}));
+}
+
+// rotation / scale / translation only (last row 0 0 0 1), cheaper than inverse()
+constexpr mat4 inverseAffine(const mat4& m) {
+  const mat3 linear = inverse(m.upper3x3());
+  const vec3 translation = -(linear * m[3].xyz());
+  return {{linear[0], 0.0f}, {linear[1], 0.0f}, {linear[2], 0.0f}, {translation, 1.0f}};
+}
+
+constexpr mat4 translate(const vec3& t) {
+  mat4 m;
+  m[3] = vec4(t, 1.0f);
+  return m;
+}
+
+constexpr mat4 scale(const vec3& s) {
+  mat4 m;
+  m[0].x = s.x;
+  m[1].y = s.y;
+  m[2].z = s.z;
+  return m;
+}
+
+// right-handed, looking down -z, depth mapped to [-1, 1] like glm::perspective
+inline mat4 perspective(float fovYRadians, float aspect, float zNear, float zFar) {
+  const float f = 1.0f / std::tan(fovYRadians * 0.5f);
+  return {{f / aspect, 0.0f, 0.0f, 0.0f},
+          {0.0f, f, 0.0f, 0.0f},
+          {0.0f, 0.0f, (zFar + zNear) / (zNear - zFar), -1.0f},
+          {0.0f, 0.0f, 2.0f * zFar * zNear / (zNear - zFar), 0.0f}};
+}
+
+constexpr mat4 ortho(float left, float right, float bottom, float top, float zNear, float zFar) {
+  return {{2.0f / (right - left), 0.0f, 0.0f, 0.0f},
+          {0.0f, 2.0f / (top - bottom), 0.0f, 0.0f},
+          {0.0f, 0.0f, -2.0f / (zFar - zNear), 0.0f},
+          {-(right + left) / (right - left), -(top + bottom) / (top - bottom), -(zFar + zNear) / (zFar - zNear), 1.0f}};
+}
+
+inline mat4 lookAt(const vec3& eye, const vec3& target, const vec3& up) {
+  const vec3 f = normalize(target - eye);
+  const vec3 s = normalize(cross(f, up));
+  const vec3 u = cross(s, f);
+  return {{s.x, u.x, -f.x, 0.0f},
+          {s.y, u.y, -f.y, 0.0f},
+          {s.z, u.z, -f.z, 0.0f},
+          {-dot(s, eye), -dot(u, eye), dot(f, eye), 1.0f}};
+}
+
+// unit quaternion rotations; w is the scalar part
+struct quat {
+  float x = 0.0f, y = 0.0f, z = 0.0f, w = 1.0f;
+
+  constexpr quat() = default;
+  constexpr quat(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+
+  static quat fromAxisAngle(const vec3& axis, float radians) {
+    const vec3 a = normalize(axis) * std::sin(radians * 0.5f);
+    return {a.x, a.y, a.z, std::cos(radians * 0.5f)};
+  }
+
+  constexpr vec3 xyz() const { return {x, y, z}; }
+};
+
+// a * b rotates by b first, then by a
+constexpr quat operator*(const quat& a, const quat& b) {
+  return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y, a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+          a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w, a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+constexpr quat conjugate(const quat& q) { return {-q.x, -q.y, -q.z, q.w}; }
+constexpr float dot(const quat& a, const quat& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+inline quat normalize(const quat& q) {
+  const float invLength = 1.0f / std::sqrt(dot(q, q));
+  return {q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength};
+}
+
+constexpr vec3 rotate(const quat& q, const vec3& v) {
+  const vec3 u = q.xyz();
+  const vec3 t = cross(u, v) * 2.0f;
+  return v + t * q.w + cross(u, t);
+}
+
+// shortest path; falls back to a normalized lerp when the rotations are nearly equal
+// ------------------------------------------------------------------------
+inline quat slerp(const quat& a, quat b, float t) {
+  float cosTheta = dot(a, b);
+  if (cosTheta < 0.0f) {
+    b = {-b.x, -b.y, -b.z, -b.w};
+    cosTheta = -cosTheta;
+  }
+  float wa = 1.0f - t;
+  float wb = t;
+  if (cosTheta < 0.9995f) {
+    const float theta = std::acos(cosTheta);
+    const float invSin = 1.0f / std::sin(theta);
+    wa = std::sin(wa * theta) * invSin;
+    wb = std::sin(wb * theta) * invSin;
+  }
+  return normalize(quat(a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb));
+}
+
+constexpr mat3 toMat3(const quat& q) {
+  const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  return {{1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy)},
+          {2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx)},
+          {2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)}};
+}
+
+// translation * rotation * scale
+constexpr mat4 compose(const vec3& translation, const quat& rotation, const vec3& scaling) {
+  const mat3 r = toMat3(rotation);
+  return {{r[0] * scaling.x, 0.0f}, {r[1] * scaling.y, 0.0f}, {r[2] * scaling.z, 0.0f}, {translation, 1.0f}};
+}
+
+// ---- batch operations ----------------------------------------------------
+
+// structure-of-arrays points: x[i], y[i], z[i] is point i
+struct Vec3SoA {
+  std::vector<float> x, y, z;
+
+  std::size_t size() const { return x.size(); }
+  void resize(std::size_t count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+  }
+  void set(std::size_t i, const vec3& v) {
+    x[i] = v.x;
+    y[i] = v.y;
+    z[i] = v.z;
+  }
+  vec3 get(std::size_t i) const { return {x[i], y[i], z[i]}; }
+};
+
+// out = m * (in, 1) for count points given as separate x / y / z streams; outW receives the
+// w component for projective matrices and may be null. in and out may be the same streams.
+// ------------------------------------------------------------------------
+inline void transformPoints(const mat4& m, const float* inX, const float* inY, const float* inZ, float* outX,
+                            float* outY, float* outZ, float* outW, std::size_t count) {
+  std::size_t i = 0;
+#if defined(SIMD_MATH_AVX)
+  {
+    // 8 matrix-vector products per iteration, the matrix lives in 16 broadcast registers
+    __m256 c[4][4];
+    for (int column = 0; column < 4; ++column) {
+      c[column][0] = _mm256_set1_ps(m[column].x);
+      c[column][1] = _mm256_set1_ps(m[column].y);
+      c[column][2] = _mm256_set1_ps(m[column].z);
+      c[column][3] = _mm256_set1_ps(m[column].w);
+    }
+    for (; i + 8 <= count; i += 8) {
+      const __m256 x = _mm256_loadu_ps(inX + i);
+      const __m256 y = _mm256_loadu_ps(inY + i);
+      const __m256 z = _mm256_loadu_ps(inZ + i);
+      for (int row = 0; row < 4; ++row) {
+        float* out = row == 0 ? outX : row == 1 ? outY : row == 2 ? outZ : outW;
+        if (out == nullptr) {
+          continue;
+        }
+        __m256 sum = _mm256_add_ps(c[3][row], _mm256_mul_ps(c[0][row], x));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(c[1][row], y));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(c[2][row], z));
+        _mm256_storeu_ps(out + i, sum);
+      }
+    }
+  }
+#elif defined(SIMD_MATH_SSE)
+  {
+    __m128 c[4][4];
+    for (int column = 0; column < 4; ++column) {
+      c[column][0] = _mm_set1_ps(m[column].x);
+      c[column][1] = _mm_set1_ps(m[column].y);
+      c[column][2] = _mm_set1_ps(m[column].z);
+      c[column][3] = _mm_set1_ps(m[column].w);
+    }
+    for (; i + 4 <= count; i += 4) {
+      const __m128 x = _mm_loadu_ps(inX + i);
+      const __m128 y = _mm_loadu_ps(inY + i);
+      const __m128 z = _mm_loadu_ps(inZ + i);
+      for (int row = 0; row < 4; ++row) {
+        float* out = row == 0 ? outX : row == 1 ? outY : row == 2 ? outZ : outW;
+        if (out == nullptr) {
+          continue;
+        }
+        __m128 sum = _mm_add_ps(c[3][row], _mm_mul_ps(c[0][row], x));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c[1][row], y));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c[2][row], z));
+        _mm_storeu_ps(out + i, sum);
+      }
+    }
+  }
+#elif defined(SIMD_MATH_NEON)
+  {
+    const float* e = m.data();  // e[column * 4 + row]
+    for (; i + 4 <= count; i += 4) {
+      const float32x4_t x = vld1q_f32(inX + i);
+      const float32x4_t y = vld1q_f32(inY + i);
+      const float32x4_t z = vld1q_f32(inZ + i);
+      for (int row = 0; row < 4; ++row) {
+        float* out = row == 0 ? outX : row == 1 ? outY : row == 2 ? outZ : outW;
+        if (out == nullptr) {
+          continue;
+        }
+        float32x4_t sum = vmlaq_n_f32(vdupq_n_f32(e[12 + row]), x, e[row]);
+        sum = vmlaq_n_f32(sum, y, e[4 + row]);
+        sum = vmlaq_n_f32(sum, z, e[8 + row]);
+        vst1q_f32(out + i, sum);
+      }
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    const vec4 p = m * vec4(inX[i], inY[i], inZ[i], 1.0f);
+    outX[i] = p.x;
+    outY[i] = p.y;
+    outZ[i] = p.z;
+    if (outW != nullptr) {
+      outW[i] = p.w;
+    }
+  }
+}
+
+inline void transformPoints(const mat4& m, const Vec3SoA& in, Vec3SoA& out) {
+  out.resize(in.size());
+  transformPoints(m, in.x.data(), in.y.data(), in.z.data(), out.x.data(), out.y.data(), out.z.data(), nullptr,
+                  in.size());
+}
+
+// out[i] = parent * locals[i], e.g. local to world for all children of one node
+inline void multiplyMatrices(const mat4& parent, const mat4* locals, mat4* out, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    out[i] = parent * locals[i];
+  }
+}
+
+// out[i] = a[i] * b[i]
+inline void multiplyMatrices(const mat4* a, const mat4* b, mat4* out, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+}  // namespace math
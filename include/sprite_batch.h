@@ -0,0 +1,166 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "logger.h"
+#include "mesh_pool.h"
+#include "stream_buffer.h"
+#include "uniform_buffer.h"
+
+// per-instance data of one sprite, matching the instance attributes of shaders/sprite.vs
+struct SpriteInstance {
+  float axisX[2];      // the quad's x axis in world units (scale and rotation)
+  float axisY[2];
+  float position[3];   // centre; z is passed on as depth
+  float layer;         // layer of the texture array
+  float uvRect[4];     // u0, v0, u1, v1
+  std::uint32_t tint;  // RGBA8, see packTint()
+
+  static constexpr std::uint32_t packTint(std::uint8_t r, std::uint8_t g, std::uint8_t b, std::uint8_t a = 255) {
+    return std::uint32_t{r} | std::uint32_t{g} << 8 | std::uint32_t{b} << 16 | std::uint32_t{a} << 24;
+  }
+
+  // width x height sprite centred on (x, y), rotated counter-clockwise by rotation radians
+  static SpriteInstance make(float x, float y, float width, float height, float rotation = 0.0f, float layer = 0.0f) {
+    const float c = std::cos(rotation);
+    const float s = std::sin(rotation);
+    return {{c * width, s * width}, {-s * height, c * height}, {x, y, 0.0f}, layer, {0.0f, 0.0f, 1.0f, 1.0f},
+            packTint(255, 255, 255)};
+  }
+};
+
+// the SpriteFrame block of shaders/sprite_frame.glsl; attach it with
+// Shader::bindUniformBlock("SpriteFrame", binding)
+struct SpriteFrameBlock {
+  glsl::mat4 viewProjection;
+  glsl::vec4 tint;
+};
+
+static_assert(checkBlockLayout<SpriteFrameBlock>(BlockLayout::Std140, {BLOCK_MEMBER(SpriteFrameBlock, viewProjection),
+                                                                       BLOCK_MEMBER(SpriteFrameBlock, tint)}));
+
+// Draws any number of textured quads with one glDrawElementsInstancedBaseVertex per
+// instanceCapacity sprites instead of one draw call each.
+//
+// The quad is a mesh of a MeshPool whose vertex format puts the position at location 0 and the
+// texture coords at location 2, e.g. the unit quad of unit_quad.h that main.cpp draws. The batch
+// owns a vertex array that reads the per-vertex attributes from the pool's buffers and adds a
+// per-instance stream (divisor 1) for SpriteInstance. add() only appends on the CPU; draw()
+// uploads the instances and issues the draws. With a StreamBuffer the instances are written
+// into its current frame region and the instance attributes are pointed at them; otherwise the
+// batch's own buffer is orphaned per upload. Apply a pipeline whose vertexArray is
+// vertexArray() and bind a GL_TEXTURE_2D_ARRAY before draw().
+class SpriteBatch {
+ public:
+  static constexpr GLuint kFirstInstanceAttribute = 3;
+
+  // ------------------------------------------------------------------------
+  SpriteBatch(GlResourceRegistry& resources, GlStateCache& glState, const MeshPool& quadPool, MeshHandle quad,
+              std::size_t instanceCapacity, quill::Logger* logger, StreamBuffer* stream = nullptr)
+      : quadPool_(quadPool),
+        capacity_(std::max<std::size_t>(instanceCapacity, 1)),
+        logger_(logger),
+        stream_(stream),
+        vertexArray_(GlVertexArray::generate(resources)),
+        instanceBuffer_(GlBuffer::generate(resources)) {
+    instances_.reserve(capacity_);
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_.get());
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity_ * sizeof(SpriteInstance)), nullptr,
+                 GL_STREAM_DRAW);
+    attachQuad(glState, quad);
+  }
+
+  // (re)build the vertex array from the quad's pool; again after MeshPool::defragment()
+  // ------------------------------------------------------------------------
+  void attachQuad(GlStateCache& glState, MeshHandle quad) {
+    quad_ = quadPool_.range(quad);
+    quadPool_.attachTo(glState, vertexArray_.get());
+    glState.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_.get());
+    pointInstanceAttributes(0);
+    streamed_ = false;
+    for (GLuint i = 0; i < 4; ++i) {
+      glVertexAttribDivisor(kFirstInstanceAttribute + i, 1);
+      glEnableVertexAttribArray(kFirstInstanceAttribute + i);
+    }
+    glState.bindVertexArray(0);
+  }
+
+  GLuint vertexArray() const { return vertexArray_.get(); }
+  std::size_t size() const { return instances_.size(); }
+
+  void clear() { instances_.clear(); }
+  void add(const SpriteInstance& sprite) { instances_.push_back(sprite); }
+
+  // upload and draw everything added since clear(); returns the number of draw calls
+  // ------------------------------------------------------------------------
+  std::size_t draw(GlStateCache& glState) {
+    glState.bindVertexArray(vertexArray_.get());
+    std::size_t drawCalls = 0;
+    for (std::size_t first = 0; first < instances_.size(); first += capacity_) {
+      const std::size_t count = std::min(capacity_, instances_.size() - first);
+      const std::size_t bytes = count * sizeof(SpriteInstance);
+      StreamRange range;
+      if (stream_ != nullptr) {
+        range = stream_->write(instances_.data() + first, bytes, alignof(SpriteInstance));
+      }
+      if (range.valid()) {
+        glState.bindBuffer(GL_ARRAY_BUFFER, stream_->buffer());
+        pointInstanceAttributes(static_cast<std::size_t>(range.offset));
+        streamed_ = true;
+      } else {
+        glState.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_.get());
+        if (streamed_) {
+          pointInstanceAttributes(0);
+          streamed_ = false;
+        }
+        // orphan the previous contents so the driver never waits for draws still reading them
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity_ * sizeof(SpriteInstance)), nullptr,
+                     GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(bytes), instances_.data() + first);
+      }
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(quad_.indexCount), GL_UNSIGNED_INT,
+                                        reinterpret_cast<const void*>(std::size_t{quad_.firstIndex} * sizeof(GLuint)),
+                                        static_cast<GLsizei>(count), quad_.baseVertex);
+      ++drawCalls;
+    }
+    if (instances_.size() > capacity_ && !warnedChunks_) {
+      LOG_WARNING(logger_, "sprite batch: {} sprites need {} draws of {}, consider a larger capacity",
+                  instances_.size(), drawCalls, capacity_);
+      warnedChunks_ = true;
+    }
+    return drawCalls;
+  }
+
+ private:
+  const MeshPool& quadPool_;
+  MeshRange quad_;
+  std::size_t capacity_;
+  quill::Logger* logger_;
+  StreamBuffer* stream_;
+  bool streamed_ = false;  // attributes currently point into stream_
+  GlVertexArray vertexArray_;
+  GlBuffer instanceBuffer_;
+  std::vector<SpriteInstance> instances_;
+  bool warnedChunks_ = false;
+
+  // the instance attributes read from the buffer bound to GL_ARRAY_BUFFER, starting at base
+  static void pointInstanceAttributes(std::size_t base) {
+    auto at = [base](std::size_t member) { return reinterpret_cast<const void*>(base + member); };
+    const GLsizei stride = sizeof(SpriteInstance);
+    glVertexAttribPointer(kFirstInstanceAttribute, 4, GL_FLOAT, GL_FALSE, stride, at(offsetof(SpriteInstance, axisX)));
+    glVertexAttribPointer(kFirstInstanceAttribute + 1, 4, GL_FLOAT, GL_FALSE, stride,
+                          at(offsetof(SpriteInstance, position)));
+    glVertexAttribPointer(kFirstInstanceAttribute + 2, 4, GL_FLOAT, GL_FALSE, stride,
+                          at(offsetof(SpriteInstance, uvRect)));
+    glVertexAttribPointer(kFirstInstanceAttribute + 3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          at(offsetof(SpriteInstance, tint)));
+  }
+};
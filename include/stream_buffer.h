@@ -0,0 +1,216 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+
+// a bump allocation from the current frame's region
+struct StreamRange {
+  GLintptr offset = 0;  // from the start of the buffer, for glBindBufferRange / attribute pointers
+  GLsizeiptr size = 0;
+  void* data = nullptr;  // write the contents here, then call StreamBuffer::flush()
+
+  bool valid() const { return data != nullptr; }
+};
+
+// The bookkeeping half of StreamBuffer: one region per frame in flight, the bump head inside
+// the current one and the fence that guards each region. It never touches GL; StreamBuffer
+// creates the fences and waits on the ones beginFrame() hands back.
+class StreamAllocator {
+ public:
+  static constexpr std::size_t kNoSpace = SIZE_MAX;
+
+  // regionAlignment: every allocation alignment used later must divide it
+  StreamAllocator(std::size_t bytesPerFrame, std::size_t frames, std::size_t regionAlignment)
+      : regionSize_(align(bytesPerFrame, regionAlignment)), fences_(frames < 1 ? 1 : frames, nullptr) {}
+
+  std::size_t frames() const { return fences_.size(); }
+  std::size_t regionSize() const { return regionSize_; }
+  std::size_t totalSize() const { return regionSize_ * fences_.size(); }
+  std::size_t frame() const { return frame_; }
+  std::size_t regionOffset() const { return frame_ * regionSize_; }
+  std::size_t used() const { return head_; }
+  std::uint64_t exhausted() const { return exhausted_; }
+
+  // move on to the next region; returns the fence of the frame that last wrote it (nullptr if
+  // none), which the caller has to wait on and delete before writing
+  // ------------------------------------------------------------------------
+  GLsync beginFrame() {
+    frame_ = (frame_ + 1) % fences_.size();
+    head_ = 0;
+    return std::exchange(fences_[frame_], nullptr);
+  }
+
+  // offset from the start of the buffer, kNoSpace when the region is full
+  // ------------------------------------------------------------------------
+  std::size_t allocate(std::size_t size, std::size_t alignment) {
+    const std::size_t begin = align(head_, alignment);
+    if (begin > regionSize_ || size > regionSize_ - begin) {
+      ++exhausted_;
+      return kNoSpace;
+    }
+    head_ = begin + size;
+    return regionOffset() + begin;
+  }
+
+  // fence the current region; it is handed back when beginFrame() comes round to it again
+  void endFrame(GLsync fence) { fences_[frame_] = fence; }
+
+  // fences still outstanding, e.g. to delete them on shutdown
+  const std::vector<GLsync>& fences() const { return fences_; }
+
+ private:
+  std::size_t regionSize_;
+  std::size_t head_ = 0;
+  std::size_t frame_ = 0;
+  std::vector<GLsync> fences_;
+  std::uint64_t exhausted_ = 0;
+
+  static std::size_t align(std::size_t value, std::size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+};
+
+// Fence-synchronized ring for data that is rewritten every frame: dynamic vertices, indices
+// and uniform blocks can all share it, the buffer object is bound to whatever target a range
+// is used with.
+//
+// The buffer is split into one region per frame in flight (see StreamAllocator). beginFrame()
+// waits on the fence of the region it reuses, allocate() bumps through that region and
+// endFrame() fences it. With GL_ARB_buffer_storage the buffer is persistently and coherently
+// mapped, data points straight into it and flush() does nothing. Without it data points into a
+// staging copy of the region and flush() uploads it with glBufferSubData. stalls() counts the
+// frames in which the CPU had caught up with the GPU and had to wait.
+//
+// Creating, flushing and unmapping bind GL_COPY_WRITE_BUFFER.
+class StreamBuffer {
+ public:
+  // regionAlignment: every allocation alignment used later must divide it
+  // ------------------------------------------------------------------------
+  StreamBuffer(GLsizeiptr bytesPerFrame, quill::Logger* logger, std::size_t frames = 3,
+               std::size_t regionAlignment = 256)
+      : logger_(logger), regions_(static_cast<std::size_t>(bytesPerFrame), frames, regionAlignment) {
+    auto total = static_cast<GLsizeiptr>(regions_.totalSize());
+
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    if (GLAD_GL_ARB_buffer_storage) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+      mapped_ = static_cast<std::uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+    }
+    if (mapped_ == nullptr) {
+      if (GLAD_GL_ARB_buffer_storage) {
+        // immutable storage cannot be respecified, start over with a mutable buffer
+        glDeleteBuffers(1, &buffer_);
+        glGenBuffers(1, &buffer_);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+      }
+      glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_DYNAMIC_DRAW);
+      staging_.resize(regions_.regionSize());
+      LOG_INFO(logger_, "stream buffer: persistent mapping unavailable, falling back to glBufferSubData");
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  ~StreamBuffer() {
+    for (GLsync fence : regions_.fences()) {
+      if (fence != nullptr) {
+        glDeleteSync(fence);
+      }
+    }
+    if (mapped_ != nullptr) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  GLuint buffer() const { return buffer_; }
+  bool persistent() const { return mapped_ != nullptr; }
+  std::size_t frames() const { return regions_.frames(); }
+  std::size_t regionSize() const { return regions_.regionSize(); }
+
+  // ------------------------------------------------------------------------
+  void beginFrame() {
+    if (GLsync fence = regions_.beginFrame(); fence != nullptr) {
+      // the region was last used frames() ago, this only blocks if the GPU is that far behind
+      if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        ++stalls_;
+        auto start = std::chrono::steady_clock::now();
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        stallMs_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      }
+      glDeleteSync(fence);
+    }
+  }
+
+  // returns an invalid range when the region is full
+  // ------------------------------------------------------------------------
+  StreamRange allocate(std::size_t size, std::size_t alignment = 16) {
+    const std::size_t offset = regions_.allocate(size, alignment);
+    if (offset == StreamAllocator::kNoSpace) {
+      if (regions_.exhausted() == 1) {
+        LOG_ERROR(logger_, "stream buffer: frame region of {} bytes exhausted", regions_.regionSize());
+      }
+      return {};
+    }
+    StreamRange range;
+    range.offset = static_cast<GLintptr>(offset);
+    range.size = static_cast<GLsizeiptr>(size);
+    range.data = mapped_ != nullptr ? mapped_ + offset : staging_.data() + (offset - regions_.regionOffset());
+    return range;
+  }
+
+  // make the range's contents visible to the GPU
+  // ------------------------------------------------------------------------
+  void flush(const StreamRange& range) {
+    if (mapped_ != nullptr || !range.valid()) {
+      return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, range.size, range.data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // allocate, copy and flush in one go
+  // ------------------------------------------------------------------------
+  StreamRange write(const void* data, std::size_t size, std::size_t alignment = 16) {
+    StreamRange range = allocate(size, alignment);
+    if (range.valid()) {
+      std::memcpy(range.data, data, size);
+      flush(range);
+    }
+    return range;
+  }
+
+  // after the frame's last draw that reads from the buffer
+  // ------------------------------------------------------------------------
+  void endFrame() { regions_.endFrame(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)); }
+
+  std::uint64_t stalls() const { return stalls_; }
+  double stallMs() const { return stallMs_; }
+  std::uint64_t exhausted() const { return regions_.exhausted(); }  // failed allocations
+  std::size_t used() const { return regions_.used(); }              // bytes of the current region
+
+ private:
+  quill::Logger* logger_;
+  GLuint buffer_ = 0;
+  std::uint8_t* mapped_ = nullptr;
+  std::vector<std::uint8_t> staging_;  // one region, only without persistent mapping
+  StreamAllocator regions_;
+  std::uint64_t stalls_ = 0;
+  double stallMs_ = 0.0;
+};
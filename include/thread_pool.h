@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops.
+//
+// parallelFor(count, fn) calls fn(index, worker) for every index in [0, count) and returns
+// once all calls have finished; the calling thread works along as worker 0. Indices are
+// handed out dynamically, so which worker runs which index varies between runs: results
+// should be written by index (e.g. one CommandList per index), not by worker, when the
+// order matters. parallelFor is not reentrant and must only be called from one thread.
+class ThreadPool {
+ public:
+  // ------------------------------------------------------------------------
+  explicit ThreadPool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+    for (std::size_t worker = 1; worker < threads; ++worker) {
+      workers_.emplace_back([this, worker] { workerLoop(worker); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // number of threads that run work, including the caller of parallelFor
+  std::size_t size() const { return workers_.size() + 1; }
+
+  // ------------------------------------------------------------------------
+  template <typename Fn>
+  void parallelFor(std::size_t count, Fn&& fn) {
+    if (workers_.empty() || count <= 1) {
+      for (std::size_t index = 0; index < count; ++index) {
+        fn(index, std::size_t{0});
+      }
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      context_ = &fn;
+      invoke_ = [](void* context, std::size_t index, std::size_t worker) {
+        (*static_cast<std::remove_reference_t<Fn>*>(context))(index, worker);
+      };
+      count_ = count;
+      next_.store(0, std::memory_order_relaxed);
+      busy_ = workers_.size();
+      ++generation_;
+    }
+    wake_.notify_all();
+    drain(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool stop_ = false;
+  std::uint64_t generation_ = 0;
+  std::size_t busy_ = 0;
+
+  // the current loop; a plain function pointer so that parallelFor never allocates
+  void* context_ = nullptr;
+  void (*invoke_)(void*, std::size_t, std::size_t) = nullptr;
+  std::size_t count_ = 0;
+  std::atomic<std::size_t> next_{0};
+
+  void drain(std::size_t worker) {
+    for (std::size_t index; (index = next_.fetch_add(1, std::memory_order_relaxed)) < count_;) {
+      invoke_(context_, index, worker);
+    }
+  }
+
+  void workerLoop(std::size_t worker) {
+    std::uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+      drain(worker);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0) {
+          done_.notify_one();
+        }
+      }
+    }
+  }
+};
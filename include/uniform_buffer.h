@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+
+#include "gl_state.h"
+#include "logger.h"
+#include "simd_math.h"
+#include "stream_buffer.h"
+
+// GLSL block types. vec3 deliberately keeps a C++ size of 12 so a scalar can follow it the way
+// std140 packs it; put alignas(16) on a vec3 member yourself (the layout check below catches it
+// if you forget).
+namespace glsl {
+struct alignas(8) vec2 {
+  float x, y;
+};
+struct vec3 {
+  float x, y, z;
+};
+struct alignas(16) vec4 {
+  float x, y, z, w;
+};
+struct alignas(16) ivec4 {
+  std::int32_t x, y, z, w;
+};
+// matrices are column-major; every column occupies a vec4 slot in both std140 and std430
+struct alignas(16) mat3 {
+  vec4 columns[3];
+};
+struct alignas(16) mat4 {
+  vec4 columns[4];
+};
+
+// math::mat4 is column-major too, so this is a plain copy
+inline mat4 toMat4(const math::mat4& m) {
+  static_assert(sizeof(math::mat4) == sizeof(mat4));
+  return std::bit_cast<mat4>(m);
+}
+}  // namespace glsl
+
+enum class BlockLayout { Std140, Std430 };
+
+// base alignment and size of a GLSL type inside a uniform / storage block
+// ------------------------------------------------------------------------
+struct BlockTypeInfo {
+  std::size_t alignment;
+  std::size_t size;
+};
+
+template <typename T>
+constexpr BlockTypeInfo blockTypeInfo() {
+  if constexpr (std::is_same_v<T, float> || std::is_same_v<T, std::int32_t> || std::is_same_v<T, std::uint32_t>) {
+    return {4, 4};
+  } else if constexpr (std::is_same_v<T, glsl::vec2>) {
+    return {8, 8};
+  } else if constexpr (std::is_same_v<T, glsl::vec3>) {
+    return {16, 12};
+  } else if constexpr (std::is_same_v<T, glsl::vec4> || std::is_same_v<T, glsl::ivec4>) {
+    return {16, 16};
+  } else if constexpr (std::is_same_v<T, glsl::mat3>) {
+    return {16, 48};
+  } else if constexpr (std::is_same_v<T, glsl::mat4>) {
+    return {16, 64};
+  } else {
+    static_assert(sizeof(T) == 0, "not a GLSL block type (bool: use std::int32_t)");
+  }
+}
+
+constexpr std::size_t alignUp(std::size_t value, std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// where the GLSL compiler puts a member, and where the C++ compiler actually put it
+// ------------------------------------------------------------------------
+struct BlockMember {
+  std::size_t offset;     // offsetof() in the C++ struct
+  BlockTypeInfo type;     // element type
+  std::size_t count;      // 0 for a non-array member
+  std::size_t cppStride;  // sizeof(element) in C++, only checked for arrays
+
+  // std140 rounds array elements up to a vec4; std430 only to the element alignment
+  constexpr std::size_t alignment(BlockLayout layout) const {
+    return count > 0 && layout == BlockLayout::Std140 ? alignUp(type.alignment, 16) : type.alignment;
+  }
+  constexpr std::size_t stride(BlockLayout layout) const { return alignUp(type.size, alignment(layout)); }
+  constexpr std::size_t size(BlockLayout layout) const { return count > 0 ? stride(layout) * count : type.size; }
+};
+
+template <typename T>
+struct BlockMemberOf {
+  static constexpr BlockMember make(std::size_t offset) { return {offset, blockTypeInfo<T>(), 0, sizeof(T)}; }
+};
+
+template <typename T, std::size_t N>
+struct BlockMemberOf<T[N]> {
+  static constexpr BlockMember make(std::size_t offset) { return {offset, blockTypeInfo<T>(), N, sizeof(T)}; }
+};
+
+// BLOCK_MEMBER(Struct, member) describes one member for checkBlockLayout()
+#define BLOCK_MEMBER(Struct, member) BlockMemberOf<decltype(Struct::member)>::make(offsetof(Struct, member))
+
+// Replays the GLSL layout rules over the members (in declaration order) and compares every
+// offset, array stride and the total size with what the C++ compiler produced. Assert it next
+// to each block struct, as sprite_batch.h does for SpriteFrameBlock.
+// ------------------------------------------------------------------------
+template <typename Struct>
+constexpr bool checkBlockLayout(BlockLayout layout, std::initializer_list<BlockMember> members) {
+  static_assert(std::is_standard_layout_v<Struct> && std::is_trivially_copyable_v<Struct>,
+                "uniform blocks are copied byte for byte");
+  std::size_t offset = 0;
+  std::size_t blockAlignment = layout == BlockLayout::Std140 ? 16 : 4;
+  for (const auto& member : members) {
+    offset = alignUp(offset, member.alignment(layout));
+    if (member.offset != offset || (member.count > 0 && member.cppStride != member.stride(layout))) {
+      return false;
+    }
+    offset += member.size(layout);
+    blockAlignment = member.alignment(layout) > blockAlignment ? member.alignment(layout) : blockAlignment;
+  }
+  return sizeof(Struct) == alignUp(offset, blockAlignment);
+}
+
+// a sub-range of the ring, ready for glBindBufferRange
+struct UniformSlice {
+  GLintptr offset = 0;
+  GLsizeiptr size = 0;
+};
+
+// Triple-buffered uniform ring.
+//
+// A StreamBuffer whose allocations follow GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. Each frame
+// writes its per-frame and per-draw blocks with push() and binds them with bind(), a single
+// glBindBufferRange per block instead of one glUniform* call per value. beginFrame() waits on
+// the fence of the region being reused, so the CPU never overwrites data the GPU still reads.
+class UniformRing {
+ public:
+  static constexpr std::size_t kFrames = 3;
+
+  UniformRing(GLsizeiptr bytesPerFrame, quill::Logger* logger)
+      : alignment_(uniformOffsetAlignment()), stream_(bytesPerFrame, logger, kFrames, alignUp(256, alignment_)) {}
+
+  GLuint buffer() const { return stream_.buffer(); }
+  StreamBuffer& stream() { return stream_; }
+
+  void beginFrame() { stream_.beginFrame(); }
+
+  // copy one block into this frame's region; returns an empty slice when the region is full
+  // ------------------------------------------------------------------------
+  template <typename Block>
+  UniformSlice push(const Block& block) {
+    static_assert(std::is_trivially_copyable_v<Block>, "uniform blocks are copied byte for byte");
+    return pushBytes(&block, sizeof(Block));
+  }
+
+  // untyped push(), for blocks that were recorded as bytes (see CommandList)
+  // ------------------------------------------------------------------------
+  UniformSlice pushBytes(const void* data, std::size_t size) {
+    StreamRange range = stream_.write(data, size, alignment_);
+    return {range.offset, range.size};
+  }
+
+  // through the state cache, which skips rebinding the same range
+  // ------------------------------------------------------------------------
+  void bind(GlStateCache& glState, GLuint binding, UniformSlice slice) const {
+    glState.bindBufferRange(GL_UNIFORM_BUFFER, binding, stream_.buffer(), slice.offset, slice.size);
+  }
+
+  // after the frame's last draw that reads from the ring
+  void endFrame() { stream_.endFrame(); }
+
+ private:
+  std::size_t alignment_;
+  StreamBuffer stream_;
+
+  static std::size_t uniformOffsetAlignment() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return static_cast<std::size_t>(alignment);
+  }
+};
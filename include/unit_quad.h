@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+
+#include "mesh_pool.h"
+#include "vertex_layout.h"
+
+// The textured quad main.cpp draws and SpriteBatch instances, in one vertex format.
+
+// 16 bytes per vertex: half float position, unorm8 color, unorm16 texture coords
+struct QuadVertex {
+  Half4 position;
+  Unorm8x4 color;
+  Unorm16x2 texCoord;
+  using Layout = VertexLayout<Attribute<0, Half4>, Attribute<1, Unorm8x4>, Attribute<2, Unorm16x2>>;
+};
+static_assert(VertexLayoutMatches<QuadVertex>);
+
+// 1 x 1, centred on the origin, with a color per corner
+// ------------------------------------------------------------------------
+inline std::array<QuadVertex, 4> unitQuadVertices() {
+  return {{
+      {Half4::make(0.5f, 0.5f, 0.0f), Unorm8x4::make(1.0f, 0.0f, 0.0f), Unorm16x2::make(1.0f, 1.0f)},    // top right
+      {Half4::make(0.5f, -0.5f, 0.0f), Unorm8x4::make(0.0f, 1.0f, 0.0f), Unorm16x2::make(1.0f, 0.0f)},   // bottom right
+      {Half4::make(-0.5f, -0.5f, 0.0f), Unorm8x4::make(0.0f, 0.0f, 1.0f), Unorm16x2::make(0.0f, 0.0f)},  // bottom left
+      {Half4::make(-0.5f, 0.5f, 0.0f), Unorm8x4::make(1.0f, 1.0f, 0.0f), Unorm16x2::make(0.0f, 1.0f)}    // top left
+  }};
+}
+
+inline constexpr std::array<GLuint, 6> kUnitQuadIndices = {
+    0, 1, 3,  // first triangle
+    1, 2, 3   // second triangle
+};
+
+// a MeshPool of QuadVertex meshes, sized for vertices / indices
+// ------------------------------------------------------------------------
+inline MeshPool makeQuadPool(GlResourceRegistry& resources, GlStateCache& glState, GLuint vertices, GLuint indices,
+                             quill::Logger* logger) {
+  return MeshPool(resources, glState, QuadVertex::Layout::stride, vertices, indices,
+                  [] { QuadVertex::Layout::apply(); }, logger);
+}
+
+// upload the unit quad into a pool made by makeQuadPool()
+// ------------------------------------------------------------------------
+inline MeshHandle addUnitQuad(MeshPool& pool) {
+  const std::array<QuadVertex, 4> vertices = unitQuadVertices();
+  return pool.add(vertices.data(), static_cast<GLuint>(vertices.size()), kUnitQuadIndices.data(),
+                  static_cast<GLuint>(kUnitQuadIndices.size()));
+}
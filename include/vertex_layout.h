@@ -0,0 +1,205 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Compact vertex attribute formats and a compile-time description of a vertex struct.
+//
+// A vertex struct lists its members in order and names a matching VertexLayout:
+//
+//   struct Vertex {
+//     Half4 position;
+//     Unorm8x4 color;
+//     Unorm16x2 texCoord;
+//     using Layout = VertexLayout<Attribute<0, Half4>, Attribute<1, Unorm8x4>, Attribute<2, Unorm16x2>>;
+//   };
+//   static_assert(VertexLayoutMatches<Vertex>);
+//
+// Layout::stride and Layout::offset<i> are constants, and Layout::apply() issues the
+// glVertexAttribPointer / glEnableVertexAttribArray calls for the bound vertex array and
+// GL_ARRAY_BUFFER. Every format is a multiple of 4 bytes so each attribute stays 4-byte aligned;
+// normalized formats arrive in the shader as floats (unorm in [0, 1], snorm in [-1, 1]).
+
+// IEEE 754 binary16, rounded to nearest even
+// ------------------------------------------------------------------------
+inline std::uint16_t floatToHalf(float value) {
+  const auto bits = std::bit_cast<std::uint32_t>(value);
+  const std::uint32_t sign = (bits >> 16) & 0x8000u;
+  const std::uint32_t exponent = (bits >> 23) & 0xFFu;
+  std::uint32_t mantissa = bits & 0x7FFFFFu;
+  if (exponent == 0xFF) {
+    return static_cast<std::uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));  // inf / nan
+  }
+  const int halfExponent = static_cast<int>(exponent) - 127 + 15;
+  if (halfExponent >= 31) {
+    return static_cast<std::uint16_t>(sign | 0x7C00u);  // too large: inf
+  }
+
+  std::uint32_t half;
+  std::uint32_t shift;
+  if (halfExponent <= 0) {
+    if (halfExponent < -10) {
+      return static_cast<std::uint16_t>(sign);  // too small: zero
+    }
+    // subnormal: the implicit leading one becomes part of the mantissa
+    mantissa |= 0x800000u;
+    shift = static_cast<std::uint32_t>(14 - halfExponent);
+    half = mantissa >> shift;
+  } else {
+    shift = 13;
+    half = (static_cast<std::uint32_t>(halfExponent) << 10) | (mantissa >> shift);
+  }
+  const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+  const std::uint32_t halfway = 1u << (shift - 1);
+  if (rest > halfway || (rest == halfway && (half & 1u) != 0)) {
+    ++half;  // a carry into the exponent is still the correctly rounded value
+  }
+  return static_cast<std::uint16_t>(sign | half);
+}
+
+inline std::uint8_t toUnorm8(float value) {
+  return static_cast<std::uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+inline std::int8_t toSnorm8(float value) {
+  return static_cast<std::int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+inline std::uint16_t toUnorm16(float value) {
+  return static_cast<std::uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// the formats: components, GL type, normalization and a make() from floats
+
+template <int N>
+struct FloatN {
+  static constexpr GLint kComponents = N;
+  static constexpr GLenum kType = GL_FLOAT;
+  static constexpr GLboolean kNormalized = GL_FALSE;
+  float v[N];
+};
+using Float2 = FloatN<2>;
+using Float3 = FloatN<3>;
+using Float4 = FloatN<4>;
+
+// a vec3 position is stored as Half4 (w is padding the shader does not need to read)
+struct Half4 {
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_HALF_FLOAT;
+  static constexpr GLboolean kNormalized = GL_FALSE;
+  std::uint16_t v[4];
+
+  static Half4 make(float x, float y, float z, float w = 1.0f) {
+    return {{floatToHalf(x), floatToHalf(y), floatToHalf(z), floatToHalf(w)}};
+  }
+};
+
+struct Half2 {
+  static constexpr GLint kComponents = 2;
+  static constexpr GLenum kType = GL_HALF_FLOAT;
+  static constexpr GLboolean kNormalized = GL_FALSE;
+  std::uint16_t v[2];
+
+  static Half2 make(float x, float y) { return {{floatToHalf(x), floatToHalf(y)}}; }
+};
+
+// colors
+struct Unorm8x4 {
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_UNSIGNED_BYTE;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+  std::uint8_t v[4];
+
+  static Unorm8x4 make(float r, float g, float b, float a = 1.0f) {
+    return {{toUnorm8(r), toUnorm8(g), toUnorm8(b), toUnorm8(a)}};
+  }
+};
+
+// low precision directions (tangents, ...)
+struct Snorm8x4 {
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_BYTE;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+  std::int8_t v[4];
+
+  static Snorm8x4 make(float x, float y, float z, float w = 0.0f) {
+    return {{toSnorm8(x), toSnorm8(y), toSnorm8(z), toSnorm8(w)}};
+  }
+};
+
+// texture coordinates in [0, 1]
+struct Unorm16x2 {
+  static constexpr GLint kComponents = 2;
+  static constexpr GLenum kType = GL_UNSIGNED_SHORT;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+  std::uint16_t v[2];
+
+  static Unorm16x2 make(float u, float v) { return {{toUnorm16(u), toUnorm16(v)}}; }
+};
+
+// normals: x, y, z as 10 bit snorm and w as 2 bit snorm (e.g. the tangent's handedness)
+struct Snorm1010102 {
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+  std::uint32_t packed;
+
+  static Snorm1010102 make(float x, float y, float z, float w = 0.0f) {
+    auto field = [](float value, float scale, std::uint32_t mask) {
+      return static_cast<std::uint32_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * scale)) & mask;
+    };
+    return {field(x, 511.0f, 0x3FFu) | field(y, 511.0f, 0x3FFu) << 10 | field(z, 511.0f, 0x3FFu) << 20 |
+            field(w, 1.0f, 0x3u) << 30};
+  }
+};
+
+template <GLuint Location, class Format>
+struct Attribute {
+  static_assert(sizeof(Format) % 4 == 0, "attribute formats have to keep 4-byte alignment");
+  static constexpr GLuint kLocation = Location;
+  using FormatType = Format;
+};
+
+// the attributes in member order; offsets are the running sum of the formats' sizes
+template <class... Attributes>
+struct VertexLayout {
+  static constexpr std::size_t kAttributes = sizeof...(Attributes);
+  static constexpr std::array<std::size_t, kAttributes> kOffsets = [] {
+    std::array<std::size_t, kAttributes> offsets{};
+    std::size_t running = 0;
+    std::size_t i = 0;
+    ((offsets[i++] = running, running += sizeof(typename Attributes::FormatType)), ...);
+    return offsets;
+  }();
+  static constexpr GLsizei stride =
+      static_cast<GLsizei>((std::size_t{0} + ... + sizeof(typename Attributes::FormatType)));
+
+  template <std::size_t I>
+  static constexpr std::size_t offset = kOffsets[I];
+
+  // specify and enable every attribute for the bound vertex array and GL_ARRAY_BUFFER
+  // ------------------------------------------------------------------------
+  static void apply(std::size_t baseOffset = 0) {
+    std::size_t i = 0;
+    (pointAttribute<Attributes>(baseOffset + kOffsets[i++]), ...);
+  }
+
+ private:
+  template <class A>
+  static void pointAttribute(std::size_t at) {
+    using Format = typename A::FormatType;
+    glVertexAttribPointer(A::kLocation, Format::kComponents, Format::kType, Format::kNormalized, stride,
+                          reinterpret_cast<const void*>(at));
+    glEnableVertexAttribArray(A::kLocation);
+  }
+};
+
+// a vertex struct has no padding beyond its layout; member order still has to match
+template <class Vertex>
+constexpr bool VertexLayoutMatches = sizeof(Vertex) == static_cast<std::size_t>(Vertex::Layout::stride);
@@ -6,9 +6,29 @@ layout (location = 2) in vec2 aTexCoord;
 out vec3 ourColor;
 out vec2 TexCoord;
 
+#include "frame.glsl"
+
+#ifdef DRAW_ID
+// drawn through an IndirectBatcher: per draw data is indexed by the draw id,
+// see BatchBlock in src/main.cpp
+layout (location = 7) in uint aDrawId;
+
+layout (std140) uniform Batch {
+	mat4 models[MAX_DRAWS];
+};
+#else
+// per draw, see ObjectBlock in src/main.cpp
+layout (std140) uniform Object {
+	mat4 model;
+};
+#endif
+
 void main()
 {
-	gl_Position = vec4(aPos, 1.0);
+#ifdef DRAW_ID
+	mat4 model = models[aDrawId];
+#endif
+	gl_Position = viewProjection * model * vec4(aPos, 1.0);
 	ourColor = aColor;
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
\ No newline at end of file
@@ -0,0 +1,4 @@
+// per-frame values of the texture shaders, see FrameBlock in src/main.cpp
+layout (std140) uniform Frame {
+	mat4 viewProjection;
+};
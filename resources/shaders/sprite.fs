@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 TexCoord;
+in vec4 Tint;
+
+// all sprite images, one per layer
+uniform sampler2DArray sprites;
+
+void main()
+{
+	FragColor = texture(sprites, TexCoord) * Tint;
+}
\ No newline at end of file
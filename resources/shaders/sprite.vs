@@ -0,0 +1,22 @@
+#version 330 core
+// shared unit quad (see include/unit_quad.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoord;
+// per instance (see SpriteInstance in include/sprite_batch.h)
+layout (location = 3) in vec4 aAxes;          // x axis in .xy, y axis in .zw
+layout (location = 4) in vec4 aPositionLayer; // centre in .xyz, texture array layer in .w
+layout (location = 5) in vec4 aUvRect;        // u0, v0, u1, v1
+layout (location = 6) in vec4 aTint;
+
+out vec3 TexCoord;
+out vec4 Tint;
+
+#include "sprite_frame.glsl"
+
+void main()
+{
+	vec2 world = aPositionLayer.xy + aAxes.xy * aPos.x + aAxes.zw * aPos.y;
+	gl_Position = viewProjection * vec4(world, aPositionLayer.z, 1.0);
+	TexCoord = vec3(mix(aUvRect.xy, aUvRect.zw, aTexCoord), aPositionLayer.w);
+	Tint = aTint * tint;
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+// per-frame values of the sprite shaders, see SpriteFrameBlock in include/sprite_batch.h
+layout (std140) uniform SpriteFrame {
+	mat4 viewProjection;
+	vec4 tint; // multiplies every sprite's own tint
+};
@@ -3,10 +3,26 @@
 #include <GLFW/glfw3.h>
 
 #include <filesystem>
-
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "frame_pacer.h"
+#include "gl_resource.h"
+#include "gl_state.h"
+#include "indirect_batch.h"
 #include "logger.h"
+#include "mesh_pool.h"
+#include "pipeline_state.h"
+#include "program_library.h"
+#include "render_components.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "shader_variants.h"
+#include "shader_watcher.h"
 #include "stb_image.h"
+#include "uniform_buffer.h"
+#include "unit_quad.h"
 // clang-format on
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -15,6 +31,10 @@ void processInput(GLFWwindow* window);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// frames the CPU may queue ahead of the GPU; fewer means lower input latency
+const std::size_t MAX_FRAMES_IN_FLIGHT = 2;
+// with vsync on, sleep before sampling input so it is read just in time for the next refresh
+const bool LATE_LATCH = false;
 
 int main() {
   auto logger = initLogger();
@@ -23,6 +43,11 @@ int main() {
   // glfw: initialize and configure
   // ------------------------------
   glfwInit();
+  // glfw: terminate, clearing all previously allocated GLFW resources. Locals are destroyed in
+  // reverse order, so this runs last, after every GL object below has been deleted.
+  struct GlfwTerminator {
+    ~GlfwTerminator() { glfwTerminate(); }
+  } glfwTerminator;
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -36,7 +61,6 @@ int main() {
   GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", nullptr, nullptr);
   if (window == nullptr) {
     LOG_ERROR(logger, "Failed to create GLFW window");
-    glfwTerminate();
     return -1;
   }
   glfwMakeContextCurrent(window);
@@ -49,54 +73,42 @@ int main() {
     return -1;
   }
 
-  Shader shader("./resources/shaders/4.2.texture.vs", "./resources/shaders/4.2.texture.fs", logger);
+  // linked programs are cached on disk so later runs skip compiling from source
+  ProgramBinaryCache programCache("./shader_cache", logger);
+  // per-program build timings, logged and written to shader_build_report.json once all are built
+  ShaderBuildReport shaderReport(logger);
+  // every bind below goes through the state cache so that unchanged state is not reissued
+  GlStateCache glState;
+  // framebuffer_size_callback sets the viewport through it
+  glfwSetWindowUserPointer(window, &glState);
+  // GL objects owned through handles are deleted once the GPU has finished the frame that released them
+  GlResourceRegistry glResources(glState, logger);
+
+  // all programs are submitted up front and compile while the textures below are loaded
+  ProgramLibrary programs(glResources, logger, &programCache, SHADER_OVERRIDE_DIR, &shaderReport);
+  // the texture shader's permutations, each submitted once however often it is requested
+  ShaderVariantCache textureVariants(programs, "4.2.texture", "shaders/4.2.texture.vs", "shaders/4.2.texture.fs");
+  auto textureProgram = textureVariants.submit({});
+  // the same shader for draws merged by the IndirectBatcher: model matrices come from one Batch
+  // block indexed by draw id. 256 mat4 fill the 16 KB any GL 3.3 uniform block may use.
+  constexpr std::size_t kMaxBatchedDraws = 256;
+  const ShaderDefines batchedDefines{{"DRAW_ID", "1"}, {"MAX_DRAWS", std::to_string(kMaxBatchedDraws)}};
+  auto batchedProgram = textureVariants.submit(batchedDefines);
 
   auto binPath = std::filesystem::current_path();
 
   // set up vertex data (and buffer(s)) and configure vertex attributes
   // ------------------------------------------------------------------
-  GLfloat vertices[] = {
-      // positions        // colors         // texture coords
-      0.5f,  0.5f,  0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,  // top right
-      0.5f,  -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,  // bottom right
-      -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // bottom left
-      -0.5f, 0.5f,  0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f   // top left
-  };
-  GLuint indices[] = {
-      0, 1, 3,  // first triangle
-      1, 2, 3   // second triangle
-  };
-
-  GLuint VBO, VAO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
-
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  // position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  // color attribute
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  // texture coord attribute
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
+  // the quad lives in the mesh pool of its vertex format: one vertex array for every such mesh
+  MeshPool meshPool = makeQuadPool(glResources, glState, 64 * 1024, 192 * 1024, logger);
+  const MeshHandle quad = addUnitQuad(meshPool);
 
   // load and create a texture
   // -------------------------
-  GLuint texture1, texture2;
   // texture 1
   // ---------
-  glGenTextures(1, &texture1);
-  glBindTexture(GL_TEXTURE_2D, texture1);
+  GlTexture texture1 = GlTexture::generate(glResources);
+  glState.bindTexture(0, GL_TEXTURE_2D, texture1.get());
   // set the texture wrapping parameters
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
                   GL_REPEAT);  // set texture wrapping to GL_REPEAT (default wrapping method)
@@ -121,8 +133,8 @@ int main() {
 
   // texture 2
   // ---------
-  glGenTextures(1, &texture2);
-  glBindTexture(GL_TEXTURE_2D, texture2);
+  GlTexture texture2 = GlTexture::generate(glResources);
+  glState.bindTexture(0, GL_TEXTURE_2D, texture2.get());
   // set the texture wrapping parameters
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
                   GL_REPEAT);  // set texture wrapping to GL_REPEAT (default wrapping method)
@@ -147,53 +159,184 @@ int main() {
   }
   stbi_image_free(data);
 
-  // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-  // -------------------------------------------------------------------------------------------
-  shader.use();  // don't forget to activate/use the shader before setting uniforms!
-  // either set it manually like so:
-  glUniform1i(glGetUniformLocation(shader.shaderProgram, "texture1"), 0);
-  // or set it via the texture class
-  shader.setInt("texture2", 1);
+  // collect the programs submitted above
+  // ------------------------------------
+  programs.finish();
+  programCache.logStats();
+  shaderReport.log();
+  shaderReport.writeJson("./shader_build_report.json");
+  Shader* texturedShader = programs.get(textureProgram);
+  if (texturedShader == nullptr) {
+    LOG_ERROR(logger, "Failed to build program: {}", programs.name(textureProgram));
+    return -1;
+  }
+  Shader& shader = *texturedShader;
+  Shader* batchedShaderPtr = programs.get(batchedProgram);
+  if (batchedShaderPtr == nullptr) {
+    LOG_ERROR(logger, "Failed to build program: {}", programs.name(batchedProgram));
+    return -1;
+  }
+  Shader& batchedShader = *batchedShaderPtr;
+
+  // per-frame and per-draw uniforms of the texture shader (shaders/frame.glsl, 4.2.texture.vs),
+  // written into a ring each frame and bound with one glBindBufferRange per block
+  struct FrameBlock {
+    glsl::mat4 viewProjection;
+  };
+  struct ObjectBlock {
+    glsl::mat4 model;
+  };
+  static_assert(checkBlockLayout<FrameBlock>(BlockLayout::Std140, {BLOCK_MEMBER(FrameBlock, viewProjection)}));
+  struct BatchBlock {
+    glsl::mat4 models[kMaxBatchedDraws];
+  };
+  static_assert(checkBlockLayout<ObjectBlock>(BlockLayout::Std140, {BLOCK_MEMBER(ObjectBlock, model)}));
+  static_assert(checkBlockLayout<BatchBlock>(BlockLayout::Std140, {BLOCK_MEMBER(BatchBlock, models)}));
+  constexpr GLuint kFrameBinding = 0;
+  constexpr GLuint kObjectBinding = 1;
+  constexpr GLuint kBatchBinding = 2;
+
+  // tell opengl for each sampler to which texture unit it belongs to and for each uniform block
+  // to which binding point (only has to be done once, and again whenever the program is hot reloaded);
+  // each variant has either the Object or the Batch block, binding the other one does nothing
+  // -------------------------------------------------------------------------------------------------
+  auto bindSlots = [&glState](Shader& shader) {
+    glState.useProgram(shader.shaderProgram);  // don't forget to activate the shader before setting uniforms!
+    // either resolve the location once into a handle:
+    UniformHandle texture1Uniform = shader.uniform("texture1");
+    shader.setInt(texture1Uniform, 0);
+    // or hash the name at compile time
+    shader.setInt(UniformName("texture2"), 1);
+    shader.bindUniformBlock("Frame", kFrameBinding);
+    shader.bindUniformBlock("Object", kObjectBinding);
+    shader.bindUniformBlock("Batch", kBatchBinding);
+  };
+  bindSlots(shader);
+  bindSlots(batchedShader);
+
+  // with SHADER_OVERRIDE_DIR set, edits to its shaders/ are picked up without restarting
+  ShaderWatcher shaderWatcher(SHADER_OVERRIDE_DIR, "shaders", logger, &programCache);
+  shaderWatcher.watch(shader, textureVariants.vertexPath(), textureVariants.fragmentPath());
+  shaderWatcher.watch(batchedShader, textureVariants.vertexPath(), textureVariants.fragmentPath(), batchedDefines);
+
+  // the complete render configuration of the container, created once and applied per draw
+  // -----------------------------------------------------------------------------------------
+  PipelineCache pipelines;
+  PipelineContext pipelineContext(glState);
+  PipelineDesc containerDesc;
+  containerDesc.shader = &shader;
+  containerDesc.vertexArray = meshPool.vertexArray();
+  const PipelineState* containerPipeline = pipelines.create(containerDesc);
+  PipelineDesc batchedDesc = containerDesc;
+  batchedDesc.shader = &batchedShader;
+  const PipelineState* batchedPipeline = pipelines.create(batchedDesc);
+
+  // draws are collected per frame, sorted by state and depth and then issued
+  RenderQueue renderQueue(1024);
+  DrawItem containerDraw;
+  containerDraw.pipeline = containerPipeline;
+  containerDraw.textureSet = renderQueue.addTextureSet({texture1.get(), texture2.get()});
+  const MeshRange quadRange = meshPool.range(quad);
+  containerDraw.count = static_cast<GLsizei>(quadRange.indexCount);
+  containerDraw.offset = quadRange.firstIndex * sizeof(GLuint);
+  containerDraw.baseVertex = quadRange.baseVertex;
+
+  // renderables live in the ECS and are scanned chunk by chunk each frame; the quad is drawn in
+  // clip space, so its transform and the view projection are identities. Its world bounds are
+  // derived from the model space ones by updateBounds(), spread over the thread pool
+  EcsWorld world;
+  world.create(WorldTransform{}, LocalBounds{{0.0f, 0.0f, 0.0f}, 0.71f}, Bounds{}, Renderable{containerDraw, 0});
+  // and a border of small static containers around it, drawn through the indirect batcher
+  constexpr int kGrid = 12;
+  for (int y = 0; y < kGrid; ++y) {
+    for (int x = 0; x < kGrid; ++x) {
+      if (x != 0 && y != 0 && x != kGrid - 1 && y != kGrid - 1) {
+        continue;
+      }
+      const math::vec3 position(-0.92f + x * (1.84f / (kGrid - 1)), -0.92f + y * (1.84f / (kGrid - 1)), 0.0f);
+      world.create(WorldTransform{math::translate(position) * math::scale({0.12f, 0.12f, 1.0f})},
+                   LocalBounds{{0.0f, 0.0f, 0.0f}, 0.71f}, Bounds{}, BatchedMesh{batchedPipeline, quadRange});
+    }
+  }
+  const math::mat4 viewProjection;
+  ThreadPool jobs;
+  // world transforms of the draws submitted this frame, indexed by DrawItem::userData
+  std::vector<math::mat4> models;
+  // triple-buffered, so a frame's blocks are not overwritten while the GPU may still read them
+  UniformRing uniforms(64 * 1024, logger);
+  // merges the batched containers into one glMultiDrawElementsIndirect, its commands streamed
+  // through the uniform ring's buffer; their models go to batchBlock.models[draw id]
+  IndirectBatcher batcher(glResources, glState, uniforms.stream(), kMaxBatchedDraws, logger);
+  batcher.attachDrawIds(glState, meshPool.vertexArray());
+  std::vector<math::mat4> batchedModels;
+  BatchBlock batchBlock{};
+
+  // keeps the CPU at most MAX_FRAMES_IN_FLIGHT frames ahead of the GPU
+  FramePacer framePacer(MAX_FRAMES_IN_FLIGHT, logger);
+  if (LATE_LATCH) {
+    glfwSwapInterval(1);
+    const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    framePacer.setLateLatch(1000.0 / (mode != nullptr && mode->refreshRate > 0 ? mode->refreshRate : 60));
+  }
 
   // render loop
   // -----------
   while (!glfwWindowShouldClose(window)) {
+    // wait for the GPU if it is too far behind, then poll IO events as late as possible
+    framePacer.beginFrame();
+    glfwPollEvents();
+
     // input
     // -----
     processInput(window);
 
+    // swap in any shader that changed on disk since the last frame
+    shaderWatcher.applyPending(bindSlots);
+
     // render
     // ------
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-
-    // render container
-    shader.use();
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    // -------------------------------------------------------------------------------
+    // render container (its texture set binds texture1 and texture2 to units 0 and 1); the
+    // frame block is bound once, each draw's model matrix right before it is drawn
+    uniforms.beginFrame();
+    uniforms.bind(glState, kFrameBinding, uniforms.push(FrameBlock{glsl::toMat4(viewProjection)}));
+    models.clear();
+    updateBounds(world, jobs);
+    submitRenderables(world, renderQueue, viewProjection, nullptr, &models);
+    renderQueue.execute(pipelineContext, glState, [&](const DrawItem& item) {
+      uniforms.bind(glState, kObjectBinding, uniforms.push(ObjectBlock{glsl::toMat4(models[item.userData])}));
+    });
+
+    // then the batched containers: one Batch block, one (multi-)draw
+    batchedModels.clear();
+    submitBatched(world, batcher, viewProjection, batchedModels);
+    for (std::size_t i = 0; i < batchedModels.size(); ++i) {
+      batchBlock.models[i] = glsl::toMat4(batchedModels[i]);
+    }
+    uniforms.bind(glState, kBatchBinding, uniforms.push(batchBlock));
+    glState.bindTexture(0, GL_TEXTURE_2D, texture1.get());
+    glState.bindTexture(1, GL_TEXTURE_2D, texture2.get());
+    batcher.flush(pipelineContext, glState);
+    uniforms.endFrame();
+
+    // glfw: swap buffers (IO events are polled at the top of the loop)
+    // -----------------------------------------------------------------
+    framePacer.markSubmitted();
     glfwSwapBuffers(window);
-    glfwPollEvents();
+    framePacer.endFrame();
+    glResources.endFrame();
   }
 
-  // optional: de-allocate all resources once they've outlived their purpose:
-  // ------------------------------------------------------------------------
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteProgram(shader.shaderProgram);
+  framePacer.logStats();
 
-  // glfw: terminate, clearing all previously allocated GLFW resources.
-  // ------------------------------------------------------------------
-  glfwTerminate();
+  LOG_INFO(logger, "gl state: issued {} calls, skipped {} redundant calls", glState.issuedCalls(),
+           glState.skippedCalls());
+  LOG_INFO(logger, "indirect batcher: {} draws in {} draw calls", batcher.batchedDraws(), batcher.drawCalls());
 
+  // all resources are de-allocated as they go out of scope: the mesh pool, the program library and
+  // the textures release their objects to glResources, which deletes them, then glfw is terminated
   return 0;
 }
 
@@ -210,5 +353,5 @@ void processInput(GLFWwindow* window) {
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
   // make sure the viewport matches the new window dimensions; note that width and
   // height will be significantly larger than specified on retina displays.
-  glViewport(0, 0, width, height);
+  static_cast<GlStateCache*>(glfwGetWindowUserPointer(window))->viewport(0, 0, width, height);
 }
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bvh.h"
+#include "doctest.h"
+
+// Bvh queries against brute force over every object, after build(), refit() and update(), with
+// the tree built on the calling thread and on a ThreadPool.
+
+namespace {
+
+std::vector<Aabb> randomBounds(std::size_t count, std::mt19937& random) {
+  std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+  std::uniform_real_distribution<float> size(0.1f, 5.0f);
+  std::vector<Aabb> bounds(count);
+  for (Aabb& box : bounds) {
+    const math::vec3 center(position(random), position(random), position(random));
+    const math::vec3 extents(size(random), size(random), size(random));
+    box = {center - extents, center + extents};
+  }
+  return bounds;
+}
+
+void moveAll(std::vector<Aabb>& bounds, std::mt19937& random, float distance) {
+  std::uniform_real_distribution<float> step(-distance, distance);
+  for (Aabb& box : bounds) {
+    const math::vec3 delta(step(random), step(random), step(random));
+    box.min += delta;
+    box.max += delta;
+  }
+}
+
+// within rounding distance of a plane the tree and the scalar test may disagree
+bool nearPlane(const Frustum& frustum, const Aabb& box) {
+  const math::vec3 center = box.center();
+  const math::vec3 extents = box.extents();
+  for (const math::vec4& plane : frustum.planes) {
+    const double distance = double{plane.x} * center.x + double{plane.y} * center.y + double{plane.z} * center.z +
+                            plane.w;
+    const double reach = std::fabs(double{plane.x}) * extents.x + std::fabs(double{plane.y}) * extents.y +
+                         std::fabs(double{plane.z}) * extents.z;
+    if (std::fabs(distance + reach) < 1e-2) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// every parent box contains its children, every leaf box its objects: checked through overlap()
+// with a box covering everything, which must return each object exactly once
+void checkStructure(const Bvh& bvh, const std::vector<Aabb>& bounds) {
+  const std::span<const BvhNode> nodes = bvh.nodes();
+  for (const BvhNode& node : nodes) {
+    if (node.leaf()) {
+      CHECK(node.count <= Bvh::kMaxLeafSize);
+      continue;
+    }
+    REQUIRE(node.first + 1 < nodes.size());
+    for (const BvhNode& child : {nodes[node.first], nodes[node.first + 1]}) {
+      CHECK(child.min.x >= node.min.x);
+      CHECK(child.min.y >= node.min.y);
+      CHECK(child.min.z >= node.min.z);
+      CHECK(child.max.x <= node.max.x);
+      CHECK(child.max.y <= node.max.y);
+      CHECK(child.max.z <= node.max.z);
+    }
+  }
+  Aabb everything;
+  for (const Aabb& box : bounds) {
+    everything.grow(box);
+  }
+  std::vector<std::uint32_t> all;
+  bvh.overlap(everything, all);
+  std::sort(all.begin(), all.end());
+  REQUIRE(all.size() == bounds.size());
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    CHECK(all[i] == i);
+  }
+}
+
+void checkCull(const Bvh& bvh, const std::vector<Aabb>& bounds, const Frustum& frustum) {
+  std::vector<std::uint32_t> visible;
+  bvh.cull(frustum, visible);
+  std::vector<char> found(bounds.size(), 0);
+  for (std::uint32_t index : visible) {
+    REQUIRE(index < bounds.size());
+    CHECK(found[index] == 0);  // at most once
+    found[index] = 1;
+  }
+  std::size_t expectedCount = 0;
+  for (std::size_t i = 0; i < bounds.size(); ++i) {
+    const bool expected = frustum.intersectsAabb(bounds[i].center(), bounds[i].extents());
+    expectedCount += expected ? 1 : 0;
+    if ((found[i] != 0) != expected) {
+      CAPTURE(i);
+      CHECK(nearPlane(frustum, bounds[i]));
+    }
+  }
+  if (bounds.size() >= 1000) {
+    // the frustum sees part of the scene, so both outcomes are exercised
+    CHECK(expectedCount > 0);
+    CHECK(expectedCount < bounds.size());
+  }
+}
+
+void checkOverlap(const Bvh& bvh, const std::vector<Aabb>& bounds, std::mt19937& random) {
+  std::uniform_real_distribution<float> position(-220.0f, 220.0f);
+  std::uniform_real_distribution<float> size(0.0f, 60.0f);
+  for (int query = 0; query < 20; ++query) {
+    const math::vec3 center(position(random), position(random), position(random));
+    const math::vec3 extents(size(random), size(random), size(random));
+    const Aabb box{center - extents, center + extents};
+    std::vector<std::uint32_t> result;
+    bvh.overlap(box, result);
+    std::sort(result.begin(), result.end());
+    std::vector<std::uint32_t> expected;
+    for (std::size_t i = 0; i < bounds.size(); ++i) {
+      if (box.overlaps(bounds[i])) {
+        expected.push_back(static_cast<std::uint32_t>(i));
+      }
+    }
+    CAPTURE(query);
+    CHECK(result == expected);
+  }
+}
+
+void checkQueries(const Bvh& bvh, const std::vector<Aabb>& bounds, std::mt19937& random) {
+  const math::mat4 projection = math::perspective(1.2f, 1.5f, 0.5f, 150.0f);
+  const math::mat4 view = math::lookAt(math::vec3(-30.0f, 10.0f, 40.0f), math::vec3(60.0f, -10.0f, -80.0f),
+                                       math::vec3(0.0f, 1.0f, 0.0f));
+  checkStructure(bvh, bounds);
+  checkCull(bvh, bounds, Frustum::fromMatrix(projection * view));
+  checkOverlap(bvh, bounds, random);
+}
+
+}  // namespace
+
+TEST_CASE("Bvh::cull and overlap match brute force, built with and without a ThreadPool") {
+  ThreadPool pool(4);
+  // 20000 objects split into pool tasks of at least Bvh::kMinTaskSize
+  for (std::size_t count : {std::size_t{0}, std::size_t{1}, std::size_t{3}, std::size_t{100}, std::size_t{20000}}) {
+    for (ThreadPool* buildPool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+      CAPTURE(count);
+      CAPTURE(buildPool != nullptr);
+      std::mt19937 random(static_cast<std::uint32_t>(count) + 1);
+      std::vector<Aabb> bounds = randomBounds(count, random);
+      Bvh bvh;
+      bvh.build(bounds, buildPool);
+      CHECK(bvh.size() == count);
+      CHECK(bvh.nodes().size() <= (count > 0 ? 2 * count - 1 : 0));
+      checkQueries(bvh, bounds, random);
+
+      // refit keeps the tree but must cover the moved objects
+      const std::size_t nodeCount = bvh.nodes().size();
+      moveAll(bounds, random, 10.0f);
+      bvh.refit(bounds);
+      CHECK(bvh.nodes().size() == nodeCount);
+      CHECK(bvh.refitsSinceBuild() == 1);
+      checkQueries(bvh, bounds, random);
+    }
+  }
+}
+
+TEST_CASE("Bvh::update refits until a rebuild is due") {
+  ThreadPool pool(4);
+  std::mt19937 random(21);
+  std::vector<Aabb> bounds = randomBounds(10000, random);
+  Bvh bvh;
+  bvh.setRebuildInterval(4);
+  CHECK(bvh.update(bounds, &pool));  // nothing built yet
+  checkQueries(bvh, bounds, random);
+
+  // small steps: refits, then the periodic rebuild
+  for (std::size_t frame = 1; frame < 4; ++frame) {
+    moveAll(bounds, random, 0.5f);
+    CHECK(!bvh.update(bounds, &pool));
+    CHECK(bvh.refitsSinceBuild() == frame);
+    checkQueries(bvh, bounds, random);
+  }
+  moveAll(bounds, random, 0.5f);
+  CHECK(bvh.update(bounds, &pool));
+  CHECK(bvh.refitsSinceBuild() == 0);
+  checkQueries(bvh, bounds, random);
+
+  // scattering the objects loosens the tree past kRebuildRatio
+  bvh.setRebuildInterval(0);
+  moveAll(bounds, random, 150.0f);
+  CHECK(bvh.update(bounds));
+  CHECK(bvh.refitsSinceBuild() == 0);
+  checkQueries(bvh, bounds, random);
+
+  // a changed object count always rebuilds
+  bounds.resize(7000);
+  CHECK(bvh.update(bounds, &pool));
+  CHECK(bvh.size() == 7000);
+  checkQueries(bvh, bounds, random);
+}
@@ -0,0 +1,137 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "command_list.h"
+#include "doctest.h"
+#include "thread_pool.h"
+
+// CommandList recording checked through visit(), which hands the commands back without GL.
+
+namespace {
+
+struct ObjectBlock {
+  float model[16];
+  std::uint32_t index;
+};
+
+// what a worker records for chunk index: a pipeline switch, a texture, a uniform block and a
+// draw of a pooled mesh
+void recordChunk(CommandList& list, std::size_t index, const std::vector<PipelineState>& pipelines) {
+  const auto i = static_cast<GLuint>(index);
+  list.setPipeline(pipelines[index % pipelines.size()]);
+  list.bindTexture(0, GL_TEXTURE_2D, i + 1);
+  ObjectBlock block{};
+  block.model[0] = static_cast<float>(index);
+  block.index = i;
+  list.uniformBlock(1, block);
+  DrawCommand draw;
+  draw.count = 6;
+  draw.offset = index * 6 * sizeof(GLuint);
+  draw.baseVertex = static_cast<GLint>(i * 4);
+  list.draw(draw);
+}
+
+// one line per command, in replay order
+struct Trace {
+  std::vector<std::string> lines;
+
+  void operator()(const PipelineState& pipeline) { lines.push_back("pipeline " + std::to_string(pipeline.id)); }
+  void operator()(const TextureCommand& texture) {
+    lines.push_back("texture " + std::to_string(texture.unit) + " " + std::to_string(texture.target) + " " +
+                    std::to_string(texture.texture));
+  }
+  void operator()(const UniformBlockCommand& block) {
+    ObjectBlock object;
+    REQUIRE(block.data.size() == sizeof(ObjectBlock));
+    std::memcpy(&object, block.data.data(), sizeof(ObjectBlock));
+    lines.push_back("block " + std::to_string(block.binding) + " " + std::to_string(object.model[0]) + " " +
+                    std::to_string(object.index));
+  }
+  void operator()(const DrawCommand& draw) {
+    lines.push_back("draw " + std::to_string(draw.count) + " " + std::to_string(draw.offset) + " " +
+                    std::to_string(draw.baseVertex) + " " + std::to_string(draw.instances));
+  }
+};
+
+std::vector<PipelineState> testPipelines() {
+  std::vector<PipelineState> pipelines(3);
+  for (std::size_t i = 0; i < pipelines.size(); ++i) {
+    pipelines[i].id = static_cast<std::uint32_t>(i + 1);
+  }
+  return pipelines;
+}
+
+}  // namespace
+
+TEST_CASE("CommandList lists recorded in parallel replay like a serial recording") {
+  const std::vector<PipelineState> pipelines = testPipelines();
+  constexpr std::size_t kChunks = 37;
+
+  CommandList serial(kChunks * 256);
+  for (std::size_t i = 0; i < kChunks; ++i) {
+    recordChunk(serial, i, pipelines);
+  }
+  REQUIRE(!serial.overflowed());
+  CHECK(serial.commands() == kChunks * 4);
+  Trace expected;
+  serial.visit(expected);
+
+  for (std::size_t threads : {1, 3, 8}) {
+    CAPTURE(threads);
+    ThreadPool pool(threads);
+    // chunk i goes into list i, whichever worker records it
+    std::vector<CommandList> lists(kChunks);
+    pool.parallelFor(kChunks, [&](std::size_t index, std::size_t) { recordChunk(lists[index], index, pipelines); });
+    Trace merged;
+    for (const CommandList& list : lists) {
+      CHECK(!list.overflowed());
+      list.visit(merged);
+    }
+    CHECK(merged.lines == expected.lines);
+  }
+}
+
+TEST_CASE("CommandList keeps the draw's base vertex and the uniform block bytes") {
+  const std::vector<PipelineState> pipelines = testPipelines();
+  CommandList list;
+  recordChunk(list, 5, pipelines);
+  Trace trace;
+  list.visit(trace);
+  const std::vector<std::string> expected = {
+      "pipeline 3",
+      "texture 0 " + std::to_string(GL_TEXTURE_2D) + " 6",
+      "block 1 " + std::to_string(5.0f) + " 5",
+      "draw 6 " + std::to_string(5 * 6 * sizeof(GLuint)) + " 20 1",
+  };
+  CHECK(trace.lines == expected);
+}
+
+TEST_CASE("CommandList drops everything past an overflow until reset") {
+  const std::vector<PipelineState> pipelines = testPipelines();
+  CommandList list(512);
+  std::size_t chunks = 0;
+  while (!list.overflowed()) {
+    recordChunk(list, chunks++, pipelines);
+  }
+  const std::size_t recorded = list.commands();
+  const std::size_t bytes = list.bytes();
+  CHECK(bytes <= 512);
+  CHECK(recorded < chunks * 4);
+
+  // later commands are dropped even if they are small enough to fit, so no command is skipped
+  // in the middle of a list
+  CHECK(!list.bindTexture(0, GL_TEXTURE_2D, 1));
+  CHECK(list.commands() == recorded);
+  CHECK(list.bytes() == bytes);
+  Trace trace;
+  list.visit(trace);
+  CHECK(trace.lines.size() == recorded);
+
+  list.reset();
+  CHECK(!list.overflowed());
+  CHECK(list.commands() == 0);
+  CHECK(list.bindTexture(0, GL_TEXTURE_2D, 1));
+}
@@ -0,0 +1,224 @@
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "ecs.h"
+#include "render_components.h"
+
+namespace {
+
+struct Position {
+  float x, y, z;
+};
+
+struct Velocity {
+  float x, y, z;
+};
+
+struct Tag {
+  std::uint32_t value;
+};
+
+// every alive entity of the map has exactly its expected Position, and every chunk but the
+// last of an archetype is full
+void checkPositions(EcsWorld& world, const std::map<std::uint32_t, std::pair<Entity, float>>& expected) {
+  std::size_t visited = 0;
+  world.forEach<const Position>([&](Entity entity, const Position& position) {
+    ++visited;
+    auto found = expected.find(entity.index);
+    REQUIRE(found != expected.end());
+    CHECK(found->second.first == entity);
+    CHECK(position.x == found->second.second);
+  });
+  CHECK(visited == expected.size());
+  for (const auto& [index, value] : expected) {
+    CHECK(world.alive(value.first));
+    REQUIRE(world.get<Position>(value.first) != nullptr);
+    CHECK(world.get<Position>(value.first)->x == value.second);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("EcsWorld keeps chunks dense when entities are destroyed") {
+  EcsWorld world;
+  std::map<std::uint32_t, std::pair<Entity, float>> expected;
+  // several chunks' worth, so holes are filled across chunk boundaries
+  for (int i = 0; i < 5000; ++i) {
+    const float value = static_cast<float>(i);
+    const Entity entity = world.create(Position{value, 0.0f, 0.0f});
+    expected[entity.index] = {entity, value};
+  }
+  CHECK(world.size() == 5000);
+
+  std::mt19937 random(5);
+  std::vector<Entity> destroyed;
+  for (int i = 0; i < 2000; ++i) {
+    auto it = expected.begin();
+    std::advance(it, random() % expected.size());
+    world.destroy(it->second.first);
+    destroyed.push_back(it->second.first);
+    expected.erase(it);
+  }
+  CHECK(world.size() == expected.size());
+  checkPositions(world, expected);
+
+  std::size_t chunks = 0;
+  std::size_t lastSize = 0;
+  std::size_t fullSize = 0;
+  world.forEachChunk<const Position>([&](std::span<const Entity> entities, std::span<const Position>) {
+    if (chunks > 0) {
+      // the previous chunk was not the last one, so it must have been full
+      CHECK(lastSize == fullSize);
+    }
+    fullSize = std::max(fullSize, entities.size());
+    lastSize = entities.size();
+    ++chunks;
+  });
+  CHECK(chunks > 1);
+
+  // destroyed handles stay dead, also once their index is reused
+  for (const Entity& entity : destroyed) {
+    CHECK(!world.alive(entity));
+    CHECK(world.get<Position>(entity) == nullptr);
+  }
+  const Entity reused = world.create(Position{-1.0f, 0.0f, 0.0f});
+  CHECK(world.alive(reused));
+  bool indexReused = false;
+  for (const Entity& entity : destroyed) {
+    if (entity.index == reused.index) {
+      indexReused = true;
+      CHECK(entity.generation != reused.generation);
+    }
+  }
+  CHECK(indexReused);
+  world.destroy(destroyed.front());  // a stale destroy must not hit the new entity
+  CHECK(world.alive(reused));
+}
+
+TEST_CASE("EcsWorld moves entities between archetypes without losing components") {
+  EcsWorld world;
+  std::vector<Entity> entities;
+  for (int i = 0; i < 100; ++i) {
+    entities.push_back(world.create(Position{static_cast<float>(i), 1.0f, 2.0f}, Tag{static_cast<std::uint32_t>(i)}));
+  }
+  CHECK(world.archetypeCount() == 1);
+
+  // every other entity gains a Velocity
+  for (std::size_t i = 0; i < entities.size(); i += 2) {
+    world.add(entities[i], Velocity{0.0f, 0.0f, static_cast<float>(i)});
+  }
+  CHECK(world.archetypeCount() == 2);
+  for (std::size_t i = 0; i < entities.size(); ++i) {
+    CAPTURE(i);
+    CHECK(world.has<Velocity>(entities[i]) == (i % 2 == 0));
+    CHECK(world.get<Position>(entities[i])->x == static_cast<float>(i));
+    CHECK(world.get<Position>(entities[i])->z == 2.0f);
+    CHECK(world.get<Tag>(entities[i])->value == i);
+  }
+
+  // overwriting an existing component keeps the archetype
+  world.add(entities[0], Velocity{5.0f, 0.0f, 0.0f});
+  CHECK(world.get<Velocity>(entities[0])->x == 5.0f);
+  CHECK(world.archetypeCount() == 2);
+
+  std::size_t moving = 0;
+  world.forEach<Position, const Velocity>([&](Entity, Position& position, const Velocity& velocity) {
+    position.y += velocity.z;
+    ++moving;
+  });
+  CHECK(moving == 50);
+  CHECK(world.get<Position>(entities[4])->y == 5.0f);
+
+  // and back: removing the Velocity returns the entity to the first archetype, values intact
+  world.remove<Velocity>(entities[4]);
+  world.remove<Velocity>(entities[5]);  // has none, no-op
+  CHECK(!world.has<Velocity>(entities[4]));
+  CHECK(world.get<Position>(entities[4])->y == 5.0f);
+  CHECK(world.get<Tag>(entities[4])->value == 4);
+  CHECK(world.get<Tag>(entities[5])->value == 5);
+
+  world.remove<Tag>(entities[6]);
+  CHECK(world.archetypeCount() == 3);
+  CHECK(world.get<Tag>(entities[6]) == nullptr);
+  CHECK(world.get<Velocity>(entities[6])->z == 6.0f);
+}
+
+TEST_CASE("EcsCommandBuffer applies the changes recorded during a query in order") {
+  EcsWorld world;
+  std::vector<Entity> entities;
+  for (int i = 0; i < 10; ++i) {
+    entities.push_back(world.create(Position{static_cast<float>(i), 0.0f, 0.0f}));
+  }
+
+  EcsCommandBuffer commands;
+  CHECK(commands.empty());
+  world.forEach<const Position>([&](Entity entity, const Position& position) {
+    const auto i = static_cast<std::uint32_t>(position.x);
+    if (i % 3 == 0) {
+      commands.destroy(entity);
+    } else if (i % 3 == 1) {
+      commands.add(entity, Tag{i * 10});
+    } else {
+      commands.create(Position{position.x + 100.0f, 0.0f, 0.0f}, Tag{i});
+    }
+  });
+  // recorded only: the world is unchanged until apply()
+  CHECK(world.size() == 10);
+  CHECK(!commands.empty());
+
+  commands.apply(world);
+  CHECK(commands.empty());
+  CHECK(world.size() == 10 - 4 + 3);
+  for (std::size_t i = 0; i < entities.size(); ++i) {
+    CAPTURE(i);
+    CHECK(world.alive(entities[i]) == (i % 3 != 0));
+    if (i % 3 == 1) {
+      CHECK(world.get<Tag>(entities[i])->value == i * 10);
+    }
+  }
+  std::size_t created = 0;
+  world.forEach<const Position, const Tag>([&](Entity, const Position& position, const Tag& tag) {
+    if (position.x >= 100.0f) {
+      CHECK(position.x == 100.0f + static_cast<float>(tag.value));
+      ++created;
+    }
+  });
+  CHECK(created == 3);
+
+  // later commands see the effect of earlier ones
+  commands.add(entities[1], Velocity{1.0f, 2.0f, 3.0f});
+  commands.remove<Tag>(entities[1]);
+  commands.destroy(entities[2]);
+  commands.add(entities[2], Tag{7});  // already destroyed: ignored
+  commands.apply(world);
+  CHECK(world.get<Velocity>(entities[1])->y == 2.0f);
+  CHECK(!world.has<Tag>(entities[1]));
+  CHECK(!world.alive(entities[2]));
+}
+
+TEST_CASE("updateBounds moves LocalBounds by WorldTransform") {
+  EcsWorld world;
+  ThreadPool pool(4);
+  std::vector<Entity> entities;
+  for (int i = 0; i < 3000; ++i) {
+    const float f = static_cast<float>(i);
+    const math::mat4 transform = math::translate(math::vec3(f, 0.0f, -f)) * math::scale(math::vec3(1.0f, 3.0f, 2.0f));
+    entities.push_back(world.create(WorldTransform{transform}, LocalBounds{math::vec3(1.0f, 1.0f, 0.0f), 0.5f},
+                                    Bounds{}));
+  }
+  // no Bounds: not touched
+  const Entity unbounded = world.create(WorldTransform{}, LocalBounds{{}, 1.0f});
+
+  updateBounds(world, pool);
+  for (std::size_t i = 0; i < entities.size(); ++i) {
+    CAPTURE(i);
+    const float f = static_cast<float>(i);
+    const Bounds& bounds = *world.get<Bounds>(entities[i]);
+    CHECK(bounds.center == math::vec3(f + 1.0f, 3.0f, -f));
+    CHECK(bounds.radius == doctest::Approx(1.5));  // grown by the largest axis scale
+  }
+  CHECK(!world.has<Bounds>(unbounded));
+}
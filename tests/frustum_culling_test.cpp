@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "frustum_culling.h"
+
+// FrustumCuller (vector kernels, AVX2 compaction, block stitching) against the scalar
+// Frustum::intersectsSphere / intersectsAabb one object at a time.
+
+namespace {
+
+Frustum testFrustum() {
+  const math::mat4 projection = math::perspective(1.0f, 16.0f / 9.0f, 0.5f, 200.0f);
+  const math::mat4 view = math::lookAt(math::vec3(0.0f, 5.0f, 20.0f), math::vec3(3.0f, 0.0f, -40.0f),
+                                       math::vec3(0.0f, 1.0f, 0.0f));
+  return Frustum::fromMatrix(projection * view);
+}
+
+// kernels and the scalar test add the same terms in a different order, so objects within
+// rounding distance of a plane are left out
+bool clearOfPlanes(const Frustum& frustum, const math::vec3& center, const math::vec3& extents) {
+  for (const math::vec4& plane : frustum.planes) {
+    const double distance = double{plane.x} * center.x + double{plane.y} * center.y + double{plane.z} * center.z +
+                            plane.w;
+    const double reach = std::fabs(double{plane.x}) * extents.x + std::fabs(double{plane.y}) * extents.y +
+                         std::fabs(double{plane.z}) * extents.z;
+    if (std::fabs(distance + reach) < 1e-2) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Objects {
+  SphereSoA spheres;
+  AabbSoA boxes;
+  std::vector<std::uint32_t> expectedSpheres;
+  std::vector<std::uint32_t> expectedBoxes;
+};
+
+Objects makeObjects(const Frustum& frustum, std::size_t count, std::uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> x(-120.0f, 120.0f);
+  std::uniform_real_distribution<float> y(-60.0f, 60.0f);
+  std::uniform_real_distribution<float> z(-220.0f, 40.0f);
+  std::uniform_real_distribution<float> size(0.1f, 8.0f);
+  Objects objects;
+  objects.spheres.resize(count);
+  objects.boxes.resize(count);
+  for (std::size_t i = 0; i < count;) {
+    const math::vec3 center(x(random), y(random), z(random));
+    const float radius = size(random);
+    const math::vec3 extents(size(random), size(random), size(random));
+    if (!clearOfPlanes(frustum, center, math::vec3(radius)) || !clearOfPlanes(frustum, center, extents)) {
+      continue;
+    }
+    objects.spheres.set(i, center, radius);
+    objects.boxes.set(i, center - extents, center + extents);
+    if (frustum.intersectsSphere(center, radius)) {
+      objects.expectedSpheres.push_back(static_cast<std::uint32_t>(i));
+    }
+    if (frustum.intersectsAabb(center, extents)) {
+      objects.expectedBoxes.push_back(static_cast<std::uint32_t>(i));
+    }
+    ++i;
+  }
+  return objects;
+}
+
+void checkSame(std::span<const std::uint32_t> visible, const std::vector<std::uint32_t>& expected) {
+  REQUIRE(visible.size() == expected.size());
+  for (std::size_t k = 0; k < expected.size(); ++k) {
+    CAPTURE(k);
+    CHECK(visible[k] == expected[k]);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("FrustumCuller matches the scalar tests, with and without a ThreadPool") {
+  const Frustum frustum = testFrustum();
+  ThreadPool pool(4);
+  FrustumCuller culler;
+  // tails of the 4 / 8 wide kernels, one block, and several blocks with a partial last one
+  for (std::size_t count : {std::size_t{0}, std::size_t{1}, std::size_t{7}, std::size_t{8}, std::size_t{9},
+                            std::size_t{31}, std::size_t{1000}, FrustumCuller::kBlock,
+                            3 * FrustumCuller::kBlock + 13}) {
+    CAPTURE(count);
+    const Objects objects = makeObjects(frustum, count, static_cast<std::uint32_t>(count) + 1);
+    if (count >= 1000) {
+      // the scene straddles the frustum, so both outcomes are exercised
+      CHECK(!objects.expectedSpheres.empty());
+      CHECK(objects.expectedSpheres.size() < count);
+    }
+
+    checkSame(culler.cull(frustum, objects.spheres), objects.expectedSpheres);
+    checkSame(culler.cull(frustum, objects.spheres, &pool), objects.expectedSpheres);
+    checkSame(culler.cull(frustum, objects.boxes), objects.expectedBoxes);
+    checkSame(culler.cull(frustum, objects.boxes, &pool), objects.expectedBoxes);
+  }
+}
+
+TEST_CASE("cullSpheres offsets the indices it writes by firstIndex") {
+  const Frustum frustum = testFrustum();
+  const Objects objects = makeObjects(frustum, 100, 9);
+  std::vector<std::uint32_t> visible(100);
+  const std::size_t count = cullSpheres(frustum, objects.spheres.x.data(), objects.spheres.y.data(),
+                                        objects.spheres.z.data(), objects.spheres.radius.data(), 100, 5000,
+                                        visible.data());
+  REQUIRE(count == objects.expectedSpheres.size());
+  for (std::size_t k = 0; k < count; ++k) {
+    CHECK(visible[k] == objects.expectedSpheres[k] + 5000);
+  }
+}
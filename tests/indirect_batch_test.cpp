@@ -0,0 +1,95 @@
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "doctest.h"
+#include "indirect_batch.h"
+
+// IndirectDrawList, the GL-free half of IndirectBatcher: draw ids, pipeline groups and the
+// commands glMultiDrawElementsIndirect reads.
+
+namespace {
+
+std::vector<PipelineState> testPipelines(std::size_t count) {
+  std::vector<PipelineState> pipelines(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    pipelines[i].id = static_cast<std::uint32_t>(i + 1);
+  }
+  return pipelines;
+}
+
+MeshRange mesh(GLuint firstIndex, GLuint indexCount, GLint baseVertex) {
+  MeshRange range;
+  range.firstIndex = firstIndex;
+  range.indexCount = indexCount;
+  range.baseVertex = baseVertex;
+  return range;
+}
+
+}  // namespace
+
+TEST_CASE("IndirectDrawList groups draws by pipeline id and keeps arrival order inside a group") {
+  const std::vector<PipelineState> pipelines = testPipelines(3);
+  IndirectDrawList list(16);
+  // pipeline ids 3, 1, 3, 2, 1 arrive in that order
+  const std::size_t arrivals[] = {2, 0, 2, 1, 0};
+  for (std::size_t i = 0; i < std::size(arrivals); ++i) {
+    const auto k = static_cast<GLuint>(i);
+    CHECK(list.add(pipelines[arrivals[i]], mesh(k * 6, 6, static_cast<GLint>(k * 4)), k + 1) == i);
+  }
+  list.build();
+
+  const std::vector<IndirectGroup>& groups = list.groups();
+  REQUIRE(groups.size() == 3);
+  CHECK(groups[0].pipeline == &pipelines[0]);
+  CHECK(groups[1].pipeline == &pipelines[1]);
+  CHECK(groups[2].pipeline == &pipelines[2]);
+  CHECK(groups[0].first == 0);
+  CHECK(groups[0].count == 2);
+  CHECK(groups[1].first == 2);
+  CHECK(groups[1].count == 1);
+  CHECK(groups[2].first == 3);
+  CHECK(groups[2].count == 2);
+
+  // draw ids in command order: pipeline 1 (ids 1, 4), pipeline 2 (id 3), pipeline 3 (ids 0, 2)
+  const GLuint expectedIds[] = {1, 4, 3, 0, 2};
+  const std::vector<DrawElementsIndirectCommand>& commands = list.commands();
+  REQUIRE(commands.size() == std::size(expectedIds));
+  for (std::size_t i = 0; i < commands.size(); ++i) {
+    CAPTURE(i);
+    const GLuint id = expectedIds[i];
+    CHECK(commands[i].count == 6);
+    CHECK(commands[i].instanceCount == id + 1);
+    CHECK(commands[i].firstIndex == id * 6);
+    CHECK(commands[i].baseVertex == static_cast<GLint>(id * 4));
+    CHECK(commands[i].baseInstance == id);
+  }
+
+  list.clear();
+  CHECK(list.size() == 0);
+  list.build();
+  CHECK(list.groups().empty());
+  CHECK(list.commands().empty());
+}
+
+TEST_CASE("IndirectDrawList refuses draws past maxDraws") {
+  const std::vector<PipelineState> pipelines = testPipelines(1);
+  IndirectDrawList list(4);
+  for (std::uint32_t i = 0; i < 4; ++i) {
+    CHECK(list.add(pipelines[0], mesh(0, 6, 0)) == i);
+  }
+  CHECK(list.add(pipelines[0], mesh(0, 6, 0)) == IndirectDrawList::kNoDraw);
+  CHECK(list.add(pipelines[0], mesh(0, 6, 0)) == IndirectDrawList::kNoDraw);
+  CHECK(list.size() == 4);
+  CHECK(list.dropped() == 2);
+
+  list.build();
+  REQUIRE(list.groups().size() == 1);
+  CHECK(list.groups()[0].count == 4);
+
+  // ids start over after clear(), the dropped count does not
+  list.clear();
+  CHECK(list.add(pipelines[0], mesh(0, 6, 0)) == 0);
+  CHECK(list.dropped() == 2);
+}
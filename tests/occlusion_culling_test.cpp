@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "occlusion_culling.h"
+
+// OcclusionBuffer against a per-pixel reference z-buffer of the same occluders: a box the buffer
+// reports hidden must lie behind the reference depth at every pixel its screen rectangle
+// touches. The reference samples pixel centers like the buffer does, in double precision.
+
+namespace {
+
+struct Mesh {
+  std::vector<math::vec3> vertices;
+  std::vector<std::uint32_t> indices;
+};
+
+// a closed box, counter-clockwise seen from outside
+Mesh boxMesh(const Aabb& box) {
+  Mesh mesh;
+  for (int corner = 0; corner < 8; ++corner) {
+    mesh.vertices.push_back({(corner & 1) != 0 ? box.max.x : box.min.x, (corner & 2) != 0 ? box.max.y : box.min.y,
+                             (corner & 4) != 0 ? box.max.z : box.min.z});
+  }
+  constexpr std::array<std::array<std::uint32_t, 4>, 6> kFaces = {
+      {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}}};
+  for (const auto& face : kFaces) {
+    mesh.indices.insert(mesh.indices.end(), {face[0], face[1], face[2], face[0], face[2], face[3]});
+  }
+  return mesh;
+}
+
+struct Screen {
+  double x, y, depth;
+};
+
+Screen toScreen(const math::mat4& viewProjection, const math::vec3& p, int width, int height) {
+  const math::vec4 clip = viewProjection * math::vec4(p, 1.0f);
+  const double invW = 1.0 / clip.w;
+  return {(clip.x * invW * 0.5 + 0.5) * width, (clip.y * invW * 0.5 + 0.5) * height, clip.z * invW * 0.5 + 0.5};
+}
+
+class ReferenceDepth {
+ public:
+  ReferenceDepth(int width, int height)
+      : width_(width), height_(height), depth_(static_cast<std::size_t>(width * height), 1.0) {}
+
+  // front faces only, like the buffer; pixel centers within kEdgeSlack of an edge count as
+  // covered, so the reference never hides less than exact coverage would
+  void draw(const Mesh& mesh, const math::mat4& viewProjection) {
+    constexpr double kEdgeSlack = 1e-3;
+    for (std::size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+      std::array<Screen, 3> v;
+      for (std::size_t i = 0; i < 3; ++i) {
+        v[i] = toScreen(viewProjection, mesh.vertices[mesh.indices[t + i]], width_, height_);
+      }
+      const double area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+      if (!(area > 0.0)) {
+        continue;
+      }
+      const double depthX =
+          ((v[1].depth - v[0].depth) * (v[2].y - v[0].y) - (v[2].depth - v[0].depth) * (v[1].y - v[0].y)) / area;
+      const double depthY =
+          ((v[2].depth - v[0].depth) * (v[1].x - v[0].x) - (v[1].depth - v[0].depth) * (v[2].x - v[0].x)) / area;
+      for (int py = 0; py < height_; ++py) {
+        for (int px = 0; px < width_; ++px) {
+          const double x = px + 0.5;
+          const double y = py + 0.5;
+          bool inside = true;
+          for (std::size_t i = 0; i < 3; ++i) {
+            const Screen& a = v[i];
+            const Screen& b = v[(i + 1) % 3];
+            const double edgeLength = std::hypot(b.x - a.x, b.y - a.y);
+            inside &= (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x) >= -kEdgeSlack * edgeLength;
+          }
+          if (inside) {
+            double& depth = depth_[static_cast<std::size_t>(py * width_ + px)];
+            depth = std::min(depth, v[0].depth + depthX * (x - v[0].x) + depthY * (y - v[0].y));
+          }
+        }
+      }
+    }
+  }
+
+  // whether the box lies behind the reference depth on every pixel of its screen rectangle, the
+  // rectangle computed like OcclusionBuffer::isVisible does
+  bool hides(const Aabb& box, const math::mat4& viewProjection) const {
+    double minX = std::numeric_limits<double>::max(), minY = minX, nearest = minX;
+    double maxX = -minX, maxY = -minX;
+    for (int corner = 0; corner < 8; ++corner) {
+      const math::vec3 p{(corner & 1) != 0 ? box.max.x : box.min.x, (corner & 2) != 0 ? box.max.y : box.min.y,
+                         (corner & 4) != 0 ? box.max.z : box.min.z};
+      const Screen s = toScreen(viewProjection, p, width_, height_);
+      minX = std::min(minX, s.x);
+      maxX = std::max(maxX, s.x);
+      minY = std::min(minY, s.y);
+      maxY = std::max(maxY, s.y);
+      nearest = std::min(nearest, s.depth);
+    }
+    const int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+    const int x1 = std::min(static_cast<int>(std::floor(maxX)), width_ - 1);
+    const int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+    const int y1 = std::min(static_cast<int>(std::floor(maxY)), height_ - 1);
+    for (int py = y0; py <= y1; ++py) {
+      for (int px = x0; px <= x1; ++px) {
+        if (depth_[static_cast<std::size_t>(py * width_ + px)] > nearest + 1e-5) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  int width_;
+  int height_;
+  std::vector<double> depth_;
+};
+
+Aabb randomBox(std::mt19937& random, float x, float y, float nearZ, float farZ, float minSize, float maxSize) {
+  std::uniform_real_distribution<float> px(-x, x);
+  std::uniform_real_distribution<float> py(-y, y);
+  std::uniform_real_distribution<float> pz(farZ, nearZ);
+  std::uniform_real_distribution<float> size(minSize, maxSize);
+  const math::vec3 center(px(random), py(random), pz(random));
+  const math::vec3 extents(size(random), size(random), size(random));
+  return {center - extents, center + extents};
+}
+
+}  // namespace
+
+TEST_CASE("OcclusionBuffer hides no box the reference z-buffer shows") {
+  // not a whole number of tiles high, so the buffer rounds up
+  OcclusionBuffer buffer(320, 180);
+  const int width = buffer.width();
+  const int height = buffer.height();
+  const math::mat4 viewProjection =
+      math::perspective(1.0f, static_cast<float>(width) / static_cast<float>(height), 0.5f, 100.0f) *
+      math::lookAt(math::vec3(0.0f, 0.0f, 0.0f), math::vec3(0.0f, 0.0f, -1.0f), math::vec3(0.0f, 1.0f, 0.0f));
+
+  std::mt19937 random(17);
+  std::vector<Mesh> occluders;
+  occluders.push_back(boxMesh({math::vec3(-6.0f, -3.0f, -20.0f), math::vec3(2.0f, 3.0f, -19.0f)}));
+  for (int i = 0; i < 40; ++i) {
+    occluders.push_back(boxMesh(randomBox(random, 6.0f, 3.0f, -8.0f, -16.0f, 0.3f, 2.0f)));
+  }
+  ReferenceDepth reference(width, height);
+  for (const Mesh& mesh : occluders) {
+    reference.draw(mesh, viewProjection);
+  }
+  std::vector<Aabb> occludees;
+  for (int i = 0; i < 3000; ++i) {
+    occludees.push_back(randomBox(random, 14.0f, 7.0f, -5.0f, -40.0f, 0.1f, 1.0f));
+  }
+
+  ThreadPool pool(4);
+  for (ThreadPool* rasterizePool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+    CAPTURE(rasterizePool != nullptr);
+    buffer.clear();
+    for (const Mesh& mesh : occluders) {
+      buffer.addOccluder(mesh.vertices, mesh.indices, viewProjection);
+    }
+    buffer.rasterize(rasterizePool);
+    CHECK(buffer.rasterizedTriangles() > 0);
+
+    std::size_t hidden = 0;
+    std::size_t referenceHidden = 0;
+    for (std::size_t i = 0; i < occludees.size(); ++i) {
+      const bool hiddenByReference = reference.hides(occludees[i], viewProjection);
+      referenceHidden += hiddenByReference ? 1 : 0;
+      if (!buffer.isVisible(occludees[i], viewProjection)) {
+        CAPTURE(i);
+        CHECK(hiddenByReference);
+        ++hidden;
+      }
+    }
+    // conservative, but still culls most of what the reference hides
+    CHECK(hidden > referenceHidden / 2);
+  }
+}
+
+TEST_CASE("OcclusionBuffer starts a new working layer for a much nearer triangle") {
+  // one tile, NDC straight to the screen: x [-1, 1] -> [0, 32], depth z * 0.5 + 0.5
+  OcclusionBuffer buffer(OcclusionBuffer::kTileWidth, OcclusionBuffer::kTileHeight);
+  const math::mat4 identity;
+  const auto quad = [](float x0, float x1, float z) {
+    return Mesh{{{x0, -1.0f, z}, {x1, -1.0f, z}, {x1, 1.0f, z}, {x0, 1.0f, z}}, {0, 1, 2, 0, 2, 3}};
+  };
+  // far (0.9) over the left half first, then near (0.5) over the right half: the near triangle
+  // replaces the working layer instead of completing it at the far depth
+  const Mesh far = quad(-1.0f, 0.0f, 0.8f);
+  const Mesh near = quad(0.0f, 1.0f, 0.0f);
+  buffer.addOccluder(far.vertices, far.indices, identity);
+  buffer.addOccluder(near.vertices, near.indices, identity);
+  buffer.rasterize();
+  CHECK(buffer.rasterizedTriangles() == 4);
+  CHECK(buffer.tileDepth(0, 0) == 1.0f);
+
+  // behind the near quad: hidden by the working layer
+  CHECK(!buffer.isVisible({math::vec3(0.1f, -0.9f, 0.2f), math::vec3(0.9f, 0.9f, 0.3f)}, identity));
+  // in front of it, or over the dropped far half: visible
+  CHECK(buffer.isVisible({math::vec3(0.1f, -0.9f, -0.5f), math::vec3(0.9f, 0.9f, -0.4f)}, identity));
+  CHECK(buffer.isVisible({math::vec3(-0.9f, -0.9f, 0.9f), math::vec3(-0.1f, 0.9f, 0.95f)}, identity));
+}
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "mesh_pool.h"
+#include "offset_allocator.h"
+
+namespace {
+
+struct Block {
+  OffsetAllocator::Allocation allocation;
+  std::uint32_t size;
+};
+
+// live blocks never overlap, stay inside the range and account for everything not free
+void checkConsistent(const OffsetAllocator& allocator, std::vector<Block> blocks) {
+  std::sort(blocks.begin(), blocks.end(),
+            [](const Block& a, const Block& b) { return a.allocation.offset < b.allocation.offset; });
+  std::uint32_t used = 0;
+  std::uint32_t end = 0;
+  for (const Block& block : blocks) {
+    CHECK(block.allocation.offset >= end);
+    end = block.allocation.offset + block.size;
+    used += block.size;
+  }
+  CHECK(end <= allocator.size());
+  CHECK(allocator.freeStorage() == allocator.size() - used);
+}
+
+}  // namespace
+
+TEST_CASE("OffsetAllocator splits a block and merges it back on free") {
+  OffsetAllocator allocator(1024);
+  OffsetAllocator::Allocation a = allocator.allocate(100);
+  OffsetAllocator::Allocation b = allocator.allocate(200);
+  OffsetAllocator::Allocation c = allocator.allocate(300);
+  REQUIRE(a.valid());
+  REQUIRE(b.valid());
+  REQUIRE(c.valid());
+  // each allocation is cut off the front of the remainder
+  CHECK(a.offset == 0);
+  CHECK(b.offset == 100);
+  CHECK(c.offset == 300);
+  CHECK(allocator.freeStorage() == 1024 - 600);
+
+  SUBCASE("middle first") {
+    allocator.free(b);
+    allocator.free(a);
+    allocator.free(c);
+  }
+  SUBCASE("left to right") {
+    allocator.free(a);
+    allocator.free(b);
+    allocator.free(c);
+  }
+  SUBCASE("right to left") {
+    allocator.free(c);
+    allocator.free(b);
+    allocator.free(a);
+  }
+  // only a fully merged block can satisfy the whole range again
+  CHECK(allocator.freeStorage() == 1024);
+  CHECK(allocator.largestFreeRegion() == 1024);
+  OffsetAllocator::Allocation all = allocator.allocate(1024);
+  REQUIRE(all.valid());
+  CHECK(all.offset == 0);
+}
+
+TEST_CASE("OffsetAllocator reuses a freed hole between used blocks") {
+  OffsetAllocator allocator(64);
+  OffsetAllocator::Allocation a = allocator.allocate(16);
+  OffsetAllocator::Allocation b = allocator.allocate(16);
+  OffsetAllocator::Allocation c = allocator.allocate(32);
+  REQUIRE(c.valid());
+  CHECK(!allocator.allocate(1).valid());
+
+  allocator.free(b);
+  OffsetAllocator::Allocation again = allocator.allocate(16);
+  REQUIRE(again.valid());
+  CHECK(again.offset == 16);
+  allocator.free(a);
+  allocator.free(again);
+  allocator.free(c);
+  CHECK(allocator.allocate(64).offset == 0);
+}
+
+TEST_CASE("OffsetAllocator rounds requests up to a bin every block of which fits") {
+  SUBCASE("sizes below the mantissa range are exact") {
+    OffsetAllocator allocator(7);
+    CHECK(allocator.largestFreeRegion() == 7);
+    CHECK(allocator.allocate(7).valid());
+  }
+  SUBCASE("a bin size is allocatable from a block of exactly that size") {
+    OffsetAllocator allocator(1024);
+    CHECK(allocator.allocate(1024).valid());
+  }
+  SUBCASE("a block is binned down, a request up") {
+    // 1000 lands in the bin of 960 (mantissa 1.111b << 6); 961 asks for the bin of 1024
+    OffsetAllocator allocator(1000);
+    CHECK(allocator.largestFreeRegion() == 960);
+    CHECK(!allocator.allocate(961).valid());
+    OffsetAllocator::Allocation fits = allocator.allocate(960);
+    REQUIRE(fits.valid());
+    CHECK(fits.offset == 0);
+    CHECK(allocator.freeStorage() == 40);
+  }
+  SUBCASE("allocateFromLargest takes exactly the size asked for") {
+    OffsetAllocator allocator(1000);
+    const OffsetAllocator::Allocation first = allocator.allocateFromLargest(600);
+    const OffsetAllocator::Allocation second = allocator.allocateFromLargest(400);
+    REQUIRE(first.valid());
+    REQUIRE(second.valid());
+    CHECK(first.offset == 0);
+    CHECK(second.offset == 600);
+    CHECK(allocator.freeStorage() == 0);
+    CHECK(!allocator.allocateFromLargest(1).valid());
+    allocator.free(first);
+    allocator.free(second);
+    CHECK(allocator.freeStorage() == 1000);
+    CHECK(!allocator.allocateFromLargest(1001).valid());
+  }
+}
+
+TEST_CASE("OffsetAllocator reports exhaustion") {
+  SUBCASE("out of space") {
+    OffsetAllocator allocator(1024);
+    OffsetAllocator::Allocation a = allocator.allocate(512);
+    OffsetAllocator::Allocation b = allocator.allocate(512);
+    REQUIRE(a.valid());
+    REQUIRE(b.valid());
+    CHECK(allocator.freeStorage() == 0);
+    CHECK(allocator.largestFreeRegion() == 0);
+    CHECK(!allocator.allocate(1).valid());
+
+    allocator.free(a);
+    OffsetAllocator::Allocation c = allocator.allocate(512);
+    REQUIRE(c.valid());
+    CHECK(c.offset == 0);
+  }
+  SUBCASE("out of nodes") {
+    // 4 allocations: 4 used blocks plus the remainder fill the 5 nodes
+    OffsetAllocator allocator(1024, 4);
+    std::vector<OffsetAllocator::Allocation> allocations;
+    for (int i = 0; i < 4; ++i) {
+      allocations.push_back(allocator.allocate(1));
+      CHECK(allocations.back().valid());
+    }
+    CHECK(!allocator.allocate(1).valid());
+    allocator.free(allocations[3]);  // merges into the remainder, freeing a node
+    CHECK(allocator.allocate(1).valid());
+  }
+  SUBCASE("zero sized and invalid") {
+    OffsetAllocator allocator(16);
+    CHECK(!allocator.allocate(0).valid());
+    allocator.free({});
+    CHECK(allocator.freeStorage() == 16);
+  }
+}
+
+TEST_CASE("OffsetAllocator stays consistent under random allocation and free") {
+  constexpr std::uint32_t kSize = 1u << 20;
+  OffsetAllocator allocator(kSize, 1024);
+  std::mt19937 random(7);
+  std::uniform_int_distribution<std::uint32_t> sizes(1, 4096);
+  std::vector<Block> blocks;
+  for (int step = 0; step < 5000; ++step) {
+    if (!blocks.empty() && random() % 3 == 0) {
+      const std::size_t index = random() % blocks.size();
+      allocator.free(blocks[index].allocation);
+      blocks[index] = blocks.back();
+      blocks.pop_back();
+    } else {
+      const std::uint32_t size = sizes(random);
+      OffsetAllocator::Allocation allocation = allocator.allocate(size);
+      if (allocation.valid()) {
+        blocks.push_back({allocation, size});
+      }
+    }
+    if (step % 500 == 0) {
+      checkConsistent(allocator, blocks);
+    }
+  }
+  checkConsistent(allocator, blocks);
+
+  for (const Block& block : blocks) {
+    allocator.free(block.allocation);
+  }
+  CHECK(allocator.freeStorage() == kSize);
+  CHECK(allocator.allocate(kSize).offset == 0);
+}
+
+TEST_CASE("MeshAllocator::defragment packs live meshes and its moves carry their data") {
+  MeshAllocator allocator(4096, 8192);
+  std::vector<MeshHandle> handles;
+  for (GLuint i = 0; i < 24; ++i) {
+    MeshHandle handle = allocator.add(10 + i * 7, 30 + i * 11);
+    REQUIRE(handle.valid());
+    handles.push_back(handle);
+  }
+  // punch holes so the live data is scattered
+  for (std::size_t i = 0; i < handles.size(); i += 3) {
+    allocator.remove(handles[i]);
+  }
+  allocator.remove(handles[0]);  // removing twice is a no-op
+  const float scattered = allocator.fragmentation();
+  CHECK(scattered > 0.0f);
+
+  // tag every vertex and index slot with the mesh it belongs to
+  std::vector<int> vertices(allocator.vertexCapacity(), -1);
+  std::vector<int> indices(allocator.indexCapacity(), -1);
+  std::vector<MeshHandle> live;
+  for (std::size_t i = 0; i < handles.size(); ++i) {
+    if (!allocator.contains(handles[i])) {
+      continue;
+    }
+    live.push_back(handles[i]);
+    const MeshRange r = allocator.range(handles[i]);
+    std::fill_n(vertices.begin() + r.baseVertex, allocator.vertexCount(handles[i]), static_cast<int>(i));
+    std::fill_n(indices.begin() + r.firstIndex, r.indexCount, static_cast<int>(i));
+  }
+
+  const std::vector<MeshMove> moves = allocator.defragment();
+  REQUIRE(moves.size() == live.size());
+
+  // apply the moves to fresh "buffers" the way MeshPool copies between GL buffers
+  std::vector<int> newVertices(vertices.size(), -1);
+  std::vector<int> newIndices(indices.size(), -1);
+  GLuint vertexEnd = 0;
+  GLuint indexEnd = 0;
+  GLuint previousFrom = 0;
+  for (const MeshMove& move : moves) {
+    // packed front to back, in the old order of the vertex data
+    CHECK(move.vertexTo == vertexEnd);
+    CHECK(move.indexTo == indexEnd);
+    CHECK(move.vertexFrom >= previousFrom);
+    previousFrom = move.vertexFrom;
+    vertexEnd += move.vertexCount;
+    indexEnd += move.indexCount;
+    std::copy_n(vertices.begin() + move.vertexFrom, move.vertexCount, newVertices.begin() + move.vertexTo);
+    std::copy_n(indices.begin() + move.indexFrom, move.indexCount, newIndices.begin() + move.indexTo);
+  }
+  // one free block is left; it is only binned down, so fragmentation() need not reach 0
+  CHECK(allocator.fragmentation() < scattered);
+  CHECK(allocator.freeVertices() == allocator.vertexCapacity() - vertexEnd);
+  CHECK(allocator.freeIndices() == allocator.indexCapacity() - indexEnd);
+
+  // every handle still resolves, now to its moved data
+  for (std::size_t i = 0; i < handles.size(); ++i) {
+    if (!allocator.contains(handles[i])) {
+      continue;
+    }
+    const MeshRange r = allocator.range(handles[i]);
+    CAPTURE(i);
+    CHECK(r.indexCount == 30 + i * 11);
+    CHECK(std::all_of(newVertices.begin() + r.baseVertex,
+                      newVertices.begin() + r.baseVertex + allocator.vertexCount(handles[i]),
+                      [i](int tag) { return tag == static_cast<int>(i); }));
+    CHECK(std::all_of(newIndices.begin() + r.firstIndex, newIndices.begin() + r.firstIndex + r.indexCount,
+                      [i](int tag) { return tag == static_cast<int>(i); }));
+  }
+
+  // the freed slots are reused and the packed tail has room
+  MeshHandle added = allocator.add(100, 100);
+  REQUIRE(added.valid());
+  CHECK(added.index < handles.size());
+  CHECK(allocator.range(added).baseVertex == static_cast<GLint>(vertexEnd));
+}
+
+TEST_CASE("MeshAllocator::defragment repacks near-full allocators") {
+  // capacities that are not bin sizes, filled until add() fails: a packed free tail is binned
+  // down while requests are rounded up, so reallocating the meshes through allocate() would
+  // not fit them all again (with this seed, within the first rounds)
+  std::mt19937 random(13);
+  std::uniform_int_distribution<GLuint> vertexCounts(1, 24);
+  std::uniform_int_distribution<GLuint> indexCounts(1, 40);
+  MeshAllocator allocator(120, 158);
+  std::vector<MeshHandle> handles;
+  for (int round = 0; round < 100; ++round) {
+    CAPTURE(round);
+    for (int failures = 0; failures < 8;) {
+      const MeshHandle handle = allocator.add(vertexCounts(random), indexCounts(random));
+      if (handle.valid()) {
+        handles.push_back(handle);
+      } else {
+        ++failures;
+      }
+    }
+
+    std::vector<int> vertices(allocator.vertexCapacity(), -1);
+    std::vector<int> indices(allocator.indexCapacity(), -1);
+    GLuint liveVertices = 0;
+    GLuint liveIndices = 0;
+    for (const MeshHandle& handle : handles) {
+      const MeshRange r = allocator.range(handle);
+      std::fill_n(vertices.begin() + r.baseVertex, allocator.vertexCount(handle), static_cast<int>(handle.index));
+      std::fill_n(indices.begin() + r.firstIndex, r.indexCount, static_cast<int>(handle.index));
+      liveVertices += allocator.vertexCount(handle);
+      liveIndices += r.indexCount;
+    }
+
+    std::vector<MeshMove> moves = allocator.defragment();
+    REQUIRE(moves.size() == handles.size());
+    std::vector<int> newVertices(vertices.size(), -1);
+    std::vector<int> newIndices(indices.size(), -1);
+    for (const MeshMove& move : moves) {
+      // (written so that a failed allocation, offset 0xFFFFFFFF, cannot wrap around)
+      REQUIRE(move.vertexTo < allocator.vertexCapacity());
+      REQUIRE(move.vertexCount <= allocator.vertexCapacity() - move.vertexTo);
+      REQUIRE(move.indexTo < allocator.indexCapacity());
+      REQUIRE(move.indexCount <= allocator.indexCapacity() - move.indexTo);
+      std::copy_n(vertices.begin() + move.vertexFrom, move.vertexCount, newVertices.begin() + move.vertexTo);
+      std::copy_n(indices.begin() + move.indexFrom, move.indexCount, newIndices.begin() + move.indexTo);
+    }
+    CHECK(allocator.freeVertices() == allocator.vertexCapacity() - liveVertices);
+    CHECK(allocator.freeIndices() == allocator.indexCapacity() - liveIndices);
+
+    // indices packed end to end in their old order, like the vertices
+    std::sort(moves.begin(), moves.end(), [](const MeshMove& a, const MeshMove& b) { return a.indexTo < b.indexTo; });
+    GLuint indexEnd = 0;
+    for (std::size_t k = 0; k < moves.size(); ++k) {
+      CHECK(moves[k].indexTo == indexEnd);
+      CHECK((k == 0 || moves[k].indexFrom > moves[k - 1].indexFrom));
+      indexEnd += moves[k].indexCount;
+    }
+
+    for (const MeshHandle& handle : handles) {
+      const MeshRange r = allocator.range(handle);
+      const int tag = static_cast<int>(handle.index);
+      CHECK(r.baseVertex + allocator.vertexCount(handle) <= liveVertices);
+      CHECK(std::all_of(newVertices.begin() + r.baseVertex,
+                        newVertices.begin() + r.baseVertex + allocator.vertexCount(handle),
+                        [tag](int value) { return value == tag; }));
+      CHECK(std::all_of(newIndices.begin() + r.firstIndex, newIndices.begin() + r.firstIndex + r.indexCount,
+                        [tag](int value) { return value == tag; }));
+    }
+
+    for (std::size_t i = 0; i < handles.size();) {
+      if (random() % 3 == 0) {
+        allocator.remove(handles[i]);
+        handles[i] = handles.back();
+        handles.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+}
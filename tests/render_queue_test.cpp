@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "render_queue.h"
+
+namespace {
+
+// radixSort() must produce exactly what a stable comparison sort by key produces
+void checkAgainstStableSort(std::vector<RenderSortItem> items) {
+  std::vector<RenderSortItem> expected = items;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const RenderSortItem& a, const RenderSortItem& b) { return a.key < b.key; });
+  std::vector<RenderSortItem> scratch(items.size());
+  radixSort(items, scratch);
+  REQUIRE(items.size() == expected.size());
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    CAPTURE(i);
+    CHECK(items[i].key == expected[i].key);
+    CHECK(items[i].index == expected[i].index);
+  }
+}
+
+template <typename MakeKey>
+std::vector<RenderSortItem> randomItems(std::size_t count, MakeKey&& makeKey) {
+  std::vector<RenderSortItem> items(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    items[i] = {makeKey(), static_cast<std::uint32_t>(i)};
+  }
+  return items;
+}
+
+}  // namespace
+
+TEST_CASE("radixSort matches std::stable_sort") {
+  std::mt19937_64 random(7);
+
+  SUBCASE("empty and single item") {
+    checkAgainstStableSort({});
+    checkAgainstStableSort({{42, 0}});
+  }
+  SUBCASE("random 64-bit keys") {
+    checkAgainstStableSort(randomItems(10000, [&] { return random(); }));
+  }
+  SUBCASE("few distinct keys, so stability matters") {
+    checkAgainstStableSort(randomItems(10000, [&] { return (random() % 8) << 37 | (random() % 3); }));
+  }
+  SUBCASE("identical keys skip every pass") {
+    checkAgainstStableSort(randomItems(1000, [] { return std::uint64_t{0x0123456789ABCDEF}; }));
+  }
+  SUBCASE("packed render keys") {
+    std::uniform_real_distribution<float> depth(-0.1f, 1.1f);
+    checkAgainstStableSort(randomItems(20000, [&] {
+      return render_key::make(static_cast<unsigned>(random() % 3), random() % 4 == 0,
+                              static_cast<std::uint32_t>(random() % 5), static_cast<std::uint32_t>(random() % 40),
+                              static_cast<std::uint32_t>(random() % 7), depth(random));
+    }));
+  }
+}
+
+TEST_CASE("render keys order passes, then opaque before translucent") {
+  const std::uint64_t translucentPass0 = render_key::make(0, true, 1, 1, 1, 0.0f);
+  const std::uint64_t opaquePass1 = render_key::make(1, false, 0, 0, 0, 0.0f);
+  CHECK(render_key::make(0, false, 2047, 4095, 4095, 1.0f) < translucentPass0);
+  CHECK(translucentPass0 < opaquePass1);
+}
+
+TEST_CASE("opaque render keys sort by state, then front to back") {
+  CHECK(render_key::make(0, false, 1, 9, 9, 1.0f) < render_key::make(0, false, 2, 0, 0, 0.0f));
+  CHECK(render_key::make(0, false, 1, 1, 9, 1.0f) < render_key::make(0, false, 1, 2, 0, 0.0f));
+  CHECK(render_key::make(0, false, 1, 1, 1, 0.25f) < render_key::make(0, false, 1, 1, 1, 0.75f));
+}
+
+TEST_CASE("translucent render keys sort back to front, then by state") {
+  CHECK(render_key::make(0, true, 9, 9, 9, 0.75f) < render_key::make(0, true, 1, 1, 1, 0.25f));
+  CHECK(render_key::make(0, true, 1, 1, 1, 0.5f) < render_key::make(0, true, 2, 1, 1, 0.5f));
+}
+
+TEST_CASE("render key fields are clamped and truncated to their width") {
+  CHECK(render_key::make(0, false, 1, 1, 1, -1.0f) == render_key::make(0, false, 1, 1, 1, 0.0f));
+  CHECK(render_key::make(0, false, 1, 1, 1, 2.0f) == render_key::make(0, false, 1, 1, 1, 1.0f));
+  CHECK(render_key::make(0, false, 1u << render_key::kProgramBits, 1, 1, 0.5f) ==
+        render_key::make(0, false, 0, 1, 1, 0.5f));
+  CHECK(render_key::make(0, true, 1, 1u << render_key::kPipelineBits, 1, 0.5f) ==
+        render_key::make(0, true, 1, 0, 1, 0.5f));
+}
@@ -0,0 +1,68 @@
+#include "doctest.h"
+#include "scene_graph.h"
+
+TEST_CASE("SceneGraph composes world matrices down the hierarchy") {
+  SceneGraph graph;
+  const SceneNode root = graph.add({}, math::vec3(1.0f, 0.0f, 0.0f));
+  const SceneNode child = graph.add(root, math::vec3(0.0f, 2.0f, 0.0f), {}, math::vec3(2.0f));
+  const SceneNode grandchild = graph.add(child, math::vec3(0.0f, 0.0f, 3.0f));
+  CHECK(graph.update() == 3);
+  CHECK(graph.depthCount() == 3);
+
+  // the grandchild's offset is scaled by its parent
+  CHECK(graph.world(grandchild)[3] == math::vec4(1.0f, 2.0f, 6.0f, 1.0f));
+
+  // only the moved subtree is recomputed
+  graph.setTranslation(child, math::vec3(0.0f, 5.0f, 0.0f));
+  CHECK(graph.update() == 2);
+  CHECK(graph.world(grandchild)[3] == math::vec4(1.0f, 5.0f, 6.0f, 1.0f));
+  CHECK(graph.world(root)[3] == math::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+}
+
+TEST_CASE("SceneGraph handles go stale when their id is reused") {
+  SceneGraph graph;
+  const SceneNode root = graph.add();
+  const SceneNode child = graph.add(root, math::vec3(1.0f, 2.0f, 3.0f));
+  graph.update();
+
+  graph.remove(root);  // takes the child with it on update()
+  CHECK(!graph.contains(root));
+  graph.update();
+  CHECK(graph.size() == 0);
+  CHECK(!graph.contains(child));
+
+  const SceneNode reused = graph.add({}, math::vec3(7.0f, 0.0f, 0.0f));
+  CHECK((reused.id == root.id || reused.id == child.id));
+  CHECK(graph.contains(reused));
+  CHECK(!graph.contains(root));
+  CHECK(!graph.contains(child));
+  CHECK(!graph.contains(SceneNode{}));
+
+  // a stale handle neither writes through to the node that took over its id nor reads it
+  const SceneNode stale = reused.id == root.id ? root : child;
+  graph.setTranslation(stale, math::vec3(-1.0f, -1.0f, -1.0f));
+  graph.setLocal(stale, math::vec3(-1.0f), {}, math::vec3(-1.0f));
+  graph.setRotation(stale, math::quat(1.0f, 0.0f, 0.0f, 0.0f));
+  graph.setScale(stale, math::vec3(5.0f));
+  CHECK(graph.translation(reused) == math::vec3(7.0f, 0.0f, 0.0f));
+  CHECK(graph.scale(reused) == math::vec3(1.0f));
+  CHECK(graph.translation(stale) == math::vec3());
+  CHECK(graph.scale(stale) == math::vec3(1.0f));
+
+  CHECK(graph.update() == 1);
+  CHECK(graph.world(reused)[3] == math::vec4(7.0f, 0.0f, 0.0f, 1.0f));
+  CHECK(graph.world(stale)[3] == math::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+TEST_CASE("SceneGraph ignores handles it never issued") {
+  SceneGraph graph;
+  const SceneNode node = graph.add();
+  SceneNode outOfRange;
+  outOfRange.id = 100;
+  outOfRange.generation = 1;
+  graph.setTranslation(outOfRange, math::vec3(1.0f));
+  graph.remove(outOfRange);
+  CHECK(graph.translation(outOfRange) == math::vec3());
+  CHECK(graph.contains(node));
+  CHECK(graph.update() == 1);
+}
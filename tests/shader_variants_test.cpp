@@ -0,0 +1,74 @@
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "doctest.h"
+#include "shader_variants.h"
+
+// ShaderVariantCache with a builder that records what it is asked to build instead of
+// submitting to a ProgramLibrary.
+
+namespace {
+
+struct FakeBuilder {
+  std::vector<std::string> built;  // ShaderDefines::name() of every permutation, in order
+
+  ShaderVariantCache::Submit submit() {
+    return [this](const ShaderDefines& defines) {
+      built.push_back(defines.name());
+      return built.size() - 1;
+    };
+  }
+};
+
+}  // namespace
+
+TEST_CASE("ShaderVariantCache builds each permutation once") {
+  FakeBuilder builder;
+  ShaderVariantCache variants(builder.submit(), "shaders/4.2.texture.vs", "shaders/4.2.texture.fs");
+  const ShaderDefines batched{{"DRAW_ID", "1"}, {"MAX_DRAWS", "256"}};
+
+  CHECK(!variants.contains({}));
+  const auto plain = variants.submit({});
+  const auto drawId = variants.submit(batched);
+  CHECK(plain != drawId);
+  CHECK(variants.submit({}) == plain);
+  CHECK(variants.submit(batched) == drawId);
+  CHECK(variants.contains({}));
+  CHECK(variants.contains(batched));
+  CHECK(variants.size() == 2);
+  CHECK(builder.built == std::vector<std::string>{"<default>", "DRAW_ID=1,MAX_DRAWS=256"});
+  CHECK(variants.vertexPath() == "shaders/4.2.texture.vs");
+  CHECK(variants.fragmentPath() == "shaders/4.2.texture.fs");
+}
+
+TEST_CASE("ShaderVariantCache keys differ by define set, not by the order defines are set in") {
+  FakeBuilder builder;
+  ShaderVariantCache variants(builder.submit(), "a.vs", "a.fs");
+
+  const auto forward = variants.submit(ShaderDefines().set("DRAW_ID").set("MAX_DRAWS", "256"));
+  const auto backward = variants.submit(ShaderDefines().set("MAX_DRAWS", "256").set("DRAW_ID"));
+  CHECK(forward == backward);
+  // a later set() of the same define replaces its value
+  CHECK(variants.submit(ShaderDefines().set("MAX_DRAWS", "128").set("DRAW_ID").set("MAX_DRAWS", "256")) == forward);
+  CHECK(variants.size() == 1);
+
+  SUBCASE("other values, other names and subsets are other permutations") {
+    const std::vector<ShaderDefines> others = {
+        {{"DRAW_ID", "1"}, {"MAX_DRAWS", "128"}},
+        {{"DRAW_ID", "1"}},
+        {{"MAX_DRAWS", "256"}},
+        {{"DRAW_ID", "0"}, {"MAX_DRAWS", "256"}},
+        // the separators keep name / value boundaries apart
+        {{"DRAW_ID", "1MAX_DRAWS256"}},
+        {{"DRAW_I", "D1"}, {"MAX_DRAWS", "256"}},
+    };
+    for (const ShaderDefines& defines : others) {
+      CAPTURE(defines.name());
+      CHECK(defines.key() != ShaderDefines({{"DRAW_ID", "1"}, {"MAX_DRAWS", "256"}}).key());
+      CHECK(variants.submit(defines) != forward);
+    }
+    CHECK(variants.size() == 1 + others.size());
+    CHECK(builder.built.size() == variants.size());
+  }
+}
@@ -0,0 +1,166 @@
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+#include "simd_math.h"
+
+// The vector paths (SSE / AVX / NEON, whichever the build enables) against double precision
+// references. The same file is built into a second target with SIMD_MATH_SCALAR, so both the
+// intrinsics and the portable fallbacks are covered.
+
+namespace {
+
+using math::mat4;
+using math::vec3;
+using math::vec4;
+
+float component(const vec4& v, std::size_t row) { return row == 0 ? v.x : row == 1 ? v.y : row == 2 ? v.z : v.w; }
+
+// random but diagonally dominant, so well conditioned; with a projective last row on request
+mat4 randomMatrix(std::mt19937& random, bool projective) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  mat4 m;
+  for (std::size_t c = 0; c < 4; ++c) {
+    m[c] = vec4(unit(random), unit(random), unit(random), projective ? unit(random) * 0.25f : 0.0f);
+  }
+  m[0].x += 3.0f;
+  m[1].y += 3.0f;
+  m[2].z += 3.0f;
+  if (!projective) {
+    m[3].w = 1.0f;
+  }
+  return m;
+}
+
+double element(const mat4& m, std::size_t column, std::size_t row) { return component(m[column], row); }
+
+void checkMatrixNear(const mat4& actual, const double (&expected)[4][4], double epsilon) {
+  for (std::size_t c = 0; c < 4; ++c) {
+    for (std::size_t r = 0; r < 4; ++r) {
+      CAPTURE(c);
+      CAPTURE(r);
+      CHECK(std::fabs(element(actual, c, r) - expected[c][r]) <= epsilon * (1.0 + std::fabs(expected[c][r])));
+    }
+  }
+}
+
+// product[c][r] = sum_k a[k][r] * b[c][k], in double
+void referenceProduct(const mat4& a, const mat4& b, double (&product)[4][4]) {
+  for (std::size_t c = 0; c < 4; ++c) {
+    for (std::size_t r = 0; r < 4; ++r) {
+      double sum = 0.0;
+      for (std::size_t k = 0; k < 4; ++k) {
+        sum += element(a, k, r) * element(b, c, k);
+      }
+      product[c][r] = sum;
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("dot(vec4) matches the scalar sum, at run time and in constant evaluation") {
+  static_assert(math::dot(vec4(1.0f, 2.0f, 3.0f, 4.0f), vec4(5.0f, 6.0f, 7.0f, 8.0f)) == 70.0f);
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> unit(-10.0f, 10.0f);
+  for (int i = 0; i < 1000; ++i) {
+    const vec4 a(unit(random), unit(random), unit(random), unit(random));
+    const vec4 b(unit(random), unit(random), unit(random), unit(random));
+    const double expected = double{a.x} * b.x + double{a.y} * b.y + double{a.z} * b.z + double{a.w} * b.w;
+    CHECK(math::dot(a, b) == doctest::Approx(expected).epsilon(1e-5));
+  }
+}
+
+TEST_CASE("mat4 * vec4 and mat4 * mat4 match a double precision product") {
+  std::mt19937 random(2);
+  for (int i = 0; i < 200; ++i) {
+    const mat4 a = randomMatrix(random, true);
+    const mat4 b = randomMatrix(random, true);
+    double expected[4][4];
+    referenceProduct(a, b, expected);
+    checkMatrixNear(a * b, expected, 1e-5);
+
+    // each column of the product is a * column of b
+    const vec4 column = a * b[2];
+    for (std::size_t r = 0; r < 4; ++r) {
+      CHECK(component(column, r) == doctest::Approx(expected[2][r]).epsilon(1e-5));
+    }
+  }
+
+  constexpr mat4 shifted = math::translate(vec3(1.0f, 2.0f, 3.0f)) * math::scale(vec3(2.0f, 2.0f, 2.0f));
+  static_assert(shifted[0].x == 2.0f && shifted[3].x == 1.0f && shifted[3].z == 3.0f);
+  const mat4 runtime = math::translate(vec3(1.0f, 2.0f, 3.0f)) * math::scale(vec3(2.0f, 2.0f, 2.0f));
+  for (std::size_t c = 0; c < 4; ++c) {
+    CHECK(runtime[c] == shifted[c]);
+  }
+}
+
+TEST_CASE("inverse(mat4) times the matrix is the identity") {
+  std::mt19937 random(3);
+  constexpr double kIdentity[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+  for (int i = 0; i < 200; ++i) {
+    const mat4 m = randomMatrix(random, i % 2 == 0);
+    checkMatrixNear(m * math::inverse(m), kIdentity, 1e-4);
+    checkMatrixNear(math::inverse(m) * m, kIdentity, 1e-4);
+    if (i % 2 != 0) {
+      // affine: the cheaper inverse agrees with the general one
+      const mat4 general = math::inverse(m);
+      const mat4 affine = math::inverseAffine(m);
+      for (std::size_t c = 0; c < 4; ++c) {
+        for (std::size_t r = 0; r < 4; ++r) {
+          CHECK(element(affine, c, r) == doctest::Approx(element(general, c, r)).epsilon(1e-4));
+        }
+      }
+    }
+  }
+
+  const mat4 projection = math::perspective(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+  checkMatrixNear(projection * math::inverse(projection), kIdentity, 1e-4);
+}
+
+TEST_CASE("transformPoints matches mat4 * vec4 for every count, tails included") {
+  std::mt19937 random(4);
+  std::uniform_real_distribution<float> unit(-50.0f, 50.0f);
+  const mat4 m = randomMatrix(random, true);
+
+  // below, at and around the 4 and 8 wide blocks
+  for (std::size_t count : {0u, 1u, 3u, 4u, 5u, 7u, 8u, 9u, 13u, 15u, 16u, 17u, 31u, 1001u}) {
+    CAPTURE(count);
+    std::vector<float> x(count), y(count), z(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      x[i] = unit(random);
+      y[i] = unit(random);
+      z[i] = unit(random);
+    }
+    std::vector<float> outX(count), outY(count), outZ(count), outW(count);
+    math::transformPoints(m, x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), outW.data(),
+                          count);
+    for (std::size_t i = 0; i < count; ++i) {
+      CAPTURE(i);
+      double expected[4];
+      for (std::size_t r = 0; r < 4; ++r) {
+        expected[r] = element(m, 0, r) * x[i] + element(m, 1, r) * y[i] + element(m, 2, r) * z[i] + element(m, 3, r);
+      }
+      CHECK(outX[i] == doctest::Approx(expected[0]).epsilon(1e-5));
+      CHECK(outY[i] == doctest::Approx(expected[1]).epsilon(1e-5));
+      CHECK(outZ[i] == doctest::Approx(expected[2]).epsilon(1e-5));
+      CHECK(outW[i] == doctest::Approx(expected[3]).epsilon(1e-5));
+    }
+
+    // in place and without w, through the SoA overload
+    math::Vec3SoA points;
+    points.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      points.set(i, {x[i], y[i], z[i]});
+    }
+    math::transformPoints(m, points, points);
+    for (std::size_t i = 0; i < count; ++i) {
+      CHECK(points.x[i] == outX[i]);
+      CHECK(points.y[i] == outY[i]);
+      CHECK(points.z[i] == outZ[i]);
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#include <array>
+#include <cstddef>
+#include <set>
+
+#include "doctest.h"
+#include "uniform_buffer.h"
+
+// checkBlockLayout() against structs whose C++ layout does and does not match the GLSL rules,
+// and the frame regions of UniformRing's StreamBuffer (its GL-free StreamAllocator half)
+
+namespace {
+
+struct PackedVec3 {
+  glsl::vec4 color;
+  alignas(16) glsl::vec3 direction;
+  float intensity;  // std140 packs a scalar into the vec3's last slot
+};
+
+struct UnalignedVec3 {
+  float intensity;
+  glsl::vec3 direction;  // GLSL puts it at 16, C++ at 4
+};
+
+struct FloatArray {
+  float weights[4];
+};
+
+struct Vec4Array {
+  glsl::vec4 offsets[3];
+};
+
+struct MissingTailPadding {
+  float scale;
+  float bias;
+  float gamma;
+};
+
+struct Matrices {
+  glsl::mat4 model;
+  glsl::mat3 normal;
+  std::int32_t flags;
+};
+
+}  // namespace
+
+TEST_CASE("checkBlockLayout accepts matching layouts") {
+  CHECK(checkBlockLayout<PackedVec3>(BlockLayout::Std140,
+                                     {BLOCK_MEMBER(PackedVec3, color), BLOCK_MEMBER(PackedVec3, direction),
+                                      BLOCK_MEMBER(PackedVec3, intensity)}));
+  CHECK(checkBlockLayout<Matrices>(BlockLayout::Std140, {BLOCK_MEMBER(Matrices, model), BLOCK_MEMBER(Matrices, normal),
+                                                         BLOCK_MEMBER(Matrices, flags)}));
+  CHECK(checkBlockLayout<FloatArray>(BlockLayout::Std430, {BLOCK_MEMBER(FloatArray, weights)}));
+  CHECK(checkBlockLayout<MissingTailPadding>(
+      BlockLayout::Std430, {BLOCK_MEMBER(MissingTailPadding, scale), BLOCK_MEMBER(MissingTailPadding, bias),
+                            BLOCK_MEMBER(MissingTailPadding, gamma)}));
+}
+
+TEST_CASE("checkBlockLayout rejects a misplaced vec3") {
+  CHECK_FALSE(checkBlockLayout<UnalignedVec3>(
+      BlockLayout::Std140, {BLOCK_MEMBER(UnalignedVec3, intensity), BLOCK_MEMBER(UnalignedVec3, direction)}));
+  CHECK_FALSE(checkBlockLayout<UnalignedVec3>(
+      BlockLayout::Std430, {BLOCK_MEMBER(UnalignedVec3, intensity), BLOCK_MEMBER(UnalignedVec3, direction)}));
+}
+
+TEST_CASE("checkBlockLayout checks the array stride of each layout") {
+  // std140 rounds the stride of a float array up to 16 bytes, std430 does not
+  CHECK_FALSE(checkBlockLayout<FloatArray>(BlockLayout::Std140, {BLOCK_MEMBER(FloatArray, weights)}));
+  CHECK(checkBlockLayout<Vec4Array>(BlockLayout::Std140, {BLOCK_MEMBER(Vec4Array, offsets)}));
+  CHECK(checkBlockLayout<Vec4Array>(BlockLayout::Std430, {BLOCK_MEMBER(Vec4Array, offsets)}));
+}
+
+TEST_CASE("checkBlockLayout checks the block size") {
+  // std140 rounds the block up to 16 bytes, the C++ struct ends at 12
+  CHECK_FALSE(checkBlockLayout<MissingTailPadding>(
+      BlockLayout::Std140, {BLOCK_MEMBER(MissingTailPadding, scale), BLOCK_MEMBER(MissingTailPadding, bias),
+                            BLOCK_MEMBER(MissingTailPadding, gamma)}));
+}
+
+TEST_CASE("checkBlockLayout checks the members in declaration order") {
+  CHECK_FALSE(checkBlockLayout<PackedVec3>(BlockLayout::Std140,
+                                           {BLOCK_MEMBER(PackedVec3, direction), BLOCK_MEMBER(PackedVec3, color),
+                                            BLOCK_MEMBER(PackedVec3, intensity)}));
+}
+
+namespace {
+
+// a common GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT; UniformRing aligns its regions to it
+constexpr std::size_t kUniformAlignment = 256;
+
+StreamAllocator uniformRegions(std::size_t bytesPerFrame) {
+  return StreamAllocator(bytesPerFrame, UniformRing::kFrames, alignUp(256, kUniformAlignment));
+}
+
+}  // namespace
+
+TEST_CASE("UniformRing regions wrap around after kFrames frames") {
+  StreamAllocator regions = uniformRegions(1000);
+  REQUIRE(regions.regionSize() == 1024);
+  REQUIRE(regions.totalSize() == 1024 * UniformRing::kFrames);
+
+  std::array<std::size_t, 3 * UniformRing::kFrames> frameBlocks{};
+  for (std::size_t frame = 0; frame < frameBlocks.size(); ++frame) {
+    CAPTURE(frame);
+    regions.beginFrame();
+    // a frame block, then per-draw blocks, each on the offset alignment
+    frameBlocks[frame] = regions.allocate(sizeof(glsl::mat4) + sizeof(glsl::vec4), kUniformAlignment);
+    REQUIRE(frameBlocks[frame] != StreamAllocator::kNoSpace);
+    CHECK(frameBlocks[frame] == regions.regionOffset());
+    for (std::size_t draw = 1; draw < 4; ++draw) {
+      const std::size_t offset = regions.allocate(sizeof(glsl::mat4), kUniformAlignment);
+      CHECK(offset == regions.regionOffset() + draw * kUniformAlignment);
+    }
+    CHECK(regions.used() == 3 * kUniformAlignment + sizeof(glsl::mat4));
+    regions.endFrame(nullptr);
+  }
+
+  // kFrames different regions inside the buffer, then the same ones again in the same order
+  const std::set<std::size_t> distinct(frameBlocks.begin(), frameBlocks.begin() + UniformRing::kFrames);
+  CHECK(distinct.size() == UniformRing::kFrames);
+  for (std::size_t frame = 0; frame < frameBlocks.size(); ++frame) {
+    CHECK(frameBlocks[frame] < regions.totalSize());
+    if (frame >= UniformRing::kFrames) {
+      CHECK(frameBlocks[frame] == frameBlocks[frame - UniformRing::kFrames]);
+    }
+  }
+}
+
+TEST_CASE("UniformRing hands back a region's fence before reusing it") {
+  StreamAllocator regions = uniformRegions(512);
+  // stand-ins for glFenceSync results, only compared
+  std::array<int, 4 * UniformRing::kFrames> fenceObjects{};
+  auto fence = [&](std::size_t frame) { return reinterpret_cast<GLsync>(&fenceObjects[frame]); };
+
+  for (std::size_t frame = 0; frame < fenceObjects.size(); ++frame) {
+    CAPTURE(frame);
+    const GLsync wait = regions.beginFrame();
+    // nothing to wait for on the first use of each region, afterwards the fence of the frame
+    // that wrote it kFrames ago
+    CHECK(wait == (frame < UniformRing::kFrames ? nullptr : fence(frame - UniformRing::kFrames)));
+    CHECK(regions.allocate(64, kUniformAlignment) != StreamAllocator::kNoSpace);
+    regions.endFrame(fence(frame));
+  }
+
+  // the fences handed back are gone; the last kFrames are still outstanding
+  std::size_t outstanding = 0;
+  for (GLsync pending : regions.fences()) {
+    outstanding += pending != nullptr ? 1 : 0;
+  }
+  CHECK(outstanding == UniformRing::kFrames);
+  for (std::size_t frame = fenceObjects.size(); frame < fenceObjects.size() + UniformRing::kFrames; ++frame) {
+    CHECK(regions.beginFrame() == fence(frame - UniformRing::kFrames));
+  }
+  CHECK(regions.beginFrame() == nullptr);  // handed back once only
+}
+
+TEST_CASE("UniformRing regions refuse blocks past their end until the next frame") {
+  StreamAllocator regions = uniformRegions(512);
+  regions.beginFrame();
+  CHECK(regions.allocate(sizeof(glsl::mat4), kUniformAlignment) == regions.regionOffset());
+  CHECK(regions.allocate(sizeof(glsl::mat4), kUniformAlignment) == regions.regionOffset() + 256);
+  // aligned to 512, the end of the region
+  CHECK(regions.allocate(sizeof(glsl::mat4), kUniformAlignment) == StreamAllocator::kNoSpace);
+  CHECK(regions.allocate(513, 4) == StreamAllocator::kNoSpace);
+  CHECK(regions.exhausted() == 2);
+
+  regions.endFrame(nullptr);
+  regions.beginFrame();
+  CHECK(regions.used() == 0);
+  CHECK(regions.allocate(512, kUniformAlignment) == regions.regionOffset());
+  CHECK(regions.exhausted() == 2);
+}